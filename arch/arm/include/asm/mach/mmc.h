@@ -134,6 +134,7 @@ struct mmc_platform_data {
 	bool pclk_src_dfab;
 	int (*cfg_mpm_sdiowakeup)(struct device *, unsigned);
 	bool sdcc_v4_sup;
+	bool cmd23_sup;		/* multi-block transfers may use CMD23 */
 	unsigned int wpswitch_gpio;
 	unsigned char wpswitch_polarity;
 	struct msm_mmc_slot_reg_data *vreg_data;
@@ -25,11 +25,28 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/sched.h>
+#include <linux/spinlock.h>
 #include <linux/suspend.h>
 
 #include "acpuclock.h"
 
-#ifdef CONFIG_SMP
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+/*
+ * Only the latest request is kept: targets that arrive while a switch is
+ * still pending or in progress replace it rather than queue behind it.
+ */
+struct cpufreq_async_struct {
+	struct work_struct work;
+	spinlock_t lock;
+	struct cpufreq_policy *policy;
+	unsigned int frequency;		/* 0 once picked up */
+	unsigned long requests;
+	unsigned long coalesced;
+	unsigned long failed;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_async_struct, cpufreq_async);
+#elif defined(CONFIG_SMP)
 struct cpufreq_work_struct {
 	struct work_struct work;
 	struct cpufreq_policy *policy;
@@ -39,6 +56,9 @@ struct cpufreq_work_struct {
 };
 
 static DEFINE_PER_CPU(struct cpufreq_work_struct, cpufreq_work);
+#endif
+
+#if defined(CONFIG_SMP) || defined(CONFIG_MSM_CPU_FREQ_ASYNC)
 static struct workqueue_struct *msm_cpufreq_wq;
 #endif
 
@@ -76,7 +96,64 @@ static int set_cpu_freq(struct cpufreq_policy *policy, unsigned int new_freq)
 	return ret;
 }
 
-#ifdef CONFIG_SMP
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+static void set_cpu_async_work(struct work_struct *work)
+{
+	struct cpufreq_async_struct *async =
+		container_of(work, struct cpufreq_async_struct, work);
+	struct cpufreq_policy *policy;
+	unsigned int new_freq;
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&async->lock, flags);
+	policy = async->policy;
+	new_freq = async->frequency;
+	async->frequency = 0;
+	spin_unlock_irqrestore(&async->lock, flags);
+
+	if (!new_freq)
+		return;
+
+	mutex_lock(&per_cpu(cpufreq_suspend, policy->cpu).suspend_mutex);
+	if (!per_cpu(cpufreq_suspend, policy->cpu).device_suspended &&
+	    (new_freq != policy->cur || override_cpu))
+		ret = set_cpu_freq(policy, new_freq);
+	mutex_unlock(&per_cpu(cpufreq_suspend, policy->cpu).suspend_mutex);
+
+	/* the target call has long returned 0; this is all that is left */
+	if (ret) {
+		pr_err("cpufreq: cpu%d switch to %u kHz failed (%d)\n",
+		       policy->cpu, new_freq, ret);
+		spin_lock_irqsave(&async->lock, flags);
+		async->failed++;
+		spin_unlock_irqrestore(&async->lock, flags);
+	}
+}
+
+/*
+ * Hand the switch to msm_cpufreq_wq and return.  policy->cur is updated by
+ * the transition notifiers once the clock has actually moved.
+ */
+static int set_cpu_freq_async(struct cpufreq_policy *policy,
+			      unsigned int new_freq)
+{
+	struct cpufreq_async_struct *async =
+		&per_cpu(cpufreq_async, policy->cpu);
+	unsigned long flags;
+
+	spin_lock_irqsave(&async->lock, flags);
+	async->requests++;
+	if (async->frequency)
+		async->coalesced++;
+	async->policy = policy;
+	async->frequency = new_freq;
+	spin_unlock_irqrestore(&async->lock, flags);
+
+	queue_work_on(policy->cpu, msm_cpufreq_wq, &async->work);
+	return 0;
+}
+#elif defined(CONFIG_SMP)
 static void set_cpu_work(struct work_struct *work)
 {
 	struct cpufreq_work_struct *cpu_work =
@@ -94,18 +171,21 @@ static int msm_cpufreq_target(struct cpufreq_policy *policy,
 	int ret = -EFAULT;
 	int index;
 	struct cpufreq_frequency_table *table;
-#ifdef CONFIG_SMP
+#if defined(CONFIG_SMP) && !defined(CONFIG_MSM_CPU_FREQ_ASYNC)
 	struct cpufreq_work_struct *cpu_work = NULL;
 	cpumask_var_t mask;
+#endif
 
-	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
-		return -ENOMEM;
-
+#ifdef CONFIG_SMP
 	if (!cpu_active(policy->cpu)) {
 		pr_info("cpufreq: cpu %d is not active.\n", policy->cpu);
 		return -ENODEV;
 	}
 #endif
+#if defined(CONFIG_SMP) && !defined(CONFIG_MSM_CPU_FREQ_ASYNC)
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+#endif
 
 	mutex_lock(&per_cpu(cpufreq_suspend, policy->cpu).suspend_mutex);
 
@@ -130,7 +210,9 @@ static int msm_cpufreq_target(struct cpufreq_policy *policy,
 		policy->min, policy->max, table[index].frequency);
 #endif
 
-#ifdef CONFIG_SMP
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+	ret = set_cpu_freq_async(policy, table[index].frequency);
+#elif defined(CONFIG_SMP)
 	cpu_work = &per_cpu(cpufreq_work, policy->cpu);
 	cpu_work->policy = policy;
 	cpu_work->frequency = table[index].frequency;
@@ -171,7 +253,9 @@ static int __cpuinit msm_cpufreq_init(struct cpufreq_policy *policy)
 	int cur_freq;
 	int index;
 	struct cpufreq_frequency_table *table;
-#ifdef CONFIG_SMP
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+	struct cpufreq_async_struct *async = NULL;
+#elif defined(CONFIG_SMP)
 	struct cpufreq_work_struct *cpu_work = NULL;
 #endif
 
@@ -210,7 +294,12 @@ static int __cpuinit msm_cpufreq_init(struct cpufreq_policy *policy)
 
 	policy->cpuinfo.transition_latency =
 		acpuclk_get_switch_time() * NSEC_PER_USEC;
-#ifdef CONFIG_SMP
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+	async = &per_cpu(cpufreq_async, policy->cpu);
+	INIT_WORK(&async->work, set_cpu_async_work);
+	spin_lock_init(&async->lock);
+	async->frequency = 0;
+#elif defined(CONFIG_SMP)
 	cpu_work = &per_cpu(cpufreq_work, policy->cpu);
 	INIT_WORK(&cpu_work->work, set_cpu_work);
 	init_completion(&cpu_work->complete);
@@ -219,6 +308,15 @@ static int __cpuinit msm_cpufreq_init(struct cpufreq_policy *policy)
 	return 0;
 }
 
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+/* The policy is about to be freed; make sure no switch still refers to it */
+static int msm_cpufreq_exit(struct cpufreq_policy *policy)
+{
+	cancel_work_sync(&per_cpu(cpufreq_async, policy->cpu).work);
+	return 0;
+}
+#endif
+
 static int msm_cpufreq_suspend(void)
 {
 	int cpu;
@@ -277,12 +375,37 @@ static ssize_t store_mfreq(struct sysdev_class *class,
 
 static SYSDEV_CLASS_ATTR(mfreq, 0200, NULL, store_mfreq);
 
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+static ssize_t show_mfreq_async(struct sysdev_class *class,
+			struct sysdev_class_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct cpufreq_async_struct *async =
+			&per_cpu(cpufreq_async, cpu);
+
+		len += snprintf(buf + len, PAGE_SIZE - len,
+				"cpu%d requests %lu coalesced %lu failed %lu\n",
+				cpu, async->requests, async->coalesced,
+				async->failed);
+	}
+	return len;
+}
+
+static SYSDEV_CLASS_ATTR(mfreq_async, 0444, show_mfreq_async, NULL);
+#endif
+
 static struct cpufreq_driver msm_cpufreq_driver = {
 	/* lps calculations are handled here. */
 	.flags		= CPUFREQ_STICKY | CPUFREQ_CONST_LOOPS,
 	.init		= msm_cpufreq_init,
 	.verify		= msm_cpufreq_verify,
 	.target		= msm_cpufreq_target,
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+	.exit		= msm_cpufreq_exit,
+#endif
 	.name		= "msm",
 };
 
@@ -298,13 +421,25 @@ static int __init msm_cpufreq_register(void)
 			&attr_mfreq.attr);
 	if (err)
 		pr_err("Failed to create sysfs mfreq\n");
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+	err = sysfs_create_file(&cpu_sysdev_class.kset.kobj,
+			&attr_mfreq_async.attr);
+	if (err)
+		pr_err("Failed to create sysfs mfreq_async\n");
+#endif
 
 	for_each_possible_cpu(cpu) {
 		mutex_init(&(per_cpu(cpufreq_suspend, cpu).suspend_mutex));
 		per_cpu(cpufreq_suspend, cpu).device_suspended = 0;
 	}
 
-#ifdef CONFIG_SMP
+#ifdef CONFIG_MSM_CPU_FREQ_ASYNC
+	/*
+	 * High priority so a ramp-up is not left waiting behind the very
+	 * work that made the governor ask for it.
+	 */
+	msm_cpufreq_wq = alloc_workqueue("msm-cpufreq", WQ_HIGHPRI, 0);
+#elif defined(CONFIG_SMP)
 	msm_cpufreq_wq = create_workqueue("msm-cpufreq");
 #endif
 
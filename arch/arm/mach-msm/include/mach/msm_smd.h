@@ -154,4 +154,58 @@ int smd_write_segment(smd_channel_t *ch, void *data, int len, int user_buf);
  */
 int smd_write_end(smd_channel_t *ch);
 
+struct kvec;
+
+/* Gathers a list of kernel buffers into the channel with a single
+ * notification of the remote processor.  On packet channels the
+ * segments form one packet and are never partially written.
+ *
+ * @ch: channel to write to
+ * @iov: array of kernel buffers
+ * @nr_segs: number of entries in @iov
+ *
+ * Returns:
+ *      number of bytes written
+ *      -ENODEV - invalid smd channel
+ *      -EINVAL - invalid segment list
+ *      -EBUSY - packet transaction in progress
+ *      -ENOMEM - not enough room for the whole packet
+ */
+int smd_write_segments(smd_channel_t *ch, const struct kvec *iov, int nr_segs);
+
+/* Scatters readable data into a list of kernel buffers.  On packet
+ * channels no more than the remainder of the current packet is read.
+ * Like smd_read(), must not be called from the notify callback; use
+ * the _from_cb variant there.
+ *
+ * Returns number of bytes read or -ENODEV/-EINVAL.
+ */
+int smd_read_segments(smd_channel_t *ch, struct kvec *iov, int nr_segs);
+int smd_read_segments_from_cb(smd_channel_t *ch, struct kvec *iov,
+			      int nr_segs);
+
+/* Zero-copy access to the fifo.  smd_read_peek() returns the number of
+ * contiguous readable bytes at *ptr (bounded by the current packet on
+ * packet channels); the caller consumes them in place and then releases
+ * them with smd_read_commit().
+ *
+ * smd_write_reserve() returns the number of contiguous free bytes at
+ * *ptr; after filling them in place the caller publishes them with
+ * smd_write_commit(), which notifies the remote processor.  On packet
+ * channels a transaction must first be opened with smd_write_start()
+ * and reservations are bounded by the bytes still owed to it.
+ *
+ * Data may wrap at the end of the fifo, so callers loop until their
+ * buffer is complete.  Commits return the number of bytes committed or
+ * -EINVAL if @len exceeds what was peeked/reserved.
+ *
+ * smd_read_commit() takes the lock the notify callback runs under; from
+ * the callback use smd_read_commit_from_cb() instead.
+ */
+int smd_read_peek(smd_channel_t *ch, void **ptr);
+int smd_read_commit(smd_channel_t *ch, int len);
+int smd_read_commit_from_cb(smd_channel_t *ch, int len);
+int smd_write_reserve(smd_channel_t *ch, void **ptr);
+int smd_write_commit(smd_channel_t *ch, int len);
+
 #endif
@@ -28,14 +28,10 @@
 #include <linux/spinlock.h>
 
 struct rq_data {
-	unsigned int rq_avg;
 	unsigned int rq_poll_ms;
 	unsigned int def_timer_ms;
 	unsigned int def_interval;
-	int64_t last_time;
-	int64_t total_time;
 	int64_t def_start_time;
-	struct delayed_work rq_work;
 	struct attribute_group *attr_group;
 	struct kobject *kobj;
 	struct delayed_work def_timer_work;
@@ -45,42 +41,6 @@ static struct rq_data rq_info;
 static DEFINE_SPINLOCK(rq_lock);
 static struct workqueue_struct *rq_wq;
 
-static void rq_work_fn(struct work_struct *work)
-{
-	int64_t time_diff = 0;
-	int64_t rq_avg = 0;
-	unsigned long flags = 0;
-
-	spin_lock_irqsave(&rq_lock, flags);
-
-	if (!rq_info.last_time)
-		rq_info.last_time = ktime_to_ns(ktime_get());
-	if (!rq_info.rq_avg)
-		rq_info.total_time = 0;
-
-	rq_avg = nr_running() * 10;
-	time_diff = ktime_to_ns(ktime_get()) - rq_info.last_time;
-	do_div(time_diff, (1000 * 1000));
-
-	if (time_diff && rq_info.total_time) {
-		rq_avg = (rq_avg * time_diff) +
-			(rq_info.rq_avg * rq_info.total_time);
-		do_div(rq_avg, rq_info.total_time + time_diff);
-	}
-
-	rq_info.rq_avg =  (unsigned int)rq_avg;
-
-	/* Set the next poll */
-	if (rq_info.rq_poll_ms)
-		queue_delayed_work(rq_wq, &rq_info.rq_work,
-			msecs_to_jiffies(rq_info.rq_poll_ms));
-
-	rq_info.total_time += time_diff;
-	rq_info.last_time = ktime_to_ns(ktime_get());
-
-	spin_unlock_irqrestore(&rq_lock, flags);
-}
-
 static void def_work_fn(struct work_struct *work)
 {
 	int64_t diff;
@@ -93,19 +53,23 @@ static void def_work_fn(struct work_struct *work)
 	sysfs_notify(rq_info.kobj, NULL, "def_timer_ms");
 }
 
+/*
+ * The scheduler keeps a decayed nr_running average per CPU, updated on
+ * every enqueue and dequeue, so there is nothing to sample here.
+ */
 static ssize_t show_run_queue_avg(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
-	unsigned int val = 0;
-	unsigned long flags = 0;
+	unsigned long val = 0;
+	int cpu;
 
-	spin_lock_irqsave(&rq_lock, flags);
-	/* rq avg currently available only on one core */
-	val = rq_info.rq_avg;
-	rq_info.rq_avg = 0;
-	spin_unlock_irqrestore(&rq_lock, flags);
+	for_each_online_cpu(cpu)
+		val += sched_cpu_nr_running_avg(cpu);
+
+	/* in tenths of a task */
+	val = (val * 10 + SCHED_LOAD_SCALE / 2) >> SCHED_LOAD_SHIFT;
 
-	return sprintf(buf, "%d.%d\n", val/10, val%10);
+	return sprintf(buf, "%lu.%lu\n", val/10, val%10);
 }
 
 static ssize_t show_run_queue_poll_ms(struct kobject *kobj,
@@ -121,28 +85,18 @@ static ssize_t show_run_queue_poll_ms(struct kobject *kobj,
 	return ret;
 }
 
+/* No longer drives any polling; kept for userspace that still sets it */
 static ssize_t store_run_queue_poll_ms(struct kobject *kobj,
 		struct kobj_attribute *attr, const char *buf, size_t count)
 {
-	int val = 0;
+	unsigned int val = 0;
 	unsigned long flags = 0;
-	static DEFINE_MUTEX(lock_poll_ms);
-
-	mutex_lock(&lock_poll_ms);
 
 	spin_lock_irqsave(&rq_lock, flags);
 	sscanf(buf, "%u", &val);
 	rq_info.rq_poll_ms = val;
 	spin_unlock_irqrestore(&rq_lock, flags);
 
-	if (val <= 0)
-		cancel_delayed_work(&rq_info.rq_work);
-	else
-		queue_delayed_work(rq_wq, &rq_info.rq_work,
-				msecs_to_jiffies(val));
-
-	mutex_unlock(&lock_poll_ms);
-
 	return count;
 }
 
@@ -209,7 +163,6 @@ static int init_rq_attribs(void)
 	if (!attribs)
 		goto rel;
 
-	rq_info.rq_avg = 0;
 	rq_info.rq_poll_ms = 0;
 
 	attribs[0] = MSM_RQ_STATS_RW_ATTRIB(def_timer_ms);
@@ -257,7 +210,6 @@ static int __init msm_rq_stats_init(void)
 {
 	rq_wq = create_singlethread_workqueue("rq_stats");
 	BUG_ON(!rq_wq);
-	INIT_DELAYED_WORK_DEFERRABLE(&rq_info.rq_work, rq_work_fn);
 	INIT_DELAYED_WORK_DEFERRABLE(&rq_info.def_timer_work, def_work_fn);
 	return init_rq_attribs();
 }
@@ -1409,6 +1409,257 @@ static int msm_pm_swfi(bool ramp_acpu)
 }
 
 
+/******************************************************************************
+ * Idle Duration Prediction
+ *****************************************************************************/
+
+/*
+ * The next timer only bounds the idle time; interrupts usually end it
+ * sooner.  Before picking a sleep mode, arch_idle() guesses the idle time
+ * from the next timer, scaled by how much of the timer wait recent idles
+ * with a similar timer actually got, or from the recent idle durations
+ * when they are regular enough.  Modes whose residency is above the
+ * guess are skipped as they would not pay off.
+ *
+ * The shallowest mode left is never skipped on the guess alone, so a
+ * guess of 0 does not leave the CPU spinning.
+ *
+ * Power collapse additionally gets the wakeup overrun measured on this
+ * SoC (time past its timer before we are running again) added to its
+ * latency and residency.  That cost is only measured when collapsing, so
+ * it is decayed whenever it alone kept power collapse from being used.
+ */
+static int msm_pm_idle_predict = 1;
+module_param_named(
+	idle_predict, msm_pm_idle_predict,
+	int, S_IRUGO | S_IWUSR | S_IWGRP
+);
+
+#define MSM_PM_IDLE_HISTORY		8
+#define MSM_PM_IDLE_BUCKETS		6	/* <10us, <100us, ... >=100ms */
+#define MSM_PM_IDLE_CF_ONE		1024	/* correction factor of 1.0 */
+#define MSM_PM_IDLE_DECAY		8
+#define MSM_PM_IDLE_MAX_US		(100 * USEC_PER_SEC)
+#define MSM_PM_IDLE_PC_COST_MAX_US	10000
+
+static struct msm_pm_idle_predictor {
+	uint32_t history_us[MSM_PM_IDLE_HISTORY];
+	int next;
+	int filled;
+	uint32_t correction[MSM_PM_IDLE_BUCKETS];
+	uint32_t pc_cost_us;
+
+	/* the idle period in progress */
+	int64_t start_ns;
+	uint32_t timer_us;
+	int bucket;
+	int mode;			/* -1 if no mode was entered */
+	uint32_t skipped_residency_us;	/* 0 if no mode was skipped */
+	bool pc_cost_blocked;		/* only pc_cost_us ruled out collapse */
+} msm_pm_idle_pred = {
+	.correction = {
+		[0 ... MSM_PM_IDLE_BUCKETS - 1] = MSM_PM_IDLE_CF_ONE,
+	},
+};
+
+static struct msm_pm_idle_mode_stats {
+	unsigned int entries;
+	int64_t time_ns;
+	unsigned int too_short;	/* woke before the mode paid off */
+	unsigned int too_long;	/* slept long enough for a skipped mode */
+} msm_pm_idle_mode_stats[MSM_PM_SLEEP_MODE_NR];
+
+static inline bool msm_pm_mode_is_collapse(int mode)
+{
+	return mode == MSM_PM_SLEEP_MODE_POWER_COLLAPSE ||
+		mode == MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN;
+}
+
+static int msm_pm_idle_bucket(uint32_t timer_us)
+{
+	uint32_t limit = 10;
+	int b;
+
+	for (b = 0; b < MSM_PM_IDLE_BUCKETS - 1; b++, limit *= 10)
+		if (timer_us < limit)
+			break;
+	return b;
+}
+
+/*
+ * Average of the recent idle durations if they are close together,
+ * dropping up to two outliers from the top; 0 if they are too scattered.
+ */
+static uint32_t msm_pm_idle_typical_us(void)
+{
+	uint32_t *h = msm_pm_idle_pred.history_us;
+	uint32_t thresh = UINT_MAX;
+	int tries;
+
+	if (msm_pm_idle_pred.filled < MSM_PM_IDLE_HISTORY)
+		return 0;
+
+	for (tries = 0; tries < 3; tries++) {
+		uint64_t sum = 0, variance = 0;
+		uint32_t highest = 0, avg;
+		int i, n = 0;
+
+		for (i = 0; i < MSM_PM_IDLE_HISTORY; i++) {
+			if (h[i] > thresh)
+				continue;
+			sum += h[i];
+			if (h[i] > highest)
+				highest = h[i];
+			n++;
+		}
+		if (!n)
+			return 0;
+		avg = div_u64(sum, n);
+
+		for (i = 0; i < MSM_PM_IDLE_HISTORY; i++) {
+			int64_t d;
+
+			if (h[i] > thresh)
+				continue;
+			d = (int64_t)h[i] - avg;
+			variance += d * d;
+		}
+		variance = div_u64(variance, n);
+
+		/* standard deviation below 1/6 of the average, or 400us */
+		if ((uint64_t)avg * avg > 36 * variance ||
+		    variance <= 400 * 400)
+			return avg;
+
+		thresh = highest - 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Start of an idle period with the next timer @timer_ns away.  Returns
+ * the predicted idle time in nanoseconds.
+ */
+static int64_t msm_pm_idle_predict_begin(int64_t timer_ns)
+{
+	struct msm_pm_idle_predictor *pred = &msm_pm_idle_pred;
+	uint64_t timer_us = timer_ns > 0 ? div_u64(timer_ns, NSEC_PER_USEC) : 0;
+	uint64_t predicted_us;
+	uint32_t typical_us;
+
+	pred->start_ns = ktime_to_ns(ktime_get());
+	pred->timer_us = min_t(uint64_t, timer_us, MSM_PM_IDLE_MAX_US);
+	pred->bucket = msm_pm_idle_bucket(pred->timer_us);
+	pred->mode = -1;
+	pred->skipped_residency_us = 0;
+	pred->pc_cost_blocked = false;
+
+	if (!msm_pm_idle_predict)
+		return timer_ns;
+
+	predicted_us = (uint64_t)pred->timer_us *
+		pred->correction[pred->bucket] / MSM_PM_IDLE_CF_ONE;
+	typical_us = msm_pm_idle_typical_us();
+	if (typical_us && typical_us < predicted_us)
+		predicted_us = typical_us;
+
+	return min_t(int64_t, predicted_us * NSEC_PER_USEC, timer_ns);
+}
+
+/* End of the idle period: learn from it and charge it to the mode used */
+static void msm_pm_idle_predict_end(void)
+{
+	struct msm_pm_idle_predictor *pred = &msm_pm_idle_pred;
+	struct msm_pm_idle_mode_stats *stats;
+	int64_t actual_ns = ktime_to_ns(ktime_get()) - pred->start_ns;
+	uint32_t actual_us;
+
+	if (actual_ns < 0)
+		actual_ns = 0;
+	actual_us = min_t(uint64_t, div_u64(actual_ns, NSEC_PER_USEC),
+			  MSM_PM_IDLE_MAX_US);
+
+	pred->history_us[pred->next] = actual_us;
+	pred->next = (pred->next + 1) % MSM_PM_IDLE_HISTORY;
+	if (pred->filled < MSM_PM_IDLE_HISTORY)
+		pred->filled++;
+
+	if (pred->timer_us) {
+		uint32_t *cf = &pred->correction[pred->bucket];
+		uint32_t ratio = (uint64_t)min(actual_us, pred->timer_us) *
+			MSM_PM_IDLE_CF_ONE / pred->timer_us;
+
+		*cf += ((int)ratio - (int)*cf) / MSM_PM_IDLE_DECAY;
+	}
+
+	/* let a stale estimate wear off rather than lock collapse out */
+	if (pred->pc_cost_blocked &&
+	    (pred->mode < 0 || !msm_pm_mode_is_collapse(pred->mode)))
+		pred->pc_cost_us -= (pred->pc_cost_us + MSM_PM_IDLE_DECAY - 1) /
+			MSM_PM_IDLE_DECAY;
+
+	if (pred->mode < 0)
+		return;
+
+	stats = &msm_pm_idle_mode_stats[pred->mode];
+	stats->entries++;
+	stats->time_ns += actual_ns;
+	if (actual_us < msm_pm_modes[pred->mode].residency)
+		stats->too_short++;
+	else if (pred->skipped_residency_us &&
+		 actual_us >= pred->skipped_residency_us)
+		stats->too_long++;
+
+	/* a collapse that outlasted its timer was woken by it */
+	if (msm_pm_mode_is_collapse(pred->mode) && pred->timer_us &&
+	    actual_us > pred->timer_us) {
+		uint32_t overrun = min_t(uint32_t, actual_us - pred->timer_us,
+					 MSM_PM_IDLE_PC_COST_MAX_US);
+
+		pred->pc_cost_us += ((int)overrun - (int)pred->pc_cost_us) /
+			MSM_PM_IDLE_DECAY;
+	}
+}
+
+/*
+ * Per mode: times entered from idle, total time spent, and how often
+ * the prediction was wrong either way.
+ */
+static int msm_pm_idle_stats_read_proc
+	(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	char *p = page;
+	int i;
+
+	p += sprintf(p, "idle_predict: %d\npower collapse cost: %u us\n"
+		     "correction:", msm_pm_idle_predict,
+		     msm_pm_idle_pred.pc_cost_us);
+	for (i = 0; i < MSM_PM_IDLE_BUCKETS; i++)
+		p += sprintf(p, " %u", msm_pm_idle_pred.correction[i]);
+	p += sprintf(p, "\n\n%-36s %9s %10s %9s %9s %11s\n", "mode",
+		     "entries", "time_ms", "too_short", "too_long",
+		     "mispredict%");
+
+	for (i = 0; i < MSM_PM_SLEEP_MODE_NR; i++) {
+		struct msm_pm_idle_mode_stats *stats =
+			&msm_pm_idle_mode_stats[i];
+		unsigned int missed = stats->too_short + stats->too_long;
+
+		if (!msm_pm_modes[i].idle_supported)
+			continue;
+		p += sprintf(p, "%-36s %9u %10llu %9u %9u %11u\n",
+			     msm_pm_sleep_mode_labels[i], stats->entries,
+			     div_u64(stats->time_ns, NSEC_PER_MSEC),
+			     stats->too_short, stats->too_long,
+			     stats->entries ? missed * 100 / stats->entries : 0);
+	}
+
+	*eof = 1;
+	return p - page;
+}
+
+
 /******************************************************************************
  * External Idle/Suspend Functions
  *****************************************************************************/
@@ -1419,10 +1670,14 @@ static int msm_pm_swfi(bool ramp_acpu)
 void arch_idle(void)
 {
 	bool allow[MSM_PM_SLEEP_MODE_NR];
+	bool skipped[MSM_PM_SLEEP_MODE_NR];
+	uint32_t eff_residency[MSM_PM_SLEEP_MODE_NR];
+	int shallowest = -1;
 	uint32_t sleep_limit = SLEEP_LIMIT_NONE;
 
 	int latency_qos;
 	int64_t timer_expiration;
+	int64_t predicted;
 
 	int low_power;
 	int ret;
@@ -1439,6 +1694,7 @@ void arch_idle(void)
 
 	latency_qos = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
 	timer_expiration = msm_timer_enter_idle();
+	predicted = msm_pm_idle_predict_begin(timer_expiration);
 
 #ifdef CONFIG_MSM_IDLE_STATS
 	t1 = ktime_to_ns(ktime_get());
@@ -1489,10 +1745,63 @@ void arch_idle(void)
 
 	for (i = 0; i < ARRAY_SIZE(allow); i++) {
 		struct msm_pm_platform_data *mode = &msm_pm_modes[i];
+		uint32_t latency = mode->latency;
+		uint32_t residency = mode->residency;
+
+		skipped[i] = false;
+		if (!allow[i])
+			continue;
+
 		if (!mode->idle_supported || !mode->idle_enabled ||
-			mode->latency >= latency_qos ||
-			mode->residency * 1000ULL >= timer_expiration)
+			latency >= latency_qos ||
+			residency * 1000ULL >= timer_expiration) {
 			allow[i] = false;
+			continue;
+		}
+
+		if (msm_pm_mode_is_collapse(i)) {
+			uint32_t pc_cost = msm_pm_idle_pred.pc_cost_us;
+
+			if (max(latency, pc_cost) >= latency_qos ||
+			    (residency + pc_cost) * 1000ULL >=
+					timer_expiration) {
+				allow[i] = false;
+				if (pc_cost)
+					msm_pm_idle_pred.pc_cost_blocked = true;
+				continue;
+			}
+			if (pc_cost && residency * 1000ULL < predicted &&
+			    (residency + pc_cost) * 1000ULL >= predicted)
+				msm_pm_idle_pred.pc_cost_blocked = true;
+			residency += pc_cost;
+		}
+
+		eff_residency[i] = residency;
+		if (residency * 1000ULL >= predicted) {
+			allow[i] = false;
+			skipped[i] = true;
+			if (shallowest < 0 ||
+			    residency < eff_residency[shallowest])
+				shallowest = i;
+		}
+	}
+
+	/* the guess alone never leaves us spinning; keep the cheapest mode */
+	for (i = 0; i < ARRAY_SIZE(allow); i++)
+		if (allow[i])
+			break;
+	if (i == ARRAY_SIZE(allow) && shallowest >= 0) {
+		allow[shallowest] = true;
+		skipped[shallowest] = false;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(allow); i++) {
+		if (!skipped[i])
+			continue;
+		if (!msm_pm_idle_pred.skipped_residency_us ||
+		    eff_residency[i] < msm_pm_idle_pred.skipped_residency_us)
+			msm_pm_idle_pred.skipped_residency_us =
+				eff_residency[i];
 	}
 
 	if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE] ||
@@ -1516,8 +1825,9 @@ void arch_idle(void)
 	}
 
 	MSM_PM_DPRINTK(MSM_PM_DEBUG_IDLE, KERN_INFO,
-		"%s(): latency qos %d, next timer %lld, sleep limit %u\n",
-		__func__, latency_qos, timer_expiration, sleep_limit);
+		"%s(): latency qos %d, next timer %lld, predicted %lld, "
+		"sleep limit %u\n", __func__, latency_qos, timer_expiration,
+		predicted, sleep_limit);
 
 	for (i = 0; i < ARRAY_SIZE(allow); i++)
 		MSM_PM_DPRINTK(MSM_PM_DEBUG_IDLE, KERN_INFO,
@@ -1542,6 +1852,10 @@ void arch_idle(void)
 		sleep_limit |= SLEEP_RESOURCE_MEMORY_BIT0;
 #endif
 
+		msm_pm_idle_pred.mode =
+			allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE] ?
+			MSM_PM_SLEEP_MODE_POWER_COLLAPSE :
+			MSM_PM_SLEEP_MODE_POWER_COLLAPSE_NO_XO_SHUTDOWN;
 		ret = msm_pm_power_collapse(true, sleep_delay, sleep_limit);
 		low_power = (ret != -EBUSY && ret != -ETIMEDOUT);
 
@@ -1561,6 +1875,7 @@ void arch_idle(void)
 		if (sleep_delay == 0) /* 0 would mean infinite time */
 			sleep_delay = 1;
 
+		msm_pm_idle_pred.mode = MSM_PM_SLEEP_MODE_APPS_SLEEP;
 		ret = msm_pm_apps_sleep(sleep_delay, sleep_limit);
 		low_power = 0;
 
@@ -1571,6 +1886,8 @@ void arch_idle(void)
 			exit_stat = MSM_PM_STAT_IDLE_SLEEP;
 #endif /* CONFIG_MSM_IDLE_STATS */
 	} else if (allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE]) {
+		msm_pm_idle_pred.mode =
+			MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE;
 		ret = msm_pm_power_collapse_standalone();
 		low_power = 0;
 #ifdef CONFIG_MSM_IDLE_STATS
@@ -1579,6 +1896,8 @@ void arch_idle(void)
 			MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE;
 #endif /* CONFIG_MSM_IDLE_STATS */
 	} else if (allow[MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT]) {
+		msm_pm_idle_pred.mode =
+			MSM_PM_SLEEP_MODE_RAMP_DOWN_AND_WAIT_FOR_INTERRUPT;
 		ret = msm_pm_swfi(true);
 		if (ret)
 			while (!msm_irq_pending())
@@ -1588,6 +1907,7 @@ void arch_idle(void)
 		exit_stat = ret ? MSM_PM_STAT_IDLE_SPIN : MSM_PM_STAT_IDLE_WFI;
 #endif /* CONFIG_MSM_IDLE_STATS */
 	} else if (allow[MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT]) {
+		msm_pm_idle_pred.mode = MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT;
 		msm_pm_swfi(false);
 		low_power = 0;
 #ifdef CONFIG_MSM_IDLE_STATS
@@ -1604,6 +1924,7 @@ void arch_idle(void)
 
 arch_idle_exit:
 	msm_timer_exit_idle(low_power);
+	msm_pm_idle_predict_end();
 
 #ifdef CONFIG_MSM_IDLE_STATS
 	t2 = ktime_to_ns(ktime_get());
@@ -1680,6 +2001,7 @@ static int msm_pm_enter(suspend_state_t state)
 		enum msm_pm_time_stats_id id;
 		int64_t end_time;
 #endif
+		u64 tl;
 
 		clock_debug_print_enabled();
 
@@ -1706,8 +2028,19 @@ static int msm_pm_enter(suspend_state_t state)
 		for (i = 0; i < 30 && msm_pm_modem_busy(); i++)
 			udelay(500);
 
+		tl = suspend_timeline_start();
 		ret = msm_pm_power_collapse(
 			false, msm_pm_max_sleep_time, sleep_limit);
+		suspend_timeline_record(tl, "msm_pm_power_collapse %d", ret);
+		if (!ret)
+			suspend_timeline_wakeup("modem reason 0x%x irqs 0x%x "
+				"rpc %x:%x %.*s",
+				msm_pm_smem_data->wakeup_reason,
+				msm_pm_smem_data->pending_irqs,
+				msm_pm_smem_data->rpc_prog,
+				msm_pm_smem_data->rpc_proc,
+				DEM_MAX_PORT_NAME_LEN,
+				msm_pm_smem_data->smd_port_name);
 
 #ifdef CONFIG_MSM_IDLE_STATS
 		if (ret)
@@ -1958,6 +2291,8 @@ static int __init msm_pm_init(void)
 	suspend_set_ops(&msm_pm_ops);
 
 	msm_pm_mode_sysfs_add();
+	create_proc_read_entry("msm_pm_idle_stats", S_IRUGO, NULL,
+			msm_pm_idle_stats_read_proc, NULL);
 #ifdef CONFIG_MSM_IDLE_STATS
 	d_entry = create_proc_entry("msm_pm_stats",
 			S_IRUGO | S_IWUSR | S_IWGRP, NULL);
@@ -31,6 +31,7 @@
 #include <linux/ctype.h>
 #include <linux/remote_spinlock.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <mach/msm_smd.h>
 #include <mach/msm_iomap.h>
 #include <mach/system.h>
@@ -1053,8 +1054,13 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
-				int user_buf)
+/* basic write interface to ch_write_{buffer,done} used by
+ * smd_*_write() and the segment APIs; does not notify the
+ * remote processor so that callers can batch several fills
+ * into a single interrupt
+ */
+static int ch_write(struct smd_channel *ch, const void *_data, int len,
+			int user_buf)
 {
 	void *ptr;
 	const unsigned char *buf = _data;
@@ -1062,12 +1068,6 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 	int orig_len = len;
 	int r = 0;
 
-	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
-	if (len < 0)
-		return -EINVAL;
-	else if (len == 0)
-		return 0;
-
 	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
 		if (!ch_is_open(ch))
 			break;
@@ -1091,10 +1091,25 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 			break;
 	}
 
-	if (orig_len - len)
+	return orig_len - len;
+}
+
+static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+				int user_buf)
+{
+	int r;
+
+	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
+	if (len < 0)
+		return -EINVAL;
+	else if (len == 0)
+		return 0;
+
+	r = ch_write(ch, _data, len, user_buf);
+	if (r)
 		ch->notify_other_cpu();
 
-	return orig_len - len;
+	return r;
 }
 
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
@@ -1115,8 +1130,8 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	hdr[0] = len;
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
-
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	/* the header is announced together with the payload below */
+	ret = ch_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		SMD_DBG("%s failed to write pkt header: "
 			"%d returned\n", __func__, ret);
@@ -1549,7 +1564,7 @@ int smd_write_start(smd_channel_t *ch, int len)
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	ret = ch_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		ch->pending_pkt_sz = 0;
 		pr_err("%s: packet header failed to write\n", __func__);
@@ -1606,6 +1621,225 @@ int smd_write_end(smd_channel_t *ch)
 }
 EXPORT_SYMBOL(smd_write_end);
 
+/* total number of bytes described by a kernel iovec */
+static int smd_kvec_len(const struct kvec *iov, int nr_segs)
+{
+	int n;
+	int len = 0;
+
+	for (n = 0; n < nr_segs; n++) {
+		if (iov[n].iov_len > INT_MAX - len)
+			return -EINVAL;
+		len += iov[n].iov_len;
+	}
+
+	return len;
+}
+
+int smd_write_segments(smd_channel_t *ch, const struct kvec *iov, int nr_segs)
+{
+	unsigned hdr[5];
+	int len;
+	int n;
+	int r;
+	int written = 0;
+
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (nr_segs < 0 || (nr_segs && !iov))
+		return -EINVAL;
+	if (ch->pending_pkt_sz)
+		return -EBUSY;
+
+	len = smd_kvec_len(iov, nr_segs);
+	if (len <= 0)
+		return len;
+
+	if (ch->is_pkt_ch) {
+		if (smd_stream_write_avail(ch) < (len + SMD_HEADER_SIZE))
+			return -ENOMEM;
+
+		hdr[0] = len;
+		hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
+
+		r = ch_write(ch, hdr, sizeof(hdr), 0);
+		if (r != sizeof(hdr)) {
+			SMD_DBG("%s failed to write pkt header: "
+				"%d returned\n", __func__, r);
+			return -EPERM;
+		}
+	}
+
+	for (n = 0; n < nr_segs; n++) {
+		if (!iov[n].iov_len)
+			continue;
+		r = ch_write(ch, iov[n].iov_base, iov[n].iov_len, 0);
+		written += r;
+		if (r != iov[n].iov_len)
+			break;
+	}
+
+	if (written)
+		ch->notify_other_cpu();
+
+	return written;
+}
+EXPORT_SYMBOL(smd_write_segments);
+
+/* consume @len bytes of the current packet; smd_lock is held if from_cb */
+static void smd_packet_consume(smd_channel_t *ch, int len, int from_cb)
+{
+	unsigned long flags;
+
+	if (!from_cb)
+		spin_lock_irqsave(&smd_lock, flags);
+	ch->current_packet -= len;
+	update_packet_state(ch);
+	if (!from_cb)
+		spin_unlock_irqrestore(&smd_lock, flags);
+}
+
+static int __smd_read_segments(smd_channel_t *ch, struct kvec *iov,
+			       int nr_segs, int from_cb)
+{
+	int n;
+	int r;
+	int len;
+	int total = 0;
+
+	if (!ch) {
+		pr_err("%s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (nr_segs < 0 || (nr_segs && !iov))
+		return -EINVAL;
+	if (smd_kvec_len(iov, nr_segs) < 0)
+		return -EINVAL;
+
+	for (n = 0; n < nr_segs; n++) {
+		len = iov[n].iov_len;
+		if (ch->is_pkt_ch && len > (int)ch->current_packet - total)
+			len = ch->current_packet - total;
+		if (len <= 0)
+			continue;
+
+		r = ch_read(ch, iov[n].iov_base, len, 0);
+		total += r;
+		if (r != iov[n].iov_len)
+			break;
+	}
+
+	if (total > 0 && !read_intr_blocked(ch))
+		ch->notify_other_cpu();
+
+	if (ch->is_pkt_ch)
+		smd_packet_consume(ch, total, from_cb);
+
+	return total;
+}
+
+int smd_read_segments(smd_channel_t *ch, struct kvec *iov, int nr_segs)
+{
+	return __smd_read_segments(ch, iov, nr_segs, 0);
+}
+EXPORT_SYMBOL(smd_read_segments);
+
+int smd_read_segments_from_cb(smd_channel_t *ch, struct kvec *iov,
+			      int nr_segs)
+{
+	return __smd_read_segments(ch, iov, nr_segs, 1);
+}
+EXPORT_SYMBOL(smd_read_segments_from_cb);
+
+int smd_read_peek(smd_channel_t *ch, void **ptr)
+{
+	unsigned n;
+
+	if (!ch || !ptr)
+		return -EINVAL;
+
+	n = ch_read_buffer(ch, ptr);
+	if (ch->is_pkt_ch && n > ch->current_packet)
+		n = ch->current_packet;
+
+	return n;
+}
+EXPORT_SYMBOL(smd_read_peek);
+
+static int __smd_read_commit(smd_channel_t *ch, int len, int from_cb)
+{
+	void *ptr;
+
+	if (!ch)
+		return -EINVAL;
+	if (len < 0 || len > smd_read_peek(ch, &ptr))
+		return -EINVAL;
+	if (len == 0)
+		return 0;
+
+	ch_read_done(ch, len);
+	if (!read_intr_blocked(ch))
+		ch->notify_other_cpu();
+
+	if (ch->is_pkt_ch)
+		smd_packet_consume(ch, len, from_cb);
+
+	return len;
+}
+
+int smd_read_commit(smd_channel_t *ch, int len)
+{
+	return __smd_read_commit(ch, len, 0);
+}
+EXPORT_SYMBOL(smd_read_commit);
+
+int smd_read_commit_from_cb(smd_channel_t *ch, int len)
+{
+	return __smd_read_commit(ch, len, 1);
+}
+EXPORT_SYMBOL(smd_read_commit_from_cb);
+
+int smd_write_reserve(smd_channel_t *ch, void **ptr)
+{
+	unsigned n;
+
+	if (!ch || !ptr)
+		return -EINVAL;
+	if (ch->is_pkt_ch && !ch->pending_pkt_sz)
+		return -ENOEXEC;
+	if (!ch_is_open(ch))
+		return 0;
+
+	n = ch_write_buffer(ch, ptr);
+	if (ch->is_pkt_ch && n > ch->pending_pkt_sz)
+		n = ch->pending_pkt_sz;
+
+	return n;
+}
+EXPORT_SYMBOL(smd_write_reserve);
+
+int smd_write_commit(smd_channel_t *ch, int len)
+{
+	void *ptr;
+
+	if (!ch)
+		return -EINVAL;
+	if (len < 0 || len > smd_write_reserve(ch, &ptr))
+		return -EINVAL;
+	if (len == 0)
+		return 0;
+
+	ch_write_done(ch, len);
+	if (ch->is_pkt_ch)
+		ch->pending_pkt_sz -= len;
+	ch->notify_other_cpu();
+
+	return len;
+}
+EXPORT_SYMBOL(smd_write_commit);
+
 int smd_read(smd_channel_t *ch, void *data, int len)
 {
 	return ch->read(ch, data, len, 0);
@@ -18,8 +18,12 @@
 #include <linux/debugfs.h>
 #include <linux/list.h>
 #include <linux/ctype.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <linux/ktime.h>
 
 #include <mach/msm_iomap.h>
+#include <mach/msm_smd.h>
 
 #include "smd_private.h"
 
@@ -408,6 +412,156 @@ static int debug_test_smsm(char *buf, int max)
 	return i;
 }
 
+#define LOOPBACK_BENCH_BYTES (1024 * 1024)
+#define LOOPBACK_BENCH_CHUNK 1500
+
+/* push a chunk through the loopback fifo with smd_write/smd_read */
+static int loopback_copy_chunk(smd_channel_t *ch, char *src, char *dst,
+				int len)
+{
+	memset(src, 0x5a, len);
+	if (smd_write(ch, src, len) != len)
+		return -EIO;
+	if (smd_read(ch, dst, len) != len)
+		return -EIO;
+	return 0;
+}
+
+/* same chunk built and consumed in place in the fifo */
+static int loopback_zero_copy_chunk(smd_channel_t *ch, int len)
+{
+	void *ptr;
+	int n;
+	int left;
+
+	for (left = len; left > 0; left -= n) {
+		n = smd_write_reserve(ch, &ptr);
+		if (n <= 0)
+			return -EIO;
+		if (n > left)
+			n = left;
+		memset(ptr, 0x5a, n);
+		smd_write_commit(ch, n);
+	}
+
+	for (left = len; left > 0; left -= n) {
+		n = smd_read_peek(ch, &ptr);
+		if (n <= 0)
+			return -EIO;
+		if (n > left)
+			n = left;
+		if (((char *)ptr)[n - 1] != 0x5a)
+			return -EIO;
+		smd_read_commit(ch, n);
+	}
+	return 0;
+}
+
+static int debug_test_smd_loopback(char *buf, int max)
+{
+	int i = 0;
+	int test_num = 0;
+	int ret;
+	int n;
+	smd_channel_t *ch;
+	char *src;
+	char *dst;
+	struct kvec iov[3];
+	void *ptr;
+	ktime_t start;
+	s64 copy_us;
+	s64 zc_us;
+
+	ret = smd_named_open_on_edge("local_loopback", SMD_LOOPBACK_TYPE,
+				     &ch, NULL, NULL);
+	if (ret) {
+		i += scnprintf(buf + i, max - i,
+			       "local_loopback unavailable: %d\n", ret);
+		return i;
+	}
+
+	src = kmalloc(LOOPBACK_BENCH_CHUNK, GFP_KERNEL);
+	dst = kmalloc(LOOPBACK_BENCH_CHUNK, GFP_KERNEL);
+	if (!src || !dst) {
+		i += scnprintf(buf + i, max - i, "out of memory\n");
+		goto out;
+	}
+
+	/* Test case 1 - gather write, scatter read */
+	do {
+		test_num++;
+		for (n = 0; n < 96; n++)
+			src[n] = n;
+
+		iov[0].iov_base = src;
+		iov[0].iov_len = 10;
+		iov[1].iov_base = src + 10;
+		iov[1].iov_len = 0;
+		iov[2].iov_base = src + 10;
+		iov[2].iov_len = 86;
+		ret = smd_write_segments(ch, iov, 3);
+		UT_EQ_INT(ret, 96);
+		UT_EQ_INT(smd_read_avail(ch), 96);
+
+		memset(dst, 0, 96);
+		iov[0].iov_base = dst;
+		iov[0].iov_len = 50;
+		iov[1].iov_base = dst + 50;
+		iov[1].iov_len = 46;
+		ret = smd_read_segments(ch, iov, 2);
+		UT_EQ_INT(ret, 96);
+		UT_EQ_INT(memcmp(src, dst, 96), 0);
+		UT_EQ_INT(smd_read_avail(ch), 0);
+
+		i += scnprintf(buf + i, max - i, "Test %d - PASS\n", test_num);
+	} while (0);
+
+	/* Test case 2 - reserve/commit and peek/commit */
+	do {
+		test_num++;
+		n = smd_write_reserve(ch, &ptr);
+		UT_EQ_INT(n > 0, 1);
+		if (n > 16)
+			n = 16;
+		memset(ptr, 0xa5, n);
+		UT_EQ_INT(smd_write_commit(ch, n), n);
+		UT_EQ_INT(smd_read_avail(ch), n);
+
+		ret = smd_read_peek(ch, &ptr);
+		UT_EQ_INT(ret, n);
+		UT_EQ_INT(((unsigned char *)ptr)[n - 1], 0xa5);
+		UT_EQ_INT(smd_read_commit(ch, n + 1), -EINVAL);
+		UT_EQ_INT(smd_read_commit(ch, n), n);
+		UT_EQ_INT(smd_read_avail(ch), 0);
+
+		i += scnprintf(buf + i, max - i, "Test %d - PASS\n", test_num);
+	} while (0);
+
+	/* Throughput - copying vs in-place access to the fifo */
+	start = ktime_get();
+	for (n = 0; n < LOOPBACK_BENCH_BYTES; n += LOOPBACK_BENCH_CHUNK)
+		if (loopback_copy_chunk(ch, src, dst, LOOPBACK_BENCH_CHUNK))
+			break;
+	copy_us = ktime_us_delta(ktime_get(), start);
+
+	start = ktime_get();
+	for (n = 0; n < LOOPBACK_BENCH_BYTES; n += LOOPBACK_BENCH_CHUNK)
+		if (loopback_zero_copy_chunk(ch, LOOPBACK_BENCH_CHUNK))
+			break;
+	zc_us = ktime_us_delta(ktime_get(), start);
+
+	i += scnprintf(buf + i, max - i,
+		       "copy: %d bytes in %lld us\n"
+		       "zero-copy: %d bytes in %lld us\n",
+		       LOOPBACK_BENCH_BYTES, copy_us,
+		       LOOPBACK_BENCH_BYTES, zc_us);
+out:
+	kfree(src);
+	kfree(dst);
+	smd_close(ch);
+	return i;
+}
+
 static int debug_read_mem(char *buf, int max)
 {
 	unsigned n;
@@ -650,6 +804,7 @@ static int __init smd_debugfs_init(void)
 	debug_create("modem_err_f3", 0444, dent, debug_modem_err_f3);
 	debug_create("print_diag", 0444, dent, debug_diag);
 	debug_create("print_f3", 0444, dent, debug_f3);
+	debug_create("loopback_test", 0444, dent, debug_test_smd_loopback);
 
 	/* NNV: this is google only stuff */
 	debug_create("build", 0444, dent, debug_read_build_id);
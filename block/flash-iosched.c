@@ -0,0 +1,463 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Seeks are free on flash, so requests are not sorted.  What does hurt
+ *  is a read stuck behind a long run of writes, so synchronous reads are
+ *  served first, writes go out in batches bounded by size and time, and
+ *  reads from foreground tasks go ahead of reads from background ones.
+ *
+ *  Based on the deadline scheduler, Copyright (C) 2002 Jens Axboe.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/ioprio.h>
+#include <linux/blktrace_api.h>
+#include "blk-cgroup.h"
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int read_expire = HZ / 8;	/* max wait of a foreground read */
+static const int bg_read_expire = HZ / 2; /* ditto for background reads */
+static const int write_expire = 2 * HZ;	/* writes may be held back this long */
+static const int writes_starved = 16;	/* max reads served ahead of writes */
+static const int bg_reads_starved = 4;	/* max fg reads ahead of a bg read */
+static const int write_batch_kb = 512;	/* size bound of a write batch */
+static const int write_batch_ms = 20;	/* time bound of a write batch */
+static const int bg_nice = 10;		/* tasks this nice are background */
+
+enum {
+	FLASH_READ_FG,
+	FLASH_READ_BG,
+	FLASH_WRITE,
+	FLASH_NR_QUEUES,
+};
+
+struct flash_data {
+	struct list_head fifo_list[FLASH_NR_QUEUES];
+
+	/*
+	 * write batch in progress, if batch_start is non-zero
+	 */
+	unsigned long batch_start;
+	unsigned int batch_bytes;
+
+	unsigned int writes_starved_cnt;	/* reads since the last write */
+	unsigned int bg_starved_cnt;	/* fg reads since the last bg read */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[FLASH_NR_QUEUES];
+	int writes_starved;
+	int bg_reads_starved;
+	int write_batch_kb;
+	int write_batch_expire;
+	int bg_nice;
+
+	/*
+	 * statistics
+	 */
+	unsigned long dispatched[FLASH_NR_QUEUES];
+	unsigned long write_batches;
+	unsigned long batches_by_size;
+	unsigned long batches_by_time;
+	unsigned long expired[FLASH_NR_QUEUES];
+	unsigned int max_wait_ms[FLASH_NR_QUEUES];
+};
+
+/* rq->elevator_private records which queue the request was put on */
+static inline int flash_rq_queue(struct request *rq)
+{
+	return (int)(unsigned long)rq->elevator_private;
+}
+
+/*
+ * Is the task issuing i/o a background one?  Android runs background
+ * work at nice 10 and may put it in a low-weight blkio cgroup; the idle
+ * i/o class counts too.
+ */
+static int flash_current_is_background(struct flash_data *fd)
+{
+	struct io_context *ioc = current->io_context;
+	int bg = 0;
+
+	if (ioc && ioprio_valid(ioc->ioprio) &&
+	    IOPRIO_PRIO_CLASS(ioc->ioprio) == IOPRIO_CLASS_IDLE)
+		return 1;
+
+	if (task_nice(current) >= fd->bg_nice)
+		return 1;
+
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_CGROUP_MODULE)
+	rcu_read_lock();
+	bg = cgroup_to_blkio_cgroup(task_cgroup(current, blkio_subsys_id))
+		->weight < blkio_root_cgroup.weight;
+	rcu_read_unlock();
+#endif
+	return bg;
+}
+
+static int
+flash_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int queue = FLASH_WRITE;
+
+	if (rq_data_dir(rq) == READ)
+		queue = flash_current_is_background(fd) ?
+			FLASH_READ_BG : FLASH_READ_FG;
+
+	rq->elevator_private = (void *)(unsigned long)queue;
+	return 0;
+}
+
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int queue = flash_rq_queue(rq);
+
+	/* requests inserted without set_request (e.g. requeued flushes) */
+	if (!(rq->cmd_flags & REQ_ELVPRIV))
+		queue = rq_data_dir(rq) == READ ? FLASH_READ_FG : FLASH_WRITE;
+	rq->elevator_private = (void *)(unsigned long)queue;
+
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[queue]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[queue]);
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	rq_fifo_clear(next);
+}
+
+static int flash_fifo_expired(struct flash_data *fd, int queue)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[queue].next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+static void
+flash_dispatch(struct request_queue *q, struct flash_data *fd, int queue)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[queue].next);
+	unsigned long queued = rq_fifo_time(rq) - fd->fifo_expire[queue];
+	unsigned int wait_ms = jiffies_to_msecs(jiffies - queued);
+
+	if (wait_ms > fd->max_wait_ms[queue])
+		fd->max_wait_ms[queue] = wait_ms;
+	fd->dispatched[queue]++;
+
+	rq_fifo_clear(rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+static void flash_end_batch(struct request_queue *q, struct flash_data *fd,
+			    const char *why)
+{
+	blk_add_trace_msg(q, "flash: write batch end (%s) %u KB in %u ms", why,
+			  fd->batch_bytes >> 10,
+			  jiffies_to_msecs(jiffies - fd->batch_start));
+	fd->batch_start = 0;
+}
+
+/*
+ * Continue a write batch while it is within both its bounds; a batch
+ * also ends when there are no more writes.
+ */
+static int flash_continue_batch(struct request_queue *q, struct flash_data *fd)
+{
+	if (!fd->batch_start)
+		return 0;
+
+	if (list_empty(&fd->fifo_list[FLASH_WRITE])) {
+		flash_end_batch(q, fd, "drained");
+		return 0;
+	}
+	if (fd->batch_bytes >= fd->write_batch_kb << 10) {
+		fd->batches_by_size++;
+		flash_end_batch(q, fd, "size");
+		return 0;
+	}
+	if (time_after(jiffies, fd->batch_start + fd->write_batch_expire)) {
+		fd->batches_by_time++;
+		flash_end_batch(q, fd, "time");
+		return 0;
+	}
+	return 1;
+}
+
+static void flash_start_batch(struct request_queue *q, struct flash_data *fd)
+{
+	fd->write_batches++;
+	fd->writes_starved_cnt = 0;
+	fd->batch_start = jiffies ? jiffies : 1;
+	fd->batch_bytes = 0;
+	blk_add_trace_msg(q, "flash: write batch start");
+}
+
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int fg_reads = !list_empty(&fd->fifo_list[FLASH_READ_FG]);
+	const int bg_reads = !list_empty(&fd->fifo_list[FLASH_READ_BG]);
+	const int writes = !list_empty(&fd->fifo_list[FLASH_WRITE]);
+	int queue;
+
+	if (flash_continue_batch(q, fd))
+		goto dispatch_write;
+
+	/*
+	 * not in a write batch: writes get one only if they have waited
+	 * too long, or too many reads went ahead of them
+	 */
+	if (writes && (flash_fifo_expired(fd, FLASH_WRITE) ||
+		       fd->writes_starved_cnt >= fd->writes_starved ||
+		       (!fg_reads && !bg_reads))) {
+		if (flash_fifo_expired(fd, FLASH_WRITE))
+			fd->expired[FLASH_WRITE]++;
+		flash_start_batch(q, fd);
+		goto dispatch_write;
+	}
+
+	/*
+	 * background reads go ahead of foreground ones only when they have
+	 * been passed over for too long, and an expired foreground read
+	 * still wins over them
+	 */
+	if (bg_reads && (!fg_reads ||
+			 (!flash_fifo_expired(fd, FLASH_READ_FG) &&
+			  (flash_fifo_expired(fd, FLASH_READ_BG) ||
+			   fd->bg_starved_cnt >= fd->bg_reads_starved)))) {
+		if (fg_reads && flash_fifo_expired(fd, FLASH_READ_BG))
+			fd->expired[FLASH_READ_BG]++;
+		fd->bg_starved_cnt = 0;
+		queue = FLASH_READ_BG;
+	} else if (fg_reads) {
+		if (flash_fifo_expired(fd, FLASH_READ_FG))
+			fd->expired[FLASH_READ_FG]++;
+		if (bg_reads)
+			fd->bg_starved_cnt++;
+		queue = FLASH_READ_FG;
+	} else
+		return 0;
+
+	if (writes)
+		fd->writes_starved_cnt++;
+	flash_dispatch(q, fd, queue);
+	return 1;
+
+dispatch_write:
+	fd->batch_bytes += blk_rq_bytes(rq_entry_fifo(
+					fd->fifo_list[FLASH_WRITE].next));
+	flash_dispatch(q, fd, FLASH_WRITE);
+	return 1;
+}
+
+static int flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int i;
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		if (!list_empty(&fd->fifo_list[i]))
+			return 0;
+	return 1;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int i;
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		BUG_ON(!list_empty(&fd->fifo_list[i]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int i;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		INIT_LIST_HEAD(&fd->fifo_list[i]);
+	fd->fifo_expire[FLASH_READ_FG] = read_expire;
+	fd->fifo_expire[FLASH_READ_BG] = bg_read_expire;
+	fd->fifo_expire[FLASH_WRITE] = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->bg_reads_starved = bg_reads_starved;
+	fd->write_batch_kb = write_batch_kb;
+	fd->write_batch_expire = msecs_to_jiffies(write_batch_ms);
+	fd->bg_nice = bg_nice;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_read_expire_show, fd->fifo_expire[FLASH_READ_FG], 1);
+SHOW_FUNCTION(flash_bg_read_expire_show, fd->fifo_expire[FLASH_READ_BG], 1);
+SHOW_FUNCTION(flash_write_expire_show, fd->fifo_expire[FLASH_WRITE], 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_bg_reads_starved_show, fd->bg_reads_starved, 0);
+SHOW_FUNCTION(flash_write_batch_kb_show, fd->write_batch_kb, 0);
+SHOW_FUNCTION(flash_write_batch_ms_show, fd->write_batch_expire, 1);
+SHOW_FUNCTION(flash_bg_nice_show, fd->bg_nice, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_read_expire_store, &fd->fifo_expire[FLASH_READ_FG], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_bg_read_expire_store, &fd->fifo_expire[FLASH_READ_BG], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_expire_store, &fd->fifo_expire[FLASH_WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_bg_reads_starved_store, &fd->bg_reads_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_kb_store, &fd->write_batch_kb, 1, INT_MAX >> 10, 0);
+STORE_FUNCTION(flash_write_batch_ms_store, &fd->write_batch_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_bg_nice_store, &fd->bg_nice, -20, 20, 0);
+#undef STORE_FUNCTION
+
+static ssize_t flash_stats_show(struct elevator_queue *e, char *page)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	return sprintf(page,
+		       "dispatched %lu %lu %lu\n"
+		       "expired %lu %lu %lu\n"
+		       "max_wait_ms %u %u %u\n"
+		       "write_batches %lu\n"
+		       "batches_by_size %lu\n"
+		       "batches_by_time %lu\n",
+		       fd->dispatched[FLASH_READ_FG],
+		       fd->dispatched[FLASH_READ_BG],
+		       fd->dispatched[FLASH_WRITE],
+		       fd->expired[FLASH_READ_FG],
+		       fd->expired[FLASH_READ_BG],
+		       fd->expired[FLASH_WRITE],
+		       fd->max_wait_ms[FLASH_READ_FG],
+		       fd->max_wait_ms[FLASH_READ_BG],
+		       fd->max_wait_ms[FLASH_WRITE],
+		       fd->write_batches, fd->batches_by_size,
+		       fd->batches_by_time);
+}
+
+#define FL_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FL_ATTR(read_expire),
+	FL_ATTR(bg_read_expire),
+	FL_ATTR(write_expire),
+	FL_ATTR(writes_starved),
+	FL_ATTR(bg_reads_starved),
+	FL_ATTR(write_batch_kb),
+	FL_ATTR(write_batch_ms),
+	FL_ATTR(bg_nice),
+	__ATTR(stats, S_IRUGO, flash_stats_show, NULL),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_set_req_fn =		flash_set_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -159,6 +159,8 @@ void device_pm_move_last(struct device *dev)
 	list_move_tail(&dev->power.entry, &dpm_list);
 }
 
+static char *pm_verb(int event);
+
 static ktime_t initcall_debug_start(struct device *dev)
 {
 	ktime_t calltime = ktime_set(0, 0);
@@ -222,6 +224,7 @@ static int pm_op(struct device *dev,
 {
 	int error = 0;
 	ktime_t calltime;
+	u64 tl = suspend_timeline_start();
 
 	calltime = initcall_debug_start(dev);
 
@@ -273,6 +276,8 @@ static int pm_op(struct device *dev,
 	}
 
 	initcall_debug_report(dev, calltime, error);
+	suspend_timeline_record_dev(tl, "%s %s", pm_verb(state.event),
+				    dev_name(dev));
 
 	return error;
 }
@@ -292,6 +297,7 @@ static int pm_noirq_op(struct device *dev,
 {
 	int error = 0;
 	ktime_t calltime = ktime_set(0, 0), delta, rettime;
+	u64 tl = suspend_timeline_start();
 
 	if (initcall_debug) {
 		pr_info("calling  %s+ @ %i, parent: %s\n",
@@ -354,6 +360,8 @@ static int pm_noirq_op(struct device *dev,
 			dev_name(dev), error,
 			(unsigned long long)ktime_to_ns(delta) >> 10);
 	}
+	suspend_timeline_record_dev(tl, "%s noirq %s",
+				    pm_verb(state.event), dev_name(dev));
 
 	return error;
 }
@@ -496,6 +504,7 @@ static int legacy_resume(struct device *dev, int (*cb)(struct device *dev))
 {
 	int error;
 	ktime_t calltime;
+	u64 tl = suspend_timeline_start();
 
 	calltime = initcall_debug_start(dev);
 
@@ -503,6 +512,7 @@ static int legacy_resume(struct device *dev, int (*cb)(struct device *dev))
 	suspend_report_result(cb, error);
 
 	initcall_debug_report(dev, calltime, error);
+	suspend_timeline_record_dev(tl, "resume legacy %s", dev_name(dev));
 
 	return error;
 }
@@ -836,6 +846,7 @@ static int legacy_suspend(struct device *dev, pm_message_t state,
 {
 	int error;
 	ktime_t calltime;
+	u64 tl = suspend_timeline_start();
 
 	calltime = initcall_debug_start(dev);
 
@@ -843,6 +854,8 @@ static int legacy_suspend(struct device *dev, pm_message_t state,
 	suspend_report_result(cb, error);
 
 	initcall_debug_report(dev, calltime, error);
+	suspend_timeline_record_dev(tl, "%s legacy %s",
+				    pm_verb(state.event), dev_name(dev));
 
 	return error;
 }
@@ -19,7 +19,9 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
+#include <linux/input.h>
 #include <linux/mutex.h>
+#include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/tick.h>
 #include <linux/timer.h>
@@ -28,6 +30,9 @@
 
 #include <asm/cputime.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_interactive.h>
+
 static void (*pm_idle_old)(void);
 static atomic_t active_count = ATOMIC_INIT(0);
 
@@ -40,6 +45,9 @@ struct cpufreq_interactive_cpuinfo {
 	int idling;
 	u64 freq_change_time;
 	u64 freq_change_time_in_idle;
+	unsigned int floor_freq;
+	u64 floor_validate_time;
+	u64 hispeed_validate_time;
 	struct cpufreq_policy *policy;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
@@ -57,16 +65,63 @@ static spinlock_t up_cpumask_lock;
 static cpumask_t down_cpumask;
 static spinlock_t down_cpumask_lock;
 
-/* Go to max speed when CPU load at or above this value. */
+/* Go to hispeed_freq when CPU load at or above this value. */
 #define DEFAULT_GO_MAXSPEED_LOAD 85
 static unsigned long go_maxspeed_load;
 
+/* Frequency the first jump goes to; 0 means policy->max. */
+static unsigned long hispeed_freq;
+
+/*
+ * Once at or above hispeed_freq, wait this long (us) before going any
+ * higher.
+ */
+#define DEFAULT_ABOVE_HISPEED_DELAY 20000
+static unsigned long above_hispeed_delay;
+
 /*
- * The minimum amount of time to spend at a frequency before we can ramp down.
+ * Load to aim for at each frequency: "load [freq:load ...]" where each
+ * load applies from the preceding frequency up.  The governor picks the
+ * lowest frequency at which the observed work would not exceed the
+ * target load.
+ */
+#define DEFAULT_TARGET_LOAD 90
+static unsigned int default_target_loads[] = {DEFAULT_TARGET_LOAD};
+static spinlock_t target_loads_lock;
+static unsigned int *target_loads = default_target_loads;
+static int ntarget_loads = ARRAY_SIZE(default_target_loads);
+
+/*
+ * The minimum amount of time a frequency must go without being chosen
+ * again before we can ramp down below it.
  */
 #define DEFAULT_MIN_SAMPLE_TIME 80000;
 static unsigned long min_sample_time;
 
+/*
+ * Touch input, or a write to boostpulse, raises the target to boost_freq
+ * (policy->max if 0) right away and keeps it from dropping below that
+ * for boost_ms, instead of waiting for the load sampling to catch up.
+ */
+#define DEFAULT_BOOST_MS 100
+static unsigned long boost_freq;
+static unsigned long boost_ms;
+static unsigned long input_boost;
+
+/*
+ * Use the scheduler's decayed busy time (sched_cpu_util()) as the load
+ * instead of idle time sampled over the timer window.  It is smoother,
+ * but reacts to a sudden burst over a few tens of ms instead of one
+ * timer period.
+ */
+static unsigned long sched_load;
+
+static spinlock_t boost_lock;
+static u64 boost_until;		/* ktime in us */
+static unsigned long boost_input_count;
+static unsigned long boost_pulse_count;
+static u64 boost_time;		/* us spent in boost windows */
+
 #define DEBUG 0
 #define BUFSZ 128
 
@@ -167,6 +222,109 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+/* Frequency the policy may not drop below right now, 0 if not boosted */
+static unsigned int cpufreq_interactive_boost_floor(
+	struct cpufreq_policy *policy)
+{
+	unsigned long flags;
+	u64 until;
+
+	spin_lock_irqsave(&boost_lock, flags);
+	until = boost_until;
+	spin_unlock_irqrestore(&boost_lock, flags);
+
+	if (ktime_to_us(ktime_get()) >= until)
+		return 0;
+	if (!boost_freq || boost_freq > policy->max)
+		return policy->max;
+	return boost_freq;
+}
+
+static unsigned int cpufreq_interactive_hispeed(struct cpufreq_policy *policy)
+{
+	if (!hispeed_freq || hispeed_freq > policy->max)
+		return policy->max;
+	return hispeed_freq;
+}
+
+static unsigned int freq_to_targetload(unsigned int freq)
+{
+	unsigned int ret;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	for (i = 0; i < ntarget_loads - 1 && freq >= target_loads[i+1]; i += 2)
+		;
+	ret = target_loads[i];
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return ret;
+}
+
+/*
+ * Lowest table frequency at which loadadjfreq (load in percent times the
+ * current frequency) stays under that frequency's target load.  The
+ * target load itself depends on the frequency, so iterate, narrowing the
+ * range each time to avoid flipping between two frequencies.
+ */
+static unsigned int choose_freq(struct cpufreq_interactive_cpuinfo *pcpu,
+				unsigned int loadadjfreq)
+{
+	unsigned int freq = pcpu->policy->cur;
+	unsigned int prevfreq, freqmin, freqmax;
+	unsigned int index;
+
+	freqmin = 0;
+	freqmax = UINT_MAX;
+
+	do {
+		prevfreq = freq;
+
+		if (cpufreq_frequency_table_target(pcpu->policy,
+				pcpu->freq_table,
+				loadadjfreq / freq_to_targetload(freq),
+				CPUFREQ_RELATION_L, &index))
+			break;
+		freq = pcpu->freq_table[index].frequency;
+
+		if (freq > prevfreq) {
+			/* The previous frequency is too low */
+			freqmin = prevfreq;
+
+			if (freq >= freqmax) {
+				/* Pick the highest frequency below freqmax */
+				if (cpufreq_frequency_table_target(pcpu->policy,
+						pcpu->freq_table, freqmax - 1,
+						CPUFREQ_RELATION_H, &index))
+					break;
+				freq = pcpu->freq_table[index].frequency;
+
+				if (freq == freqmin) {
+					freq = freqmax;
+					break;
+				}
+			}
+		} else if (freq < prevfreq) {
+			/* The previous frequency is high enough */
+			freqmax = prevfreq;
+
+			if (freq <= freqmin) {
+				/* Pick the lowest frequency above freqmin */
+				if (cpufreq_frequency_table_target(pcpu->policy,
+						pcpu->freq_table, freqmin + 1,
+						CPUFREQ_RELATION_L, &index))
+					break;
+				freq = pcpu->freq_table[index].frequency;
+
+				if (freq == freqmax)
+					break;
+			}
+		}
+	} while (freq != prevfreq);
+
+	return freq;
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -179,8 +337,12 @@ static void cpufreq_interactive_timer(unsigned long data)
 		&per_cpu(cpuinfo, data);
 	u64 now_idle;
 	unsigned int new_freq;
+	unsigned int boost;
+	unsigned int hispeed;
+	unsigned int loadadjfreq;
 	unsigned int index;
 	unsigned long flags;
+	u64 now;
 
 	smp_rmb();
 
@@ -250,10 +412,34 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (load_since_change > cpu_load)
 		cpu_load = load_since_change;
 
-	if (cpu_load >= go_maxspeed_load)
-		new_freq = pcpu->policy->max;
-	else
-		new_freq = pcpu->policy->max * cpu_load / 100;
+	if (sched_load)
+		cpu_load = (sched_cpu_util(data) * 100) >> SCHED_LOAD_SHIFT;
+
+	now = pcpu->timer_run_time;
+	hispeed = cpufreq_interactive_hispeed(pcpu->policy);
+	loadadjfreq = cpu_load * pcpu->policy->cur;
+
+	if (cpu_load >= go_maxspeed_load) {
+		if (pcpu->target_freq < hispeed)
+			new_freq = hispeed;
+		else
+			new_freq = max(choose_freq(pcpu, loadadjfreq), hispeed);
+	} else {
+		new_freq = choose_freq(pcpu, loadadjfreq);
+	}
+
+	if (pcpu->target_freq >= hispeed && new_freq > pcpu->target_freq &&
+	    now - pcpu->hispeed_validate_time < above_hispeed_delay) {
+		trace_cpufreq_interactive_eval(data, cpu_load,
+			pcpu->target_freq, pcpu->policy->cur, new_freq,
+			"above_hispeed_delay");
+		goto rearm;
+	}
+	pcpu->hispeed_validate_time = now;
+
+	boost = cpufreq_interactive_boost_floor(pcpu->policy);
+	if (new_freq < boost)
+		new_freq = boost;
 
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_H,
@@ -264,25 +450,37 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	new_freq = pcpu->freq_table[index].frequency;
 
+	/*
+	 * Do not scale down below the floor until it has gone unvalidated
+	 * for the minimum sample time; every decision at or above the
+	 * floor revalidates it.
+	 */
+	if (new_freq < pcpu->floor_freq &&
+	    now - pcpu->floor_validate_time < min_sample_time) {
+		dbgpr("timer %d: load=%d cur=%d tgt=%d not yet\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
+		trace_cpufreq_interactive_eval(data, cpu_load,
+			pcpu->target_freq, pcpu->policy->cur, new_freq,
+			"min_sample_time");
+		goto rearm;
+	}
+	pcpu->floor_freq = new_freq;
+	pcpu->floor_validate_time = now;
+
 	if (pcpu->target_freq == new_freq)
 	{
 		dbgpr("timer %d: load=%d, already at %d\n", (int) data, cpu_load, new_freq);
+		trace_cpufreq_interactive_eval(data, cpu_load,
+			pcpu->target_freq, pcpu->policy->cur, new_freq,
+			"already");
 		goto rearm_if_notmax;
 	}
 
-	/*
-	 * Do not scale down unless we have been at this frequency for the
-	 * minimum sample time.
-	 */
-	if (new_freq < pcpu->target_freq) {
-		if (cputime64_sub(pcpu->timer_run_time, pcpu->freq_change_time) <
-		    min_sample_time) {
-			dbgpr("timer %d: load=%d cur=%d tgt=%d not yet\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
-			goto rearm;
-		}
-	}
-
 	dbgpr("timer %d: load=%d cur=%d tgt=%d queue\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
+	trace_cpufreq_interactive_eval(data, cpu_load, pcpu->target_freq,
+		pcpu->policy->cur, new_freq,
+		new_freq == boost ? "boost" :
+		new_freq < pcpu->target_freq ? "down" :
+		new_freq == hispeed ? "hispeed" : "up");
 
 	if (new_freq < pcpu->target_freq) {
 		pcpu->target_freq = new_freq;
@@ -527,6 +725,130 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
+/*
+ * Start or extend a boost window and raise every CPU still below the
+ * boost frequency.  Callable from the input event path, so nothing here
+ * sleeps; the up task does the actual frequency change.
+ */
+static void cpufreq_interactive_boost(bool pulse)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	u64 now = ktime_to_us(ktime_get());
+	u64 until = now + boost_ms * USEC_PER_MSEC;
+	unsigned long flags;
+	int wake = 0;
+	int i;
+
+	spin_lock_irqsave(&boost_lock, flags);
+	if (pulse)
+		boost_pulse_count++;
+	/*
+	 * A touch produces a stream of events; only extend the window once
+	 * half of it has passed.
+	 */
+	if (boost_until > now + boost_ms * USEC_PER_MSEC / 2) {
+		spin_unlock_irqrestore(&boost_lock, flags);
+		return;
+	}
+	if (!pulse)
+		boost_input_count++;
+	boost_time += until - max(now, boost_until);
+	boost_until = until;
+	spin_unlock_irqrestore(&boost_lock, flags);
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+	for_each_online_cpu(i) {
+		unsigned int freq;
+
+		pcpu = &per_cpu(cpuinfo, i);
+		smp_rmb();
+		if (!pcpu->governor_enabled)
+			continue;
+
+		freq = cpufreq_interactive_boost_floor(pcpu->policy);
+		if (pcpu->target_freq < freq) {
+			pcpu->target_freq = freq;
+			cpumask_set_cpu(i, &up_cpumask);
+			wake = 1;
+		}
+	}
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+
+	if (wake)
+		wake_up_process(up_task);
+}
+
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+		unsigned int type, unsigned int code, int value)
+{
+	if (input_boost && boost_ms)
+		cpufreq_interactive_boost(false);
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+		struct input_dev *dev, const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err2;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err1;
+
+	return 0;
+err1:
+	input_unregister_handle(handle);
+err2:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* Touchscreens: multi-touch or single-touch absolute devices */
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] = BIT_MASK(ABS_X) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+static int input_handler_registered;
+
 static ssize_t show_go_maxspeed_load(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
@@ -536,7 +858,8 @@ static ssize_t show_go_maxspeed_load(struct kobject *kobj,
 static ssize_t store_go_maxspeed_load(struct kobject *kobj,
 			struct attribute *attr, const char *buf, size_t count)
 {
-	return strict_strtoul(buf, 0, &go_maxspeed_load);
+	int ret = strict_strtoul(buf, 0, &go_maxspeed_load);
+	return ret ? ret : count;
 }
 
 static struct global_attr go_maxspeed_load_attr = __ATTR(go_maxspeed_load, 0644,
@@ -551,15 +874,150 @@ static ssize_t show_min_sample_time(struct kobject *kobj,
 static ssize_t store_min_sample_time(struct kobject *kobj,
 			struct attribute *attr, const char *buf, size_t count)
 {
-	return strict_strtoul(buf, 0, &min_sample_time);
+	int ret = strict_strtoul(buf, 0, &min_sample_time);
+	return ret ? ret : count;
 }
 
 static struct global_attr min_sample_time_attr = __ATTR(min_sample_time, 0644,
 		show_min_sample_time, store_min_sample_time);
 
+#define show_one(file_name)						\
+static ssize_t show_##file_name(struct kobject *kobj,			\
+				struct attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%lu\n", file_name);			\
+}
+
+#define store_one(file_name)						\
+static ssize_t store_##file_name(struct kobject *kobj,			\
+			struct attribute *attr, const char *buf,	\
+			size_t count)					\
+{									\
+	int ret = strict_strtoul(buf, 0, &file_name);			\
+	return ret ? ret : count;					\
+}									\
+static struct global_attr file_name##_attr = __ATTR(file_name, 0644,	\
+		show_##file_name, store_##file_name);
+
+static ssize_t show_target_loads(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	unsigned long flags;
+	ssize_t ret = 0;
+	int i;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	for (i = 0; i < ntarget_loads; i++)
+		ret += sprintf(buf + ret, "%u%s", target_loads[i],
+			       i & 1 ? ":" : " ");
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	buf[ret - 1] = '\n';
+	return ret;
+}
+
+static ssize_t store_target_loads(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	unsigned int *new_loads, *old_loads;
+	unsigned long flags;
+	const char *cp;
+	int ntokens = 1;
+	int i;
+
+	for (cp = buf; (cp = strpbrk(cp, " :")); cp++)
+		ntokens++;
+	if (!(ntokens & 1))
+		return -EINVAL;
+
+	new_loads = kmalloc(ntokens * sizeof(unsigned int), GFP_KERNEL);
+	if (!new_loads)
+		return -ENOMEM;
+
+	cp = buf;
+	for (i = 0; i < ntokens; i++) {
+		if (sscanf(cp, "%u", &new_loads[i]) != 1 ||
+		    (!(i & 1) && (!new_loads[i] || new_loads[i] > 100)) ||
+		    (i > 1 && (i & 1) && new_loads[i] <= new_loads[i - 2])) {
+			kfree(new_loads);
+			return -EINVAL;
+		}
+		cp = strpbrk(cp, " :");
+		if (!cp)
+			break;
+		cp++;
+	}
+	if (i != ntokens - 1) {
+		kfree(new_loads);
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	old_loads = target_loads;
+	target_loads = new_loads;
+	ntarget_loads = ntokens;
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+
+	if (old_loads != default_target_loads)
+		kfree(old_loads);
+	return count;
+}
+
+static struct global_attr target_loads_attr = __ATTR(target_loads, 0644,
+		show_target_loads, store_target_loads);
+
+show_one(hispeed_freq);
+store_one(hispeed_freq);
+show_one(above_hispeed_delay);
+store_one(above_hispeed_delay);
+show_one(boost_freq);
+store_one(boost_freq);
+show_one(boost_ms);
+store_one(boost_ms);
+show_one(input_boost);
+store_one(input_boost);
+show_one(sched_load);
+store_one(sched_load);
+
+static ssize_t store_boostpulse(struct kobject *kobj, struct attribute *attr,
+				const char *buf, size_t count)
+{
+	if (boost_ms)
+		cpufreq_interactive_boost(true);
+	return count;
+}
+
+static struct global_attr boostpulse_attr = __ATTR(boostpulse, 0200,
+		NULL, store_boostpulse);
+
+static ssize_t show_boost_stats(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	unsigned long flags;
+	ssize_t ret;
+
+	spin_lock_irqsave(&boost_lock, flags);
+	ret = sprintf(buf, "input_boosts %lu\nboostpulses %lu\n"
+		      "boost_time_ms %llu\n", boost_input_count,
+		      boost_pulse_count, div_u64(boost_time, USEC_PER_MSEC));
+	spin_unlock_irqrestore(&boost_lock, flags);
+	return ret;
+}
+
+static struct global_attr boost_stats_attr = __ATTR(boost_stats, 0444,
+		show_boost_stats, NULL);
+
 static struct attribute *interactive_attributes[] = {
 	&go_maxspeed_load_attr.attr,
 	&min_sample_time_attr.attr,
+	&target_loads_attr.attr,
+	&hispeed_freq_attr.attr,
+	&above_hispeed_delay_attr.attr,
+	&boost_freq_attr.attr,
+	&boost_ms_attr.attr,
+	&input_boost_attr.attr,
+	&boostpulse_attr.attr,
+	&boost_stats_attr.attr,
+	&sched_load_attr.attr,
 	NULL,
 };
 
@@ -586,6 +1044,9 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		pcpu->freq_change_time_in_idle =
 			get_cpu_idle_time_us(new_policy->cpu,
 					     &pcpu->freq_change_time);
+		pcpu->floor_freq = pcpu->target_freq;
+		pcpu->floor_validate_time = pcpu->freq_change_time;
+		pcpu->hispeed_validate_time = pcpu->freq_change_time;
 		pcpu->governor_enabled = 1;
 		smp_wmb();
 		/*
@@ -600,6 +1061,12 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		if (rc)
 			return rc;
 
+		if (input_register_handler(&cpufreq_interactive_input_handler))
+			pr_warn("%s: failed to register input handler\n",
+				__func__);
+		else
+			input_handler_registered = 1;
+
 		pm_idle_old = pm_idle;
 		pm_idle = cpufreq_interactive_idle;
 		break;
@@ -620,6 +1087,11 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		if (atomic_dec_return(&active_count) > 0)
 			return 0;
 
+		if (input_handler_registered) {
+			input_unregister_handler(
+				&cpufreq_interactive_input_handler);
+			input_handler_registered = 0;
+		}
 		sysfs_remove_group(cpufreq_global_kobject,
 				&interactive_attr_group);
 
@@ -646,6 +1118,9 @@ static int __init cpufreq_interactive_init(void)
 
 	go_maxspeed_load = DEFAULT_GO_MAXSPEED_LOAD;
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
+	above_hispeed_delay = DEFAULT_ABOVE_HISPEED_DELAY;
+	boost_ms = DEFAULT_BOOST_MS;
+	input_boost = 1;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -675,6 +1150,8 @@ static int __init cpufreq_interactive_init(void)
 
 	spin_lock_init(&up_cpumask_lock);
 	spin_lock_init(&down_cpumask_lock);
+	spin_lock_init(&boost_lock);
+	spin_lock_init(&target_loads_lock);
 
 #if DEBUG
 	spin_lock_init(&dbgpr_lock);
@@ -20,6 +20,7 @@
 #include <linux/kobject.h>
 #include <linux/spinlock.h>
 #include <linux/notifier.h>
+#include <linux/ktime.h>
 #include <asm/cputime.h>
 
 static spinlock_t cpufreq_stats_lock;
@@ -30,6 +31,12 @@ static struct freq_attr _attr_##_name = {\
 	.show = _show,\
 };
 
+/* Upper bounds (usecs) of the transition latency histogram buckets */
+static const unsigned int lat_bucket_us[] = {
+	50, 100, 200, 500, 1000, 2000, 5000, UINT_MAX,
+};
+#define LAT_BUCKETS	ARRAY_SIZE(lat_bucket_us)
+
 struct cpufreq_stats {
 	unsigned int cpu;
 	unsigned int total_trans;
@@ -43,6 +50,11 @@ struct cpufreq_stats {
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	unsigned int *trans_table;
 #endif
+	ktime_t trans_start;		/* PRECHANGE of transition in flight */
+	u64 *lat_total_us;		/* [from][to] */
+	unsigned int *lat_count;	/* [from][to] */
+	unsigned int *lat_max_us;	/* [from][to] */
+	unsigned int *lat_hist;		/* [to][bucket] */
 };
 
 static DEFINE_PER_CPU(struct cpufreq_stats *, cpufreq_stats_table);
@@ -187,6 +199,82 @@ static ssize_t show_trans_table(struct cpufreq_policy *policy, char *buf)
 CPUFREQ_STATDEVICE_ATTR(trans_table, 0444, show_trans_table);
 #endif
 
+/*
+ * Time from PRECHANGE to POSTCHANGE for each from/to pair, i.e. how long
+ * the driver took to actually switch.  Pairs never taken are left out.
+ */
+static ssize_t show_trans_latency(struct cpufreq_policy *policy, char *buf)
+{
+	ssize_t len = 0;
+	int i, j;
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+	len += snprintf(buf + len, PAGE_SIZE - len, "%9s %9s %9s %9s %9s\n",
+			"From", "To", "count", "avg_us", "max_us");
+	spin_lock(&cpufreq_stats_lock);
+	for (i = 0; i < stat->state_num; i++) {
+		for (j = 0; j < stat->state_num; j++) {
+			int n = i * stat->max_state + j;
+
+			if (!stat->lat_count[n])
+				continue;
+			if (len >= PAGE_SIZE)
+				break;
+			len += snprintf(buf + len, PAGE_SIZE - len,
+					"%9u %9u %9u %9llu %9u\n",
+					stat->freq_table[i], stat->freq_table[j],
+					stat->lat_count[n],
+					div_u64(stat->lat_total_us[n],
+						stat->lat_count[n]),
+					stat->lat_max_us[n]);
+		}
+	}
+	spin_unlock(&cpufreq_stats_lock);
+	if (len >= PAGE_SIZE)
+		return PAGE_SIZE;
+	return len;
+}
+CPUFREQ_STATDEVICE_ATTR(trans_latency, 0444, show_trans_latency);
+
+/* Switch latency histogram per target frequency */
+static ssize_t show_latency_hist(struct cpufreq_policy *policy, char *buf)
+{
+	ssize_t len = 0;
+	int i, j;
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+	len += snprintf(buf + len, PAGE_SIZE - len, "%9s:", "To / us");
+	for (j = 0; j < LAT_BUCKETS - 1; j++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "  <%6u",
+				lat_bucket_us[j]);
+	len += snprintf(buf + len, PAGE_SIZE - len, " >=%6u\n",
+			lat_bucket_us[LAT_BUCKETS - 2]);
+
+	spin_lock(&cpufreq_stats_lock);
+	for (i = 0; i < stat->state_num; i++) {
+		if (len >= PAGE_SIZE)
+			break;
+		len += snprintf(buf + len, PAGE_SIZE - len, "%9u:",
+				stat->freq_table[i]);
+		for (j = 0; j < LAT_BUCKETS; j++) {
+			if (len >= PAGE_SIZE)
+				break;
+			len += snprintf(buf + len, PAGE_SIZE - len, " %8u",
+					stat->lat_hist[i * LAT_BUCKETS + j]);
+		}
+		if (len >= PAGE_SIZE)
+			break;
+		len += snprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+	spin_unlock(&cpufreq_stats_lock);
+	if (len >= PAGE_SIZE)
+		return PAGE_SIZE;
+	return len;
+}
+CPUFREQ_STATDEVICE_ATTR(latency_hist, 0444, show_latency_hist);
+
 CPUFREQ_STATDEVICE_ATTR(total_trans, 0444, show_total_trans);
 CPUFREQ_STATDEVICE_ATTR(time_in_state, 0444, show_time_in_state);
 
@@ -194,6 +282,8 @@ static struct attribute *default_attrs[] = {
 	&_attr_total_trans.attr,
 	&_attr_time_in_state.attr,
 	&_attr_percentage.attr,
+	&_attr_trans_latency.attr,
+	&_attr_latency_hist.attr,
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	&_attr_trans_table.attr,
 #endif
@@ -263,6 +353,9 @@ static int cpufreq_stats_create_table(struct cpufreq_policy *policy,
 	}
 
 	alloc_size = count * sizeof(int) + 2 * count * sizeof(cputime64_t);
+	alloc_size += count * count * sizeof(u64);
+	alloc_size += 2 * count * count * sizeof(int);
+	alloc_size += count * LAT_BUCKETS * sizeof(int);
 
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	alloc_size += count * count * sizeof(int);
@@ -274,10 +367,14 @@ static int cpufreq_stats_create_table(struct cpufreq_policy *policy,
 		goto error_out;
 	}
 	stat->percentage = (cputime64_t *)(stat->time_in_state + count);
-	stat->freq_table = (unsigned int *)(stat->time_in_state + 2 * count);
+	stat->lat_total_us = (u64 *)(stat->time_in_state + 2 * count);
+	stat->freq_table = (unsigned int *)(stat->lat_total_us + count * count);
+	stat->lat_count = stat->freq_table + count;
+	stat->lat_max_us = stat->lat_count + count * count;
+	stat->lat_hist = stat->lat_max_us + count * count;
 
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
-	stat->trans_table = stat->freq_table + count;
+	stat->trans_table = stat->lat_hist + count * LAT_BUCKETS;
 #endif
 	j = 0;
 	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
@@ -326,14 +423,28 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	struct cpufreq_freqs *freq = data;
 	struct cpufreq_stats *stat;
 	int old_index, new_index;
+	unsigned int lat_us = 0;
+	bool timed = false;
 
-	if (val != CPUFREQ_POSTCHANGE)
+	if (val != CPUFREQ_PRECHANGE && val != CPUFREQ_POSTCHANGE)
 		return 0;
 
 	stat = per_cpu(cpufreq_stats_table, freq->cpu);
 	if (!stat)
 		return 0;
 
+	if (val == CPUFREQ_PRECHANGE) {
+		stat->trans_start = ktime_get();
+		return 0;
+	}
+
+	/* a POSTCHANGE without PRECHANGE (e.g. resync) has nothing to time */
+	if (stat->trans_start.tv64) {
+		lat_us = ktime_to_us(ktime_sub(ktime_get(), stat->trans_start));
+		stat->trans_start.tv64 = 0;
+		timed = true;
+	}
+
 	old_index = stat->last_index;
 	new_index = freq_table_get_index(stat, freq->new);
 
@@ -350,6 +461,18 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	stat->trans_table[old_index * stat->max_state + new_index]++;
 #endif
 	stat->total_trans++;
+	if (timed) {
+		int n = old_index * stat->max_state + new_index;
+		int b = 0;
+
+		while (b < LAT_BUCKETS - 1 && lat_us >= lat_bucket_us[b])
+			b++;
+		stat->lat_hist[new_index * LAT_BUCKETS + b]++;
+		stat->lat_count[n]++;
+		stat->lat_total_us[n] += lat_us;
+		if (lat_us > stat->lat_max_us[n])
+			stat->lat_max_us[n] = lat_us;
+	}
 	spin_unlock(&cpufreq_stats_lock);
 	return 0;
 }
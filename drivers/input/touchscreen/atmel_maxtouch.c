@@ -2196,7 +2196,7 @@ static int __devinit mxt_probe(struct i2c_client *client,
 						MXT_SUSPEND_LEVEL;
 	mxt->early_suspend.suspend = mxt_early_suspend;
 	mxt->early_suspend.resume = mxt_late_resume;
-	register_early_suspend(&mxt->early_suspend);
+	register_early_suspend_async(&mxt->early_suspend);
 #endif
 
 	return 0;
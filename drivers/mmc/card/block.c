@@ -65,6 +65,20 @@ static int max_devices;
 /* 256 minors, so at most 256 separate devices */
 static DECLARE_BITMAP(dev_use, 256);
 
+/* eMMC 4.5 packed command header */
+#define PACKED_CMD_VER		0x01
+#define PACKED_CMD_WR		0x02
+
+/*
+ * Write commands issued, by the number of requests they carried.
+ */
+struct mmc_blk_packed_stats {
+	unsigned long	depth[MMC_PACKED_NR_MAX + 1];
+	unsigned long	packed;		/* eMMC packed write commands */
+	unsigned long	coalesced;	/* CMD25s spanning adjacent writes */
+	unsigned long	failed;		/* packs re-issued one by one */
+};
+
 /*
  * There is one mmc_blk_data per slot.
  */
@@ -76,9 +90,13 @@ struct mmc_blk_data {
 	unsigned int	flags;
 #define MMC_BLK_CMD23	(1 << 0)	/* Can do SET_BLOCK_COUNT for multiblock */
 #define MMC_BLK_REL_WR	(1 << 1)	/* MMC Reliable write support */
+#define MMC_BLK_PACKED_WR (1 << 2)	/* eMMC 4.5 packed write commands */
 
 	unsigned int	usage;
 	unsigned int	read_only;
+
+	unsigned int	packing;	/* pack small writes, from sysfs */
+	struct mmc_blk_packed_stats packed_stats;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -165,14 +183,6 @@ static const struct block_device_operations mmc_bdops = {
 	.owner			= THIS_MODULE,
 };
 
-struct mmc_blk_request {
-	struct mmc_request	mrq;
-	struct mmc_command	sbc;
-	struct mmc_command	cmd;
-	struct mmc_command	stop;
-	struct mmc_data		data;
-};
-
 static u32 mmc_sd_num_wr_blocks(struct mmc_card *card)
 {
 	int err;
@@ -263,6 +273,36 @@ static u32 get_card_status(struct mmc_card *card, struct request *req)
 	return cmd.resp[0];
 }
 
+/*
+ * Poll the card until it has left the programming state after a write.
+ */
+static int mmc_blk_wait_for_ready(struct mmc_card *card, struct request *req)
+{
+	struct mmc_command cmd;
+	int err;
+
+	do {
+		memset(&cmd, 0, sizeof(struct mmc_command));
+		cmd.opcode = MMC_SEND_STATUS;
+		cmd.arg = card->rca << 16;
+		cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		err = mmc_wait_for_cmd(card->host, &cmd, 5);
+		if (err) {
+			printk(KERN_ERR "%s: error %d requesting status\n",
+			       req->rq_disk->disk_name, err);
+			return err;
+		}
+		/*
+		 * Some cards mishandle the status bits,
+		 * so make sure to check both the busy
+		 * indication and the card state.
+		 */
+	} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
+		(R1_CURRENT_STATE(cmd.resp[0]) == 7));
+
+	return 0;
+}
+
 static int mmc_blk_issue_discard_rq(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
@@ -370,12 +410,19 @@ static inline void mmc_apply_rel_rw(struct mmc_blk_request *brq,
 	}
 }
 
-static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
+/*
+ * Fill in the MMC request for the part of mqrq->req that is still
+ * outstanding, map its data and bounce it if needed.
+ */
+static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
+			       struct mmc_card *card,
+			       int disable_multi,
+			       struct mmc_queue *mq)
 {
 	struct mmc_blk_data *md = mq->data;
-	struct mmc_card *card = md->queue.card;
-	struct mmc_blk_request brq;
-	int ret = 1, disable_multi = 0;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	u32 readcmd, writecmd;
 
 	/*
 	 * Reliable writes are used to implement Forced Unit Access and
@@ -386,233 +433,214 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		(rq_data_dir(req) == WRITE) &&
 		(md->flags & MMC_BLK_REL_WR);
 
-	mmc_claim_host(card->host);
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
 
-	do {
-		struct mmc_command cmd;
-		u32 readcmd, writecmd, status = 0;
-
-		memset(&brq, 0, sizeof(struct mmc_blk_request));
-		brq.mrq.cmd = &brq.cmd;
-		brq.mrq.data = &brq.data;
-
-		brq.cmd.arg = blk_rq_pos(req);
-		if (!mmc_card_blockaddr(card))
-			brq.cmd.arg <<= 9;
-		brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
-		brq.data.blksz = 512;
-		brq.stop.opcode = MMC_STOP_TRANSMISSION;
-		brq.stop.arg = 0;
-		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = blk_rq_sectors(req);
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+	brq->data.blocks = blk_rq_sectors(req);
 
-		/*
-		 * The block layer doesn't support all sector count
-		 * restrictions, so we need to be prepared for too big
-		 * requests.
-		 */
-		if (brq.data.blocks > card->host->max_blk_count)
-			brq.data.blocks = card->host->max_blk_count;
+	/*
+	 * The block layer doesn't support all sector count
+	 * restrictions, so we need to be prepared for too big
+	 * requests.
+	 */
+	if (brq->data.blocks > card->host->max_blk_count)
+		brq->data.blocks = card->host->max_blk_count;
 
-		/*
-		 * After a read error, we redo the request one sector at a time
-		 * in order to accurately determine which sectors can be read
-		 * successfully.
-		 */
-		if (disable_multi && brq.data.blocks > 1)
-			brq.data.blocks = 1;
+	/*
+	 * After a read error, we redo the request one sector at a time
+	 * in order to accurately determine which sectors can be read
+	 * successfully.
+	 */
+	if (disable_multi && brq->data.blocks > 1)
+		brq->data.blocks = 1;
 
-		if (brq.data.blocks > 1 || do_rel_wr) {
-			/* SPI multiblock writes terminate using a special
-			 * token, not a STOP_TRANSMISSION request.
-			 */
-			if (!mmc_host_is_spi(card->host) ||
-			    rq_data_dir(req) == READ)
-				brq.mrq.stop = &brq.stop;
-			readcmd = MMC_READ_MULTIPLE_BLOCK;
-			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
-		} else {
-			brq.mrq.stop = NULL;
-			readcmd = MMC_READ_SINGLE_BLOCK;
-			writecmd = MMC_WRITE_BLOCK;
-		}
-		if (rq_data_dir(req) == READ) {
-			brq.cmd.opcode = readcmd;
-			brq.data.flags |= MMC_DATA_READ;
-		} else {
-			brq.cmd.opcode = writecmd;
-			brq.data.flags |= MMC_DATA_WRITE;
-		}
+	if (brq->data.blocks > 1 || do_rel_wr) {
+		/* SPI multiblock writes terminate using a special
+		 * token, not a STOP_TRANSMISSION request.
+		 */
+		if (!mmc_host_is_spi(card->host) ||
+		    rq_data_dir(req) == READ)
+			brq->mrq.stop = &brq->stop;
+		readcmd = MMC_READ_MULTIPLE_BLOCK;
+		writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+	} else {
+		brq->mrq.stop = NULL;
+		readcmd = MMC_READ_SINGLE_BLOCK;
+		writecmd = MMC_WRITE_BLOCK;
+	}
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = readcmd;
+		brq->data.flags |= MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = writecmd;
+		brq->data.flags |= MMC_DATA_WRITE;
+	}
 
-		if (do_rel_wr)
-			mmc_apply_rel_rw(&brq, card, req);
+	if (do_rel_wr)
+		mmc_apply_rel_rw(brq, card, req);
 
-		/*
-		 * Pre-defined multi-block transfers are preferable to
-		 * open ended-ones (and necessary for reliable writes).
-		 * However, it is not sufficient to just send CMD23,
-		 * and avoid the final CMD12, as on an error condition
-		 * CMD12 (stop) needs to be sent anyway. This, coupled
-		 * with Auto-CMD23 enhancements provided by some
-		 * hosts, means that the complexity of dealing
-		 * with this is best left to the host. If CMD23 is
-		 * supported by card and host, we'll fill sbc in and let
-		 * the host deal with handling it correctly. This means
-		 * that for hosts that don't expose MMC_CAP_CMD23, no
-		 * change of behavior will be observed.
-		 *
-		 * N.B: Some MMC cards experience perf degradation.
-		 * We'll avoid using CMD23-bounded multiblock writes for
-		 * these, while retaining features like reliable writes.
-		 */
+	/*
+	 * Pre-defined multi-block transfers are preferable to
+	 * open ended-ones (and necessary for reliable writes).
+	 * However, it is not sufficient to just send CMD23,
+	 * and avoid the final CMD12, as on an error condition
+	 * CMD12 (stop) needs to be sent anyway. This, coupled
+	 * with Auto-CMD23 enhancements provided by some
+	 * hosts, means that the complexity of dealing
+	 * with this is best left to the host. If CMD23 is
+	 * supported by card and host, we'll fill sbc in and let
+	 * the host deal with handling it correctly. This means
+	 * that for hosts that don't expose MMC_CAP_CMD23, no
+	 * change of behavior will be observed.
+	 *
+	 * N.B: Some MMC cards experience perf degradation.
+	 * We'll avoid using CMD23-bounded multiblock writes for
+	 * these, while retaining features like reliable writes.
+	 */
 
-		if ((md->flags & MMC_BLK_CMD23) &&
-		    mmc_op_multi(brq.cmd.opcode) &&
-		    (do_rel_wr || !(card->quirks & MMC_QUIRK_BLK_NO_CMD23))) {
-			brq.sbc.opcode = MMC_SET_BLOCK_COUNT;
-			brq.sbc.arg = brq.data.blocks |
-				(do_rel_wr ? (1 << 31) : 0);
-			brq.sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
-			brq.mrq.sbc = &brq.sbc;
-		}
+	if ((md->flags & MMC_BLK_CMD23) &&
+	    mmc_op_multi(brq->cmd.opcode) &&
+	    (do_rel_wr || !(card->quirks & MMC_QUIRK_BLK_NO_CMD23))) {
+		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+		brq->sbc.arg = brq->data.blocks |
+			(do_rel_wr ? (1 << 31) : 0);
+		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		brq->mrq.sbc = &brq->sbc;
+	}
 
-		mmc_set_data_timeout(&brq.data, card);
+	mmc_set_data_timeout(&brq->data, card);
 
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
 
-		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
-		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
-
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
+	/*
+	 * Adjust the sg list so it is the same size as the
+	 * request.
+	 */
+	if (brq->data.blocks != blk_rq_sectors(req)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
 			}
-			brq.data.sg_len = i;
 		}
+		brq->data.sg_len = i;
+	}
 
-		mmc_queue_bounce_pre(mq);
-
-		mmc_wait_for_req(card->host, &brq.mrq);
+	mmc_queue_bounce_pre(mqrq);
+}
 
-		mmc_queue_bounce_post(mq);
+/*
+ * Check the result of a finished transfer and complete the bytes it
+ * moved.  Returns non-zero if part of the request is still outstanding
+ * and has to be issued again, with *disable_multi telling whether to
+ * fall back to single block transfers.
+ */
+static int mmc_blk_rw_finish(struct mmc_queue *mq, struct mmc_queue_req *mqrq,
+			     int *disable_multi)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	u32 status = 0;
+	int ret = 1;
 
-		/*
-		 * Check for errors here, but don't jump to cmd_err
-		 * until later as we need to wait for the card to leave
-		 * programming mode even when things go wrong.
-		 */
-		if (brq.sbc.error || brq.cmd.error ||
-		    brq.data.error || brq.stop.error) {
-			if (brq.data.blocks > 1 && rq_data_dir(req) == READ) {
-				/* Redo read one sector at a time */
-				printk(KERN_WARNING "%s: retrying using single "
-				       "block read\n", req->rq_disk->disk_name);
-				disable_multi = 1;
-				continue;
-			}
-			status = get_card_status(card, req);
-		} else if (disable_multi == 1) {
-			disable_multi = 0;
-		}
+	mmc_queue_bounce_post(mqrq);
 
-		if (brq.sbc.error) {
-			printk(KERN_ERR "%s: error %d sending SET_BLOCK_COUNT "
-			       "command, response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.sbc.error,
-			       brq.sbc.resp[0], status);
+	/*
+	 * Check for errors here, but don't jump to cmd_err
+	 * until later as we need to wait for the card to leave
+	 * programming mode even when things go wrong.
+	 */
+	if (brq->sbc.error || brq->cmd.error ||
+	    brq->data.error || brq->stop.error) {
+		if (brq->data.blocks > 1 && rq_data_dir(req) == READ) {
+			/* Redo read one sector at a time */
+			printk(KERN_WARNING "%s: retrying using single "
+			       "block read\n", req->rq_disk->disk_name);
+			*disable_multi = 1;
+			return 1;
 		}
+		status = get_card_status(card, req);
+	} else if (*disable_multi == 1) {
+		*disable_multi = 0;
+	}
 
-		if (brq.cmd.error) {
-			printk(KERN_ERR "%s: error %d sending read/write "
-			       "command, response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.cmd.error,
-			       brq.cmd.resp[0], status);
-		}
+	if (brq->sbc.error) {
+		printk(KERN_ERR "%s: error %d sending SET_BLOCK_COUNT "
+		       "command, response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->sbc.error,
+		       brq->sbc.resp[0], status);
+	}
 
-		if (brq.data.error) {
-			if (brq.data.error == -ETIMEDOUT && brq.mrq.stop)
-				/* 'Stop' response contains card status */
-				status = brq.mrq.stop->resp[0];
-			printk(KERN_ERR "%s: error %d transferring data,"
-			       " sector %u, nr %u, card status %#x\n",
-			       req->rq_disk->disk_name, brq.data.error,
-			       (unsigned)blk_rq_pos(req),
-			       (unsigned)blk_rq_sectors(req), status);
-		}
+	if (brq->cmd.error) {
+		printk(KERN_ERR "%s: error %d sending read/write "
+		       "command, response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->cmd.error,
+		       brq->cmd.resp[0], status);
+	}
 
-		if (brq.stop.error) {
-			printk(KERN_ERR "%s: error %d sending stop command, "
-			       "response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.stop.error,
-			       brq.stop.resp[0], status);
-		}
+	if (brq->data.error) {
+		if (brq->data.error == -ETIMEDOUT && brq->mrq.stop)
+			/* 'Stop' response contains card status */
+			status = brq->mrq.stop->resp[0];
+		printk(KERN_ERR "%s: error %d transferring data,"
+		       " sector %u, nr %u, card status %#x\n",
+		       req->rq_disk->disk_name, brq->data.error,
+		       (unsigned)blk_rq_pos(req),
+		       (unsigned)blk_rq_sectors(req), status);
+	}
 
-		if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
-			do {
-				int err;
-
-				cmd.opcode = MMC_SEND_STATUS;
-				cmd.arg = card->rca << 16;
-				cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
-				err = mmc_wait_for_cmd(card->host, &cmd, 5);
-				if (err) {
-					printk(KERN_ERR "%s: error %d requesting status\n",
-					       req->rq_disk->disk_name, err);
-					goto cmd_err;
-				}
-				/*
-				 * Some cards mishandle the status bits,
-				 * so make sure to check both the busy
-				 * indication and the card state.
-				 */
-			} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
-				(R1_CURRENT_STATE(cmd.resp[0]) == 7));
-
-#if 0
-			if (cmd.resp[0] & ~0x00000900)
-				printk(KERN_ERR "%s: status = %08x\n",
-				       req->rq_disk->disk_name, cmd.resp[0]);
-			if (mmc_decode_status(cmd.resp))
-				goto cmd_err;
-#endif
-		}
+	if (brq->stop.error) {
+		printk(KERN_ERR "%s: error %d sending stop command, "
+		       "response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->stop.error,
+		       brq->stop.resp[0], status);
+	}
 
-		if (brq.cmd.error || brq.stop.error || brq.data.error) {
-			if (rq_data_dir(req) == READ) {
-				/*
-				 * After an error, we redo I/O one sector at a
-				 * time, so we only reach here after trying to
-				 * read a single sector.
-				 */
-				spin_lock_irq(&md->lock);
-				ret = __blk_end_request(req, -EIO, brq.data.blksz);
-				spin_unlock_irq(&md->lock);
-				continue;
-			}
+	if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
+		if (mmc_blk_wait_for_ready(card, req))
 			goto cmd_err;
-		}
+	}
 
-		/*
-		 * A block was successfully transferred.
-		 */
-		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
-		spin_unlock_irq(&md->lock);
-	} while (ret);
+	if (brq->cmd.error || brq->stop.error || brq->data.error) {
+		if (rq_data_dir(req) == READ) {
+			/*
+			 * After an error, we redo I/O one sector at a
+			 * time, so we only reach here after trying to
+			 * read a single sector.
+			 */
+			spin_lock_irq(&md->lock);
+			ret = __blk_end_request(req, -EIO, brq->data.blksz);
+			spin_unlock_irq(&md->lock);
+			return ret;
+		}
+		goto cmd_err;
+	}
 
-	mmc_release_host(card->host);
+	/*
+	 * A block was successfully transferred.
+	 */
+	spin_lock_irq(&md->lock);
+	ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
+	spin_unlock_irq(&md->lock);
 
-	return 1;
+	return ret;
 
  cmd_err:
  	/*
@@ -634,12 +662,10 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		}
 	} else {
 		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
+		ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
 		spin_unlock_irq(&md->lock);
 	}
 
-	mmc_release_host(card->host);
-
 	spin_lock_irq(&md->lock);
 	while (ret)
 		ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
@@ -648,6 +674,331 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 	return 0;
 }
 
+static void mmc_blk_clear_packed(struct mmc_queue_req *mqrq)
+{
+	mqrq->packed_cmd = MMC_PACKED_NONE;
+	mqrq->packed_num = 0;
+	mqrq->packed_blocks = 0;
+}
+
+/*
+ * Try to gather the write requests queued behind mqrq->req into one
+ * write command.  Cards with eMMC 4.5 packed commands take any mix of
+ * addresses; everything else gets runs of adjacent writes the elevator
+ * has not merged, e.g. because the first one was already dispatched.
+ * Returns non-zero if more than one request was gathered.
+ */
+static int mmc_blk_prep_packed_list(struct mmc_queue *mq,
+				    struct mmc_queue_req *mqrq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct request_queue *q = mq->queue;
+	struct request *req = mqrq->req;
+	struct request *last = req, *next;
+	unsigned int max_num, max_blocks, max_segs;
+	unsigned int num = 1, blocks, segs;
+	enum mmc_packed_cmd type;
+
+	/* reliable writes keep their own command */
+	if (!md->packing || rq_data_dir(req) != WRITE || mqrq->bounce_buf ||
+	    (req->cmd_flags & (REQ_FUA | REQ_META)))
+		return 0;
+
+	max_blocks = min(card->host->max_blk_count,
+			 card->host->max_req_size >> 9);
+	max_segs = card->host->max_segs;
+
+	if (md->flags & MMC_BLK_PACKED_WR) {
+		type = MMC_PACKED_WRITE;
+		max_num = min_t(unsigned int, card->ext_csd.max_packed_writes,
+				MMC_PACKED_NR_MAX);
+		/* room for the header block */
+		max_blocks--;
+		max_segs--;
+	} else {
+		type = MMC_PACKED_COALESCED;
+		max_num = MMC_PACKED_NR_MAX;
+	}
+
+	blocks = blk_rq_sectors(req);
+	segs = req->nr_phys_segments;
+	if (blocks > max_blocks || segs > max_segs)
+		return 0;
+
+	list_add_tail(&req->queuelist, &mqrq->packed_list);
+
+	spin_lock_irq(q->queue_lock);
+	while (num < max_num) {
+		next = blk_peek_request(q);
+		if (!next)
+			break;
+
+		if (rq_data_dir(next) != WRITE ||
+		    (next->cmd_flags & (REQ_DISCARD | REQ_FLUSH |
+					REQ_FUA | REQ_META)))
+			break;
+
+		if (blocks + blk_rq_sectors(next) > max_blocks ||
+		    segs + next->nr_phys_segments > max_segs)
+			break;
+
+		if (type == MMC_PACKED_COALESCED &&
+		    blk_rq_pos(next) != blk_rq_pos(last) + blk_rq_sectors(last))
+			break;
+
+		blk_start_request(next);
+		list_add_tail(&next->queuelist, &mqrq->packed_list);
+		blocks += blk_rq_sectors(next);
+		segs += next->nr_phys_segments;
+		last = next;
+		num++;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	if (num == 1) {
+		list_del_init(&req->queuelist);
+		return 0;
+	}
+
+	mqrq->packed_cmd = type;
+	mqrq->packed_num = num;
+	mqrq->packed_blocks = blocks;
+
+	return 1;
+}
+
+/*
+ * Build a single CMD25 for all requests on mqrq->packed_list.  For a
+ * packed write, the first data block is the header listing each
+ * request's address and length, and CMD23 announces the packing.
+ */
+static void mmc_blk_packed_rq_prep(struct mmc_queue_req *mqrq,
+				   struct mmc_card *card,
+				   struct mmc_queue *mq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req;
+	bool do_sbc = false;
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(mqrq->req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = mqrq->packed_blocks;
+	brq->data.flags = MMC_DATA_WRITE;
+
+	/* SPI multiblock writes terminate with a token instead */
+	if (!mmc_host_is_spi(card->host)) {
+		brq->stop.opcode = MMC_STOP_TRANSMISSION;
+		brq->stop.arg = 0;
+		brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+		brq->mrq.stop = &brq->stop;
+	}
+
+	if (mqrq->packed_cmd == MMC_PACKED_WRITE) {
+		u32 *hdr = mqrq->packed_cmd_hdr;
+		unsigned int i = 1;
+
+		memset(hdr, 0, MMC_PACKED_HDR_SZ);
+		hdr[0] = cpu_to_le32((mqrq->packed_num << 16) |
+				     (PACKED_CMD_WR << 8) | PACKED_CMD_VER);
+		list_for_each_entry(req, &mqrq->packed_list, queuelist) {
+			u32 addr = blk_rq_pos(req);
+
+			if (!mmc_card_blockaddr(card))
+				addr <<= 9;
+			hdr[i * 2] = cpu_to_le32(blk_rq_sectors(req));
+			hdr[i * 2 + 1] = cpu_to_le32(addr);
+			i++;
+		}
+
+		brq->data.blocks++;
+		brq->sbc.arg = brq->data.blocks | MMC_CMD23_ARG_PACKED;
+		do_sbc = true;
+	} else if ((md->flags & MMC_BLK_CMD23) &&
+		   !(card->quirks & MMC_QUIRK_BLK_NO_CMD23)) {
+		brq->sbc.arg = brq->data.blocks;
+		do_sbc = true;
+	}
+
+	if (do_sbc) {
+		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		brq->mrq.sbc = &brq->sbc;
+	}
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_packed_map_sg(mq, mqrq);
+}
+
+/*
+ * Complete all requests of a finished packed or coalesced write.
+ * Returns non-zero if the command failed; the requests are then
+ * still on mqrq->packed_list.
+ */
+static int mmc_blk_packed_finish(struct mmc_queue *mq,
+				 struct mmc_queue_req *mqrq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req;
+	int err, busy_err = 0;
+
+	err = brq->sbc.error ? : brq->cmd.error ? :
+		brq->data.error ? : brq->stop.error;
+
+	if (!mmc_host_is_spi(card->host))
+		busy_err = mmc_blk_wait_for_ready(card, mqrq->req);
+	if (!err)
+		err = busy_err;
+
+	if (err) {
+		printk(KERN_WARNING "%s: %s write of %u requests failed (%d),"
+		       " retrying them one by one\n",
+		       mqrq->req->rq_disk->disk_name,
+		       mqrq->packed_cmd == MMC_PACKED_WRITE ?
+		       "packed" : "coalesced", mqrq->packed_num, err);
+		md->packed_stats.failed++;
+		return err;
+	}
+
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&mqrq->packed_list)) {
+		req = list_first_entry(&mqrq->packed_list, struct request,
+				       queuelist);
+		list_del_init(&req->queuelist);
+		__blk_end_request(req, 0, blk_rq_bytes(req));
+	}
+	spin_unlock_irq(&md->lock);
+
+	mmc_blk_clear_packed(mqrq);
+
+	return 0;
+}
+
+/*
+ * A packed or coalesced write failed: issue its requests one at a time
+ * through the normal path, so the usual error handling applies to each.
+ * Rewriting the blocks that did make it to the card is harmless.
+ */
+static void mmc_blk_packed_reissue(struct mmc_queue *mq,
+				   struct mmc_queue_req *mqrq)
+{
+	struct mmc_card *card = mq->card;
+	struct request *req;
+	int disable_multi = 0;
+
+	mmc_blk_clear_packed(mqrq);
+
+	while (!list_empty(&mqrq->packed_list)) {
+		req = list_first_entry(&mqrq->packed_list, struct request,
+				       queuelist);
+		list_del_init(&req->queuelist);
+
+		mqrq->req = req;
+		do {
+			mmc_blk_rw_rq_prep(mqrq, card, disable_multi, mq);
+			mmc_wait_for_req(card->host, &mqrq->brq.mrq);
+		} while (mmc_blk_rw_finish(mq, mqrq, &disable_multi));
+	}
+}
+
+static void mmc_blk_packed_account(struct mmc_blk_data *md,
+				   struct mmc_queue_req *mqrq)
+{
+	struct mmc_blk_packed_stats *stats = &md->packed_stats;
+
+	switch (mqrq->packed_cmd) {
+	case MMC_PACKED_WRITE:
+		stats->packed++;
+		stats->depth[mqrq->packed_num]++;
+		break;
+	case MMC_PACKED_COALESCED:
+		stats->coalesced++;
+		stats->depth[mqrq->packed_num]++;
+		break;
+	default:
+		stats->depth[1]++;
+		break;
+	}
+}
+
+/*
+ * Read/write requests are double buffered: @req is mapped and handed
+ * to the host for preparation while the previous request is still on
+ * the bus, and is started as soon as that one has completed.  A NULL
+ * @req just drains the pipeline.  Retries and the remainder of split
+ * requests are issued synchronously, so requests always complete in
+ * order.  Writes queued behind @req may be gathered into the same
+ * command, see mmc_blk_prep_packed_list().
+ */
+static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_queue_req *cur = mq->mqrq_cur;
+	struct mmc_queue_req *prev = mq->mqrq_prev;
+	int disable_multi = 0;
+
+	if (!req && !prev->req)
+		return 0;
+
+	/* the host stays claimed for as long as the pipeline is busy */
+	if (!prev->req)
+		mmc_claim_host(card->host);
+
+	if (req) {
+		cur->req = req;
+		if (mmc_blk_prep_packed_list(mq, cur))
+			mmc_blk_packed_rq_prep(cur, card, mq);
+		else
+			mmc_blk_rw_rq_prep(cur, card, 0, mq);
+		if (rq_data_dir(req) == WRITE)
+			mmc_blk_packed_account(md, cur);
+		mmc_pre_req(card->host, &cur->brq.mrq, !prev->req);
+	}
+
+	if (prev->req) {
+		wait_for_completion_io(&prev->done);
+		mmc_post_req(card->host, &prev->brq.mrq, 0);
+
+		if (prev->packed_cmd != MMC_PACKED_NONE) {
+			if (mmc_blk_packed_finish(mq, prev))
+				mmc_blk_packed_reissue(mq, prev);
+		} else {
+			while (mmc_blk_rw_finish(mq, prev, &disable_multi)) {
+				mmc_blk_rw_rq_prep(prev, card, disable_multi,
+						   mq);
+				mmc_wait_for_req(card->host, &prev->brq.mrq);
+			}
+		}
+		prev->req = NULL;
+	}
+
+	if (!req) {
+		mmc_release_host(card->host);
+		return 1;
+	}
+
+	mmc_start_req_async(card->host, &cur->brq.mrq, &cur->done);
+	mq->mqrq_prev = cur;
+	mq->mqrq_cur = prev;
+
+	return 1;
+}
+
 static int
 mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card);
 
@@ -663,6 +1014,14 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	}
 #endif
 
+	if (!req)
+		return mmc_blk_issue_rw_rq(mq, NULL);
+
+	if (req->cmd_flags & (REQ_DISCARD | REQ_FLUSH)) {
+		/* complete any read/write still on the bus first */
+		mmc_blk_issue_rw_rq(mq, NULL);
+	}
+
 	if (req->cmd_flags & REQ_DISCARD) {
 		if (req->cmd_flags & REQ_SECURE)
 			return mmc_blk_issue_secdiscard_rq(mq, req);
@@ -675,6 +1034,99 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	}
 }
 
+static ssize_t mmc_blk_packing_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	ssize_t ret;
+
+	if (!md)
+		return -ENODEV;
+
+	ret = snprintf(buf, PAGE_SIZE, "%u\n", md->packing);
+	mmc_blk_put(md);
+
+	return ret;
+}
+
+static ssize_t mmc_blk_packing_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct mmc_blk_data *md;
+	unsigned long val;
+
+	if (strict_strtoul(buf, 0, &val))
+		return -EINVAL;
+
+	md = mmc_blk_get(dev_to_disk(dev));
+	if (!md)
+		return -ENODEV;
+
+	md->packing = !!val;
+	mmc_blk_put(md);
+
+	return count;
+}
+
+static DEVICE_ATTR(packing, S_IRUGO | S_IWUSR,
+		   mmc_blk_packing_show, mmc_blk_packing_store);
+
+static ssize_t mmc_blk_packing_stats_show(struct device *dev,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	struct mmc_blk_packed_stats *stats;
+	char *p = buf;
+	int i;
+
+	if (!md)
+		return -ENODEV;
+
+	stats = &md->packed_stats;
+	p += sprintf(p, "mode: %s\n", md->flags & MMC_BLK_PACKED_WR ?
+		     "packed" : "coalesced");
+	p += sprintf(p, "packed: %lu\ncoalesced: %lu\nfailed: %lu\n",
+		     stats->packed, stats->coalesced, stats->failed);
+	p += sprintf(p, "depth:\n");
+	for (i = 1; i <= MMC_PACKED_NR_MAX; i++) {
+		if (stats->depth[i])
+			p += sprintf(p, "%2d: %lu\n", i, stats->depth[i]);
+	}
+	mmc_blk_put(md);
+
+	return p - buf;
+}
+
+static ssize_t mmc_blk_packing_stats_store(struct device *dev,
+					   struct device_attribute *attr,
+					   const char *buf, size_t count)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+
+	if (!md)
+		return -ENODEV;
+
+	memset(&md->packed_stats, 0, sizeof(md->packed_stats));
+	mmc_blk_put(md);
+
+	return count;
+}
+
+static DEVICE_ATTR(packing_stats, S_IRUGO | S_IWUSR,
+		   mmc_blk_packing_stats_show, mmc_blk_packing_stats_store);
+
+static struct attribute *mmc_blk_attrs[] = {
+	&dev_attr_packing.attr,
+	&dev_attr_packing_stats.attr,
+	NULL,
+};
+
+static struct attribute_group mmc_blk_attr_group = {
+	.attrs = mmc_blk_attrs,
+};
+
 static inline int mmc_blk_readonly(struct mmc_card *card)
 {
 	return mmc_card_readonly(card) ||
@@ -775,6 +1227,13 @@ static struct mmc_blk_data *mmc_blk_alloc(struct mmc_card *card)
 		blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
 	}
 
+	/* packed writes need CMD23 to announce the packing */
+	if (mmc_card_mmc(card) && md->flags & MMC_BLK_CMD23 &&
+	    card->ext_csd.max_packed_writes &&
+	    md->queue.mqrq_cur->packed_cmd_hdr)
+		md->flags |= MMC_BLK_PACKED_WR;
+	md->packing = 1;
+
 	return md;
 
  err_putdisk:
@@ -834,6 +1293,11 @@ static int mmc_blk_probe(struct mmc_card *card)
 	mmc_set_bus_resume_policy(card->host, 1);
 #endif
 	add_disk(md->disk);
+
+	if (sysfs_create_group(&disk_to_dev(md->disk)->kobj,
+			       &mmc_blk_attr_group))
+		printk(KERN_WARNING "%s: failed to create sysfs attributes\n",
+		       md->disk->disk_name);
 	return 0;
 
  out:
@@ -848,6 +1312,9 @@ static void mmc_blk_remove(struct mmc_card *card)
 	struct mmc_blk_data *md = mmc_get_drvdata(card);
 
 	if (md) {
+		sysfs_remove_group(&disk_to_dev(md->disk)->kobj,
+				   &mmc_blk_attr_group);
+
 		/* Stop new requests from getting into the queue */
 		del_gendisk(md->disk);
 
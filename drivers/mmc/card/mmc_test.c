@@ -1766,6 +1766,163 @@ static int mmc_test_profile_seq_trim_perf(struct mmc_test_card *test)
 	return 0;
 }
 
+/*
+ * One of the two requests kept in flight by mmc_test_rw_multiple().
+ */
+struct mmc_test_async_req {
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+	struct scatterlist	*sg;
+	unsigned int		sg_len;
+	struct completion	done;
+};
+
+static int mmc_test_finish_async_req(struct mmc_test_card *test,
+				     struct mmc_test_async_req *areq)
+{
+	int ret;
+
+	wait_for_completion(&areq->done);
+	mmc_test_wait_busy(test);
+	ret = mmc_test_check_result(test, &areq->mrq);
+	mmc_post_req(test->card->host, &areq->mrq, ret);
+
+	return ret;
+}
+
+/*
+ * Transfer the whole test area in sz sized requests.  With nonblock set, the
+ * next request is prepared by the host (mmc_pre_req) while the previous one
+ * is still on the bus, which is what the block driver does.
+ */
+static int mmc_test_rw_multiple(struct mmc_test_card *test, unsigned long sz,
+				int write, int nonblock)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_async_req *areq, *cur, *prev = NULL;
+	unsigned int dev_addr, i, cnt;
+	struct timespec ts1, ts2;
+	int ret = 0;
+
+	areq = kzalloc(2 * sizeof(*areq), GFP_KERNEL);
+	if (!areq)
+		return -ENOMEM;
+
+	for (i = 0; i < 2; i++) {
+		areq[i].sg = kmalloc(sizeof(struct scatterlist) * t->max_segs,
+				     GFP_KERNEL);
+		if (!areq[i].sg) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+		ret = mmc_test_map_sg(t->mem, sz, areq[i].sg, 1, t->max_segs,
+				      t->max_seg_sz, &areq[i].sg_len);
+		if (ret)
+			goto out_free;
+		init_completion(&areq[i].done);
+	}
+
+	if (write) {
+		ret = mmc_test_area_erase(test);
+		if (ret)
+			goto out_free;
+	}
+
+	cnt = t->max_sz / sz;
+	dev_addr = t->dev_addr;
+	getnstimeofday(&ts1);
+	for (i = 0; i < cnt; i++) {
+		cur = &areq[i & 1];
+
+		memset(&cur->mrq, 0, sizeof(struct mmc_request));
+		memset(&cur->cmd, 0, sizeof(struct mmc_command));
+		memset(&cur->stop, 0, sizeof(struct mmc_command));
+		memset(&cur->data, 0, sizeof(struct mmc_data));
+		cur->mrq.cmd = &cur->cmd;
+		cur->mrq.data = &cur->data;
+		cur->mrq.stop = &cur->stop;
+		mmc_test_prepare_mrq(test, &cur->mrq, cur->sg, cur->sg_len,
+				     dev_addr, sz >> 9, 512, write);
+
+		if (!nonblock) {
+			mmc_wait_for_req(host, &cur->mrq);
+			mmc_test_wait_busy(test);
+			ret = mmc_test_check_result(test, &cur->mrq);
+			if (ret)
+				goto out_free;
+		} else {
+			mmc_pre_req(host, &cur->mrq, !prev);
+			if (prev) {
+				ret = mmc_test_finish_async_req(test, prev);
+				prev = NULL;
+				if (ret) {
+					mmc_post_req(host, &cur->mrq, ret);
+					goto out_free;
+				}
+			}
+			mmc_start_req_async(host, &cur->mrq, &cur->done);
+			prev = cur;
+		}
+		dev_addr += sz >> 9;
+	}
+	if (prev) {
+		ret = mmc_test_finish_async_req(test, prev);
+		prev = NULL;
+		if (ret)
+			goto out_free;
+	}
+	getnstimeofday(&ts2);
+
+	mmc_test_print_avg_rate(test, sz, cnt, &ts1, &ts2);
+
+out_free:
+	if (prev)
+		mmc_test_finish_async_req(test, prev);
+	for (i = 0; i < 2; i++)
+		kfree(areq[i].sg);
+	kfree(areq);
+	return ret;
+}
+
+static int mmc_test_profile_rw_multiple(struct mmc_test_card *test, int write)
+{
+	unsigned long sz;
+	int ret;
+
+	for (sz = 4096; sz <= test->area.max_tfr; sz <<= 1) {
+		printk(KERN_INFO "%s: blocking:\n",
+		       mmc_hostname(test->card->host));
+		ret = mmc_test_rw_multiple(test, sz, write, 0);
+		if (ret)
+			return ret;
+		printk(KERN_INFO "%s: non-blocking:\n",
+		       mmc_hostname(test->card->host));
+		ret = mmc_test_rw_multiple(test, sz, write, 1);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Consecutive write performance, blocking vs non-blocking requests.
+ */
+static int mmc_test_profile_seq_write_nonblock_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_rw_multiple(test, 1);
+}
+
+/*
+ * Consecutive read performance, blocking vs non-blocking requests.
+ */
+static int mmc_test_profile_seq_read_nonblock_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_rw_multiple(test, 0);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2005,6 +2162,20 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Consecutive write performance, blocking vs non-blocking",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_seq_write_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive read performance, blocking vs non-blocking",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_profile_seq_read_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
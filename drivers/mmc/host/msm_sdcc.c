@@ -290,6 +290,17 @@ msmsdcc_request_end(struct msmsdcc_host *host, struct mmc_request *mrq)
 	return retval;
 }
 
+/*
+ * A transfer bounded by a preceding CMD23 ends by itself, so CMD12 is
+ * only needed to get the card out of the data state after an error.
+ */
+static inline struct mmc_command *msmsdcc_stop_cmd(struct mmc_request *mrq)
+{
+	if (mrq->sbc && !mrq->data->error)
+		return NULL;
+	return mrq->data->stop;
+}
+
 static inline void msmsdcc_delay(struct msmsdcc_host *host);
 
 static void
@@ -378,8 +389,10 @@ msmsdcc_dma_complete_tlet(unsigned long data)
 		if (!mrq->data->error)
 			mrq->data->error = -EIO;
 	}
-	dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg, host->dma.num_ents,
-		     host->dma.dir);
+	/* buffers mapped by msmsdcc_pre_req are unmapped in post_req */
+	if (!mrq->data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg,
+			     host->dma.num_ents, host->dma.dir);
 
 	if (host->curr.user_pages) {
 		struct scatterlist *sg = host->dma.sg;
@@ -411,7 +424,7 @@ msmsdcc_dma_complete_tlet(unsigned long data)
 			host->curr.data_xfered = host->curr.xfer_size;
 			host->curr.xfer_remain -= host->curr.xfer_size;
 		}
-		if (!mrq->data->stop || mrq->cmd->error) {
+		if (!msmsdcc_stop_cmd(mrq) || mrq->cmd->error) {
 			host->curr.mrq = NULL;
 			host->curr.cmd = NULL;
 			mrq->data->bytes_xfered = host->curr.data_xfered;
@@ -555,7 +568,7 @@ static void msmsdcc_sps_complete_tlet(unsigned long data)
 			host->curr.data_xfered = host->curr.xfer_size;
 			host->curr.xfer_remain -= host->curr.xfer_size;
 		}
-		if (!mrq->data->stop || mrq->cmd->error) {
+		if (!msmsdcc_stop_cmd(mrq) || mrq->cmd->error) {
 			host->curr.mrq = NULL;
 			host->curr.cmd = NULL;
 			mrq->data->bytes_xfered = host->curr.data_xfered;
@@ -602,7 +615,7 @@ static void msmsdcc_sps_exit_curr_xfer(struct msmsdcc_host *host)
 	if (host->curr.data)
 		msmsdcc_stop_data(host);
 
-	if (!mrq->data->stop || mrq->cmd->error)
+	if (!msmsdcc_stop_cmd(mrq) || mrq->cmd->error)
 		msmsdcc_request_end(host, mrq);
 	else
 		msmsdcc_start_command(host, mrq->data->stop, 0);
@@ -718,6 +731,12 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 	host->dma.hdr.complete_func = msmsdcc_dma_complete_func;
 	host->dma.hdr.crci_mask = msm_dmov_build_crci_mask(1, host->dma.crci);
 
+	if (data->host_cookie) {
+		/* already mapped by msmsdcc_pre_req, just push nc out */
+		mb();
+		return 0;
+	}
+
 	n = dma_map_sg(mmc_dev(host->mmc), host->dma.sg,
 			host->dma.num_ents, host->dma.dir);
 	/* dsb inside dma_map_sg will write nc out to mem as well */
@@ -1247,6 +1266,17 @@ static void msmsdcc_do_cmdirq(struct msmsdcc_host *host, uint32_t status)
 		cmd->error = -EILSEQ;
 	}
 
+	/* CMD23 done, go on with the actual read/write */
+	if (cmd == cmd->mrq->sbc) {
+		if (cmd->error) {
+			host->curr.data_xfered = 0;
+			msmsdcc_request_end(host, cmd->mrq);
+		} else {
+			msmsdcc_request_start(host, cmd->mrq);
+		}
+		return;
+	}
+
 	if (!cmd->data || cmd->error) {
 		if (host->curr.data && host->dma.sg &&
 			host->is_dma_mode)
@@ -1445,7 +1475,8 @@ msmsdcc_irq(int irq, void *dev_id)
 
 					if (!host->dummy_52_needed) {
 						msmsdcc_stop_data(host);
-						if (!data->stop) {
+						if (!msmsdcc_stop_cmd(
+							data->mrq)) {
 							msmsdcc_request_end(
 								  host,
 								  data->mrq);
@@ -1484,6 +1515,58 @@ msmsdcc_request_start(struct msmsdcc_host *host, struct mmc_request *mrq)
 	}
 }
 
+/*
+ * Map the data of a request that will go through the data mover while
+ * the previous request is still in flight, so that the cache
+ * maintenance is off the critical path.
+ */
+static void
+msmsdcc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+		bool is_first_req)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	int n;
+
+	if (!data)
+		return;
+
+	data->host_cookie = 0;
+
+	/* only data mover transfers are sure not to fall back to PIO */
+	if (!host->is_dma_mode || (host->dma.channel == -1) ||
+	    (host->dma.crci == -1) || msmsdcc_check_dma_op_req(data))
+		return;
+
+	if (data->sg_len > NR_SG)
+		return;
+
+	n = dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		       (data->flags & MMC_DATA_READ) ?
+		       DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	if (n != data->sg_len) {
+		pr_err("%s: Unable to premap all sg elements\n",
+		       mmc_hostname(mmc));
+		return;
+	}
+
+	data->host_cookie = 1;
+}
+
+static void
+msmsdcc_post_req(struct mmc_host *mmc, struct mmc_request *mrq, int err)
+{
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		     (data->flags & MMC_DATA_READ) ?
+		     DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	data->host_cookie = 0;
+}
+
 static void
 msmsdcc_request(struct mmc_host *mmc, struct mmc_request *mrq)
 {
@@ -1526,7 +1609,10 @@ msmsdcc_request(struct mmc_host *mmc, struct mmc_request *mrq)
 			}
 		}
 	}
-	msmsdcc_request_start(host, mrq);
+	if (mrq->sbc)
+		msmsdcc_start_command(host, mrq->sbc, 0);
+	else
+		msmsdcc_request_start(host, mrq);
 	spin_unlock_irqrestore(&host->lock, flags);
 }
 
@@ -2612,6 +2698,8 @@ out:
 static const struct mmc_host_ops msmsdcc_ops = {
 	.enable		= msmsdcc_enable,
 	.disable	= msmsdcc_disable,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.request	= msmsdcc_request,
 	.set_ios	= msmsdcc_set_ios,
 	.get_ro		= msmsdcc_get_ro,
@@ -3506,6 +3594,8 @@ msmsdcc_probe(struct platform_device *pdev)
 
 	if (plat->nonremovable)
 		mmc->caps |= MMC_CAP_NONREMOVABLE;
+	if (plat->cmd23_sup)
+		mmc->caps |= MMC_CAP_CMD23;
 #ifdef CONFIG_MMC_MSM_SDIO_SUPPORT
 	mmc->caps |= MMC_CAP_SDIO_IRQ;
 #endif
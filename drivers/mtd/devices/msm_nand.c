@@ -43,10 +43,13 @@ uint32_t interleave_enable;
 uint32_t enable_bch_ecc;
 unsigned crci_mask;
 
-#define MSM_NAND_DMA_BUFFER_SIZE SZ_8K
+#define MSM_NAND_DMA_BUFFER_SIZE SZ_32K
 #define MSM_NAND_DMA_BUFFER_SLOTS \
 	(MSM_NAND_DMA_BUFFER_SIZE / (sizeof(((atomic_t *)0)->counter) * 8))
 
+/* Pages chained into one data mover request by read_oob/write_oob */
+#define MSM_NAND_PAGES_PER_DMA 4
+
 #define MSM_NAND_CFG0_RAW_ONFI_IDENTIFIER 0x88000800
 #define MSM_NAND_CFG0_RAW_ONFI_PARAM_INFO 0x88040000
 #define MSM_NAND_CFG1_RAW_ONFI_IDENTIFIER 0x0005045d
@@ -780,9 +783,8 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 {
 	struct msm_nand_chip *chip = mtd->priv;
 
-	struct {
+	struct msm_nand_read_page {
 		dmov_s cmd[8 * 5 + 2];
-		unsigned cmdptr;
 		struct {
 			uint32_t cmd;
 			uint32_t addr0;
@@ -798,7 +800,13 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 				uint32_t buffer_status;
 			} result[8];
 		} data;
+	} __aligned(8) *pb;
+	struct {
+		struct msm_nand_read_page page[MSM_NAND_PAGES_PER_DMA];
+		unsigned cmdptr[MSM_NAND_PAGES_PER_DMA];
 	} *dma_buffer;
+	uint32_t oob_done[MSM_NAND_PAGES_PER_DMA];
+	unsigned batch, b;
 	dmov_s *cmd;
 	unsigned n;
 	unsigned page = 0;
@@ -906,256 +914,276 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 	if (chip->CFG1 & CFG1_WIDE_FLASH)
 		oob_col >>= 1;
 
+	/* Up to MSM_NAND_PAGES_PER_DMA pages are queued as one chain of
+	 * command lists, so the data mover moves straight on to the next
+	 * page instead of waiting for us between pages.
+	 */
 	err = 0;
-	while (page_count-- > 0) {
-		cmd = dma_buffer->cmd;
-
-		/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
-		if (ops->mode != MTD_OOB_RAW) {
-			dma_buffer->data.cmd = MSM_NAND_CMD_PAGE_READ_ECC;
-			dma_buffer->data.cfg0 =
-			(chip->CFG0 & ~(7U << 6))
-				| (((cwperpage-1) - start_sector) << 6);
-			dma_buffer->data.cfg1 = chip->CFG1;
-			if (enable_bch_ecc)
-				dma_buffer->data.eccbchcfg = chip->ecc_bch_cfg;
-		} else {
-			dma_buffer->data.cmd = MSM_NAND_CMD_PAGE_READ;
-			dma_buffer->data.cfg0 = (chip->CFG0_RAW
-					& ~(7U << 6)) | ((cwperpage-1) << 6);
-			dma_buffer->data.cfg1 = chip->CFG1_RAW |
-					(chip->CFG1 & CFG1_WIDE_FLASH);
-		}
-
-		dma_buffer->data.addr0 = (page << 16) | oob_col;
-		dma_buffer->data.addr1 = (page >> 16) & 0xff;
-		/* chipsel_0 + enable DM interface */
-		dma_buffer->data.chipsel = 0 | 4;
+	while (page_count > 0) {
+		batch = min_t(unsigned, page_count, MSM_NAND_PAGES_PER_DMA);
+
+		for (b = 0; b < batch; b++) {
+			pb = &dma_buffer->page[b];
+			cmd = pb->cmd;
+
+			/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
+			if (ops->mode != MTD_OOB_RAW) {
+				pb->data.cmd = MSM_NAND_CMD_PAGE_READ_ECC;
+				pb->data.cfg0 =
+				(chip->CFG0 & ~(7U << 6))
+					| (((cwperpage-1) - start_sector) << 6);
+				pb->data.cfg1 = chip->CFG1;
+				if (enable_bch_ecc)
+					pb->data.eccbchcfg = chip->ecc_bch_cfg;
+			} else {
+				pb->data.cmd = MSM_NAND_CMD_PAGE_READ;
+				pb->data.cfg0 = (chip->CFG0_RAW
+						& ~(7U << 6)) | ((cwperpage-1) << 6);
+				pb->data.cfg1 = chip->CFG1_RAW |
+						(chip->CFG1 & CFG1_WIDE_FLASH);
+			}
 
+			pb->data.addr0 = ((page + b) << 16) | oob_col;
+			pb->data.addr1 = ((page + b) >> 16) & 0xff;
+			/* chipsel_0 + enable DM interface */
+			pb->data.chipsel = 0 | 4;
 
-		/* GO bit for the EXEC register */
-		dma_buffer->data.exec = 1;
 
+			/* GO bit for the EXEC register */
+			pb->data.exec = 1;
 
-		BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.result));
 
-		for (n = start_sector; n < cwperpage; n++) {
-			/* flash + buffer status return words */
-			dma_buffer->data.result[n].flash_status = 0xeeeeeeee;
-			dma_buffer->data.result[n].buffer_status = 0xeeeeeeee;
+			BUILD_BUG_ON(8 != ARRAY_SIZE(pb->data.result));
 
-			/* block on cmd ready, then
-			 * write CMD / ADDR0 / ADDR1 / CHIPSEL
-			 * regs in a burst
-			 */
-			cmd->cmd = DST_CRCI_NAND_CMD;
-			cmd->src = msm_virt_to_dma(chip, &dma_buffer->data.cmd);
-			cmd->dst = MSM_NAND_FLASH_CMD;
-			if (n == start_sector)
-				cmd->len = 16;
-			else
-				cmd->len = 4;
-			cmd++;
+			for (n = start_sector; n < cwperpage; n++) {
+				/* flash + buffer status return words */
+				pb->data.result[n].flash_status = 0xeeeeeeee;
+				pb->data.result[n].buffer_status = 0xeeeeeeee;
 
-			if (n == start_sector) {
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,
-							&dma_buffer->data.cfg0);
-				cmd->dst = MSM_NAND_DEV0_CFG0;
-				if (enable_bch_ecc)
-					cmd->len = 12;
+				/* block on cmd ready, then
+				 * write CMD / ADDR0 / ADDR1 / CHIPSEL
+				 * regs in a burst
+				 */
+				cmd->cmd = DST_CRCI_NAND_CMD;
+				cmd->src = msm_virt_to_dma(chip, &pb->data.cmd);
+				cmd->dst = MSM_NAND_FLASH_CMD;
+				if (n == start_sector)
+					cmd->len = 16;
 				else
-					cmd->len = 8;
+					cmd->len = 4;
 				cmd++;
 
-				dma_buffer->data.ecccfg = chip->ecc_buf_cfg;
+				if (n == start_sector) {
+					cmd->cmd = 0;
+					cmd->src = msm_virt_to_dma(chip,
+								&pb->data.cfg0);
+					cmd->dst = MSM_NAND_DEV0_CFG0;
+					if (enable_bch_ecc)
+						cmd->len = 12;
+					else
+						cmd->len = 8;
+					cmd++;
+
+					pb->data.ecccfg = chip->ecc_buf_cfg;
+					cmd->cmd = 0;
+					cmd->src = msm_virt_to_dma(chip,
+							&pb->data.ecccfg);
+					cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
+					cmd->len = 4;
+					cmd++;
+				}
+
+				/* kick the execute register */
 				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,
-						&dma_buffer->data.ecccfg);
-				cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
+				cmd->src =
+					msm_virt_to_dma(chip, &pb->data.exec);
+				cmd->dst = MSM_NAND_EXEC_CMD;
 				cmd->len = 4;
 				cmd++;
-			}
 
-			/* kick the execute register */
-			cmd->cmd = 0;
-			cmd->src =
-				msm_virt_to_dma(chip, &dma_buffer->data.exec);
-			cmd->dst = MSM_NAND_EXEC_CMD;
-			cmd->len = 4;
-			cmd++;
+				/* block on data ready, then
+				 * read the status register
+				 */
+				cmd->cmd = SRC_CRCI_NAND_DATA;
+				cmd->src = MSM_NAND_FLASH_STATUS;
+				cmd->dst = msm_virt_to_dma(chip,
+							   &pb->data.result[n]);
+				/* MSM_NAND_FLASH_STATUS + MSM_NAND_BUFFER_STATUS */
+				cmd->len = 8;
+				cmd++;
 
-			/* block on data ready, then
-			 * read the status register
-			 */
-			cmd->cmd = SRC_CRCI_NAND_DATA;
-			cmd->src = MSM_NAND_FLASH_STATUS;
-			cmd->dst = msm_virt_to_dma(chip,
-						   &dma_buffer->data.result[n]);
-			/* MSM_NAND_FLASH_STATUS + MSM_NAND_BUFFER_STATUS */
-			cmd->len = 8;
-			cmd++;
+				/* read data block
+				 * (only valid if status says success)
+				 */
+				if (ops->datbuf) {
+					if (ops->mode != MTD_OOB_RAW)
+						sectordatasize = (n < (cwperpage - 1))
+						? 516 : (512 - ((cwperpage - 1) << 2));
+					else
+						sectordatasize = chip->cw_size;
 
-			/* read data block
-			 * (only valid if status says success)
-			 */
-			if (ops->datbuf) {
-				if (ops->mode != MTD_OOB_RAW)
-					sectordatasize = (n < (cwperpage - 1))
-					? 516 : (512 - ((cwperpage - 1) << 2));
-				else
-					sectordatasize = chip->cw_size;
+					cmd->cmd = 0;
+					cmd->src = MSM_NAND_FLASH_BUFFER;
+					cmd->dst = data_dma_addr_curr;
+					data_dma_addr_curr += sectordatasize;
+					cmd->len = sectordatasize;
+					cmd++;
+				}
 
-				cmd->cmd = 0;
-				cmd->src = MSM_NAND_FLASH_BUFFER;
-				cmd->dst = data_dma_addr_curr;
-				data_dma_addr_curr += sectordatasize;
-				cmd->len = sectordatasize;
-				cmd++;
-			}
+				if (ops->oobbuf && (n == (cwperpage - 1)
+				     || ops->mode != MTD_OOB_AUTO)) {
+					cmd->cmd = 0;
+					if (n == (cwperpage - 1)) {
+						cmd->src = MSM_NAND_FLASH_BUFFER +
+							(512 - ((cwperpage - 1) << 2));
+						sectoroobsize = (cwperpage << 2);
+						if (ops->mode != MTD_OOB_AUTO)
+							sectoroobsize +=
+								chip->ecc_parity_bytes;
+					} else {
+						cmd->src = MSM_NAND_FLASH_BUFFER + 516;
+						sectoroobsize = chip->ecc_parity_bytes;
+					}
 
-			if (ops->oobbuf && (n == (cwperpage - 1)
-			     || ops->mode != MTD_OOB_AUTO)) {
-				cmd->cmd = 0;
-				if (n == (cwperpage - 1)) {
-					cmd->src = MSM_NAND_FLASH_BUFFER +
-						(512 - ((cwperpage - 1) << 2));
-					sectoroobsize = (cwperpage << 2);
-					if (ops->mode != MTD_OOB_AUTO)
-						sectoroobsize +=
-							chip->ecc_parity_bytes;
-				} else {
-					cmd->src = MSM_NAND_FLASH_BUFFER + 516;
-					sectoroobsize = chip->ecc_parity_bytes;
+					cmd->dst = oob_dma_addr_curr;
+					if (sectoroobsize < oob_len)
+						cmd->len = sectoroobsize;
+					else
+						cmd->len = oob_len;
+					oob_dma_addr_curr += cmd->len;
+					oob_len -= cmd->len;
+					if (cmd->len > 0)
+						cmd++;
 				}
-
-				cmd->dst = oob_dma_addr_curr;
-				if (sectoroobsize < oob_len)
-					cmd->len = sectoroobsize;
-				else
-					cmd->len = oob_len;
-				oob_dma_addr_curr += cmd->len;
-				oob_len -= cmd->len;
-				if (cmd->len > 0)
-					cmd++;
 			}
-		}
 
-		BUILD_BUG_ON(8 * 5 + 2 != ARRAY_SIZE(dma_buffer->cmd));
-		BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
-		dma_buffer->cmd[0].cmd |= CMD_OCB;
-		cmd[-1].cmd |= CMD_OCU | CMD_LC;
+			BUILD_BUG_ON(8 * 5 + 2 != ARRAY_SIZE(pb->cmd));
+			BUG_ON(cmd - pb->cmd > ARRAY_SIZE(pb->cmd));
+			pb->cmd[0].cmd |= CMD_OCB;
+			cmd[-1].cmd |= CMD_OCU | CMD_LC;
 
-		dma_buffer->cmdptr =
-			(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3)
-			| CMD_PTR_LP;
+			dma_buffer->cmdptr[b] =
+				msm_virt_to_dma(chip, pb->cmd) >> 3;
+			oob_done[b] = ops->ooblen - oob_len;
+		}
+		dma_buffer->cmdptr[batch - 1] |= CMD_PTR_LP;
 
 		mb();
 		msm_dmov_exec_cmd(chip->dma_channel, crci_mask,
 			DMOV_CMD_PTR_LIST | DMOV_CMD_ADDR(msm_virt_to_dma(chip,
-			&dma_buffer->cmdptr)));
+			dma_buffer->cmdptr)));
 		mb();
 
-		/* if any of the writes failed (0x10), or there
-		 * was a protection violation (0x100), we lose
-		 */
-		pageerr = rawerr = 0;
-		for (n = start_sector; n < cwperpage; n++) {
-			if (dma_buffer->data.result[n].flash_status & 0x110) {
-				rawerr = -EIO;
-				break;
+		for (b = 0; b < batch; b++) {
+			pb = &dma_buffer->page[b];
+
+			/* if any of the writes failed (0x10), or there
+			 * was a protection violation (0x100), we lose
+			 */
+			pageerr = rawerr = 0;
+			for (n = start_sector; n < cwperpage; n++) {
+				if (pb->data.result[n].flash_status & 0x110) {
+					rawerr = -EIO;
+					break;
+				}
 			}
-		}
-		if (rawerr) {
-			if (ops->datbuf && ops->mode != MTD_OOB_RAW) {
-				uint8_t *datbuf = ops->datbuf +
-					pages_read * mtd->writesize;
+			if (rawerr) {
+				if (ops->datbuf && ops->mode != MTD_OOB_RAW) {
+					uint8_t *datbuf = ops->datbuf +
+						pages_read * mtd->writesize;
+
+					dma_sync_single_for_cpu(chip->dev,
+						data_dma_addr +
+						pages_read * mtd->writesize,
+						mtd->writesize, DMA_BIDIRECTIONAL);
+
+					for (n = 0; n < mtd->writesize; n++) {
+						/* empty blocks read 0x54 at
+						 * these offsets
+						 */
+						if ((n % 516 == 3 || n % 516 == 175)
+								&& datbuf[n] == 0x54)
+							datbuf[n] = 0xff;
+						if (datbuf[n] != 0xff) {
+							pageerr = rawerr;
+							break;
+						}
+					}
 
-				dma_sync_single_for_cpu(chip->dev,
-					data_dma_addr_curr-mtd->writesize,
-					mtd->writesize, DMA_BIDIRECTIONAL);
+					dma_sync_single_for_device(chip->dev,
+						data_dma_addr +
+						pages_read * mtd->writesize,
+						mtd->writesize, DMA_BIDIRECTIONAL);
 
-				for (n = 0; n < mtd->writesize; n++) {
-					/* empty blocks read 0x54 at
-					 * these offsets
-					 */
-					if ((n % 516 == 3 || n % 516 == 175)
-							&& datbuf[n] == 0x54)
-						datbuf[n] = 0xff;
-					if (datbuf[n] != 0xff) {
-						pageerr = rawerr;
-						break;
-					}
 				}
+				if (ops->oobbuf) {
+					dma_sync_single_for_cpu(chip->dev,
+					oob_dma_addr, oob_done[b], DMA_BIDIRECTIONAL);
+
+					/* up to and including this page */
+					for (n = 0; n < oob_done[b]; n++) {
+						if (ops->oobbuf[n] != 0xff) {
+							pageerr = rawerr;
+							break;
+						}
+					}
 
-				dma_sync_single_for_device(chip->dev,
-					data_dma_addr_curr-mtd->writesize,
-					mtd->writesize, DMA_BIDIRECTIONAL);
-
+					dma_sync_single_for_device(chip->dev,
+					oob_dma_addr, oob_done[b], DMA_BIDIRECTIONAL);
+				}
 			}
-			if (ops->oobbuf) {
-				dma_sync_single_for_cpu(chip->dev,
-				oob_dma_addr_curr - (ops->ooblen - oob_len),
-				ops->ooblen - oob_len, DMA_BIDIRECTIONAL);
-
-				for (n = 0; n < ops->ooblen; n++) {
-					if (ops->oobbuf[n] != 0xff) {
-						pageerr = rawerr;
+			if (pageerr) {
+				for (n = start_sector; n < cwperpage; n++) {
+					if (enable_bch_ecc ?
+				(pb->data.result[n].buffer_status & 0x10) :
+				(pb->data.result[n].buffer_status & 0x8)) {
+						/* not thread safe */
+						mtd->ecc_stats.failed++;
+						pageerr = -EBADMSG;
 						break;
 					}
 				}
-
-				dma_sync_single_for_device(chip->dev,
-				oob_dma_addr_curr - (ops->ooblen - oob_len),
-				ops->ooblen - oob_len, DMA_BIDIRECTIONAL);
-			}
-		}
-		if (pageerr) {
-			for (n = start_sector; n < cwperpage; n++) {
-				if (enable_bch_ecc ?
-			(dma_buffer->data.result[n].buffer_status & 0x10) :
-			(dma_buffer->data.result[n].buffer_status & 0x8)) {
-					/* not thread safe */
-					mtd->ecc_stats.failed++;
-					pageerr = -EBADMSG;
-					break;
-				}
 			}
-		}
-		if (!rawerr) { /* check for corretable errors */
-			for (n = start_sector; n < cwperpage; n++) {
-				ecc_errors = enable_bch_ecc ?
-			(dma_buffer->data.result[n].buffer_status & 0xF) :
-			(dma_buffer->data.result[n].buffer_status & 0x7);
-				if (ecc_errors) {
-					total_ecc_errors += ecc_errors;
-					/* not thread safe */
-					mtd->ecc_stats.corrected += ecc_errors;
-					if (ecc_errors > 1)
-						pageerr = -EUCLEAN;
+			if (!rawerr) { /* check for corretable errors */
+				for (n = start_sector; n < cwperpage; n++) {
+					ecc_errors = enable_bch_ecc ?
+				(pb->data.result[n].buffer_status & 0xF) :
+				(pb->data.result[n].buffer_status & 0x7);
+					if (ecc_errors) {
+						total_ecc_errors += ecc_errors;
+						/* not thread safe */
+						mtd->ecc_stats.corrected += ecc_errors;
+						if (ecc_errors > 1)
+							pageerr = -EUCLEAN;
+					}
 				}
 			}
-		}
-		if (pageerr && (pageerr != -EUCLEAN || err == 0))
-			err = pageerr;
+			if (pageerr && (pageerr != -EUCLEAN || err == 0))
+				err = pageerr;
 
 #if VERBOSE
-		if (rawerr && !pageerr) {
-			pr_err("msm_nand_read_oob %llx %x %x empty page\n",
-			       (loff_t)page * mtd->writesize, ops->len,
-			       ops->ooblen);
-		} else {
-			for (n = start_sector; n < cwperpage; n++)
-				pr_info("flash_status[%d] = %x,\
-				buffr_status[%d] = %x\n",
-				n, dma_buffer->data.result[n].flash_status,
-				n, dma_buffer->data.result[n].buffer_status);
-		}
+			if (rawerr && !pageerr) {
+				pr_err("msm_nand_read_oob %llx %x %x empty page\n",
+				       (loff_t)page * mtd->writesize, ops->len,
+				       ops->ooblen);
+			} else {
+				for (n = start_sector; n < cwperpage; n++)
+					pr_info("flash_status[%d] = %x,\
+					buffr_status[%d] = %x\n",
+					n, pb->data.result[n].flash_status,
+					n, pb->data.result[n].buffer_status);
+			}
 #endif
-		if (err && err != -EUCLEAN && err != -EBADMSG)
-			break;
-		pages_read++;
-		page++;
+			if (err && err != -EUCLEAN && err != -EBADMSG) {
+				/* pages after this one don't count */
+				oob_len = ops->ooblen - oob_done[b];
+				page_count = 0;
+				break;
+			}
+			pages_read++;
+			page++;
+			page_count--;
+		}
 	}
 	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer));
 
@@ -2011,9 +2039,8 @@ static int
 msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 {
 	struct msm_nand_chip *chip = mtd->priv;
-	struct {
+	struct msm_nand_write_page {
 		dmov_s cmd[8 * 7 + 2];
-		unsigned cmdptr;
 		struct {
 			uint32_t cmd;
 			uint32_t addr0;
@@ -2028,7 +2055,13 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 			uint32_t clrrstatus;
 			uint32_t flash_status[8];
 		} data;
+	} __aligned(8) *pb;
+	struct {
+		struct msm_nand_write_page page[MSM_NAND_PAGES_PER_DMA];
+		unsigned cmdptr[MSM_NAND_PAGES_PER_DMA];
 	} *dma_buffer;
+	uint32_t oob_done[MSM_NAND_PAGES_PER_DMA];
+	unsigned batch, b;
 	dmov_s *cmd;
 	unsigned n;
 	unsigned page = 0;
@@ -2124,189 +2157,209 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 	wait_event(chip->wait_queue, (dma_buffer =
 			msm_nand_get_dma_buffer(chip, sizeof(*dma_buffer))));
 
-	while (page_count-- > 0) {
-		cmd = dma_buffer->cmd;
+	/* Chain up to MSM_NAND_PAGES_PER_DMA pages per data mover request,
+	 * as in msm_nand_read_oob().  A page that fails to program does not
+	 * stop the ones already queued behind it; only the pages before it
+	 * are reported as written.
+	 */
+	err = 0;
+	while (page_count > 0) {
+		batch = min_t(unsigned, page_count, MSM_NAND_PAGES_PER_DMA);
 
-		if (ops->mode != MTD_OOB_RAW) {
-			dma_buffer->data.cfg0 = chip->CFG0;
-			dma_buffer->data.cfg1 = chip->CFG1;
-			if (enable_bch_ecc)
-				dma_buffer->data.eccbchcfg = chip->ecc_bch_cfg;
-		} else {
-			dma_buffer->data.cfg0 = (chip->CFG0_RAW &
-					~(7U << 6)) | ((cwperpage-1) << 6);
-			dma_buffer->data.cfg1 = chip->CFG1_RAW |
-						(chip->CFG1 & CFG1_WIDE_FLASH);
-		}
+		for (b = 0; b < batch; b++) {
+			pb = &dma_buffer->page[b];
+			cmd = pb->cmd;
 
-		/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
-		dma_buffer->data.cmd = MSM_NAND_CMD_PRG_PAGE;
-		dma_buffer->data.addr0 = page << 16;
-		dma_buffer->data.addr1 = (page >> 16) & 0xff;
-		/* chipsel_0 + enable DM interface */
-		dma_buffer->data.chipsel = 0 | 4;
+			if (ops->mode != MTD_OOB_RAW) {
+				pb->data.cfg0 = chip->CFG0;
+				pb->data.cfg1 = chip->CFG1;
+				if (enable_bch_ecc)
+					pb->data.eccbchcfg = chip->ecc_bch_cfg;
+			} else {
+				pb->data.cfg0 = (chip->CFG0_RAW &
+						~(7U << 6)) | ((cwperpage-1) << 6);
+				pb->data.cfg1 = chip->CFG1_RAW |
+							(chip->CFG1 & CFG1_WIDE_FLASH);
+			}
 
+			/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
+			pb->data.cmd = MSM_NAND_CMD_PRG_PAGE;
+			pb->data.addr0 = (page + b) << 16;
+			pb->data.addr1 = ((page + b) >> 16) & 0xff;
+			/* chipsel_0 + enable DM interface */
+			pb->data.chipsel = 0 | 4;
 
-		/* GO bit for the EXEC register */
-		dma_buffer->data.exec = 1;
-		dma_buffer->data.clrfstatus = 0x00000020;
-		dma_buffer->data.clrrstatus = 0x000000C0;
 
-		BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.flash_status));
+			/* GO bit for the EXEC register */
+			pb->data.exec = 1;
+			pb->data.clrfstatus = 0x00000020;
+			pb->data.clrrstatus = 0x000000C0;
 
-		for (n = 0; n < cwperpage ; n++) {
-			/* status return words */
-			dma_buffer->data.flash_status[n] = 0xeeeeeeee;
-			/* block on cmd ready, then
-			 * write CMD / ADDR0 / ADDR1 / CHIPSEL regs in a burst
-			 */
-			cmd->cmd = DST_CRCI_NAND_CMD;
-			cmd->src =
-				msm_virt_to_dma(chip, &dma_buffer->data.cmd);
-			cmd->dst = MSM_NAND_FLASH_CMD;
-			if (n == 0)
-				cmd->len = 16;
-			else
-				cmd->len = 4;
-			cmd++;
+			BUILD_BUG_ON(8 != ARRAY_SIZE(pb->data.flash_status));
 
-			if (n == 0) {
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,
-							&dma_buffer->data.cfg0);
-				cmd->dst = MSM_NAND_DEV0_CFG0;
-				if (enable_bch_ecc)
-					cmd->len = 12;
+			for (n = 0; n < cwperpage ; n++) {
+				/* status return words */
+				pb->data.flash_status[n] = 0xeeeeeeee;
+				/* block on cmd ready, then
+				 * write CMD / ADDR0 / ADDR1 / CHIPSEL regs in a burst
+				 */
+				cmd->cmd = DST_CRCI_NAND_CMD;
+				cmd->src =
+					msm_virt_to_dma(chip, &pb->data.cmd);
+				cmd->dst = MSM_NAND_FLASH_CMD;
+				if (n == 0)
+					cmd->len = 16;
 				else
-					cmd->len = 8;
-				cmd++;
-
-				dma_buffer->data.ecccfg = chip->ecc_buf_cfg;
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,
-						 &dma_buffer->data.ecccfg);
-				cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
-				cmd->len = 4;
+					cmd->len = 4;
 				cmd++;
-			}
 
-			/* write data block */
-			if (ops->mode != MTD_OOB_RAW)
-				sectordatawritesize = (n < (cwperpage - 1)) ?
-					516 : (512 - ((cwperpage - 1) << 2));
-			else
-				sectordatawritesize = chip->cw_size;
-
-			cmd->cmd = 0;
-			cmd->src = data_dma_addr_curr;
-			data_dma_addr_curr += sectordatawritesize;
-			cmd->dst = MSM_NAND_FLASH_BUFFER;
-			cmd->len = sectordatawritesize;
-			cmd++;
-
-			if (ops->oobbuf) {
-				if (n == (cwperpage - 1)) {
+				if (n == 0) {
 					cmd->cmd = 0;
-					cmd->src = oob_dma_addr_curr;
-					cmd->dst = MSM_NAND_FLASH_BUFFER +
-						(512 - ((cwperpage - 1) << 2));
-					if ((cwperpage << 2) < oob_len)
-						cmd->len = (cwperpage << 2);
+					cmd->src = msm_virt_to_dma(chip,
+								&pb->data.cfg0);
+					cmd->dst = MSM_NAND_DEV0_CFG0;
+					if (enable_bch_ecc)
+						cmd->len = 12;
 					else
-						cmd->len = oob_len;
-					oob_dma_addr_curr += cmd->len;
-					oob_len -= cmd->len;
-					if (cmd->len > 0)
-						cmd++;
+						cmd->len = 8;
+					cmd++;
+
+					pb->data.ecccfg = chip->ecc_buf_cfg;
+					cmd->cmd = 0;
+					cmd->src = msm_virt_to_dma(chip,
+							 &pb->data.ecccfg);
+					cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
+					cmd->len = 4;
+					cmd++;
 				}
-				if (ops->mode != MTD_OOB_AUTO) {
-					/* skip ecc bytes in oobbuf */
-					if (oob_len < chip->ecc_parity_bytes) {
-						oob_dma_addr_curr +=
-							chip->ecc_parity_bytes;
-						oob_len -=
-							chip->ecc_parity_bytes;
-					} else {
-						oob_dma_addr_curr += oob_len;
-						oob_len = 0;
+
+				/* write data block */
+				if (ops->mode != MTD_OOB_RAW)
+					sectordatawritesize = (n < (cwperpage - 1)) ?
+						516 : (512 - ((cwperpage - 1) << 2));
+				else
+					sectordatawritesize = chip->cw_size;
+
+				cmd->cmd = 0;
+				cmd->src = data_dma_addr_curr;
+				data_dma_addr_curr += sectordatawritesize;
+				cmd->dst = MSM_NAND_FLASH_BUFFER;
+				cmd->len = sectordatawritesize;
+				cmd++;
+
+				if (ops->oobbuf) {
+					if (n == (cwperpage - 1)) {
+						cmd->cmd = 0;
+						cmd->src = oob_dma_addr_curr;
+						cmd->dst = MSM_NAND_FLASH_BUFFER +
+							(512 - ((cwperpage - 1) << 2));
+						if ((cwperpage << 2) < oob_len)
+							cmd->len = (cwperpage << 2);
+						else
+							cmd->len = oob_len;
+						oob_dma_addr_curr += cmd->len;
+						oob_len -= cmd->len;
+						if (cmd->len > 0)
+							cmd++;
+					}
+					if (ops->mode != MTD_OOB_AUTO) {
+						/* skip ecc bytes in oobbuf */
+						if (oob_len < chip->ecc_parity_bytes) {
+							oob_dma_addr_curr +=
+								chip->ecc_parity_bytes;
+							oob_len -=
+								chip->ecc_parity_bytes;
+						} else {
+							oob_dma_addr_curr += oob_len;
+							oob_len = 0;
+						}
 					}
 				}
-			}
 
-			/* kick the execute register */
-			cmd->cmd = 0;
-			cmd->src =
-				msm_virt_to_dma(chip, &dma_buffer->data.exec);
-			cmd->dst = MSM_NAND_EXEC_CMD;
-			cmd->len = 4;
-			cmd++;
+				/* kick the execute register */
+				cmd->cmd = 0;
+				cmd->src =
+					msm_virt_to_dma(chip, &pb->data.exec);
+				cmd->dst = MSM_NAND_EXEC_CMD;
+				cmd->len = 4;
+				cmd++;
 
-			/* block on data ready, then
-			 * read the status register
-			 */
-			cmd->cmd = SRC_CRCI_NAND_DATA;
-			cmd->src = MSM_NAND_FLASH_STATUS;
-			cmd->dst = msm_virt_to_dma(chip,
-					     &dma_buffer->data.flash_status[n]);
-			cmd->len = 4;
-			cmd++;
+				/* block on data ready, then
+				 * read the status register
+				 */
+				cmd->cmd = SRC_CRCI_NAND_DATA;
+				cmd->src = MSM_NAND_FLASH_STATUS;
+				cmd->dst = msm_virt_to_dma(chip,
+						     &pb->data.flash_status[n]);
+				cmd->len = 4;
+				cmd++;
 
-			cmd->cmd = 0;
-			cmd->src = msm_virt_to_dma(chip,
-						&dma_buffer->data.clrfstatus);
-			cmd->dst = MSM_NAND_FLASH_STATUS;
-			cmd->len = 4;
-			cmd++;
+				cmd->cmd = 0;
+				cmd->src = msm_virt_to_dma(chip,
+							&pb->data.clrfstatus);
+				cmd->dst = MSM_NAND_FLASH_STATUS;
+				cmd->len = 4;
+				cmd++;
 
-			cmd->cmd = 0;
-			cmd->src = msm_virt_to_dma(chip,
-						&dma_buffer->data.clrrstatus);
-			cmd->dst = MSM_NAND_READ_STATUS;
-			cmd->len = 4;
-			cmd++;
+				cmd->cmd = 0;
+				cmd->src = msm_virt_to_dma(chip,
+							&pb->data.clrrstatus);
+				cmd->dst = MSM_NAND_READ_STATUS;
+				cmd->len = 4;
+				cmd++;
 
-		}
+			}
 
-		dma_buffer->cmd[0].cmd |= CMD_OCB;
-		cmd[-1].cmd |= CMD_OCU | CMD_LC;
-		BUILD_BUG_ON(8 * 7 + 2 != ARRAY_SIZE(dma_buffer->cmd));
-		BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
-		dma_buffer->cmdptr =
-			(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3) |
-			CMD_PTR_LP;
+			pb->cmd[0].cmd |= CMD_OCB;
+			cmd[-1].cmd |= CMD_OCU | CMD_LC;
+			BUILD_BUG_ON(8 * 7 + 2 != ARRAY_SIZE(pb->cmd));
+			BUG_ON(cmd - pb->cmd > ARRAY_SIZE(pb->cmd));
+			dma_buffer->cmdptr[b] =
+				msm_virt_to_dma(chip, pb->cmd) >> 3;
+			oob_done[b] = ops->ooblen - oob_len;
+		}
+		dma_buffer->cmdptr[batch - 1] |= CMD_PTR_LP;
 
 		mb();
 		msm_dmov_exec_cmd(chip->dma_channel, crci_mask,
 			DMOV_CMD_PTR_LIST | DMOV_CMD_ADDR(
-				msm_virt_to_dma(chip, &dma_buffer->cmdptr)));
+				msm_virt_to_dma(chip, dma_buffer->cmdptr)));
 		mb();
 
-		/* if any of the writes failed (0x10), or there was a
-		 * protection violation (0x100), or the program success
-		 * bit (0x80) is unset, we lose
-		 */
-		err = 0;
-		for (n = 0; n < cwperpage; n++) {
-			if (dma_buffer->data.flash_status[n] & 0x110) {
-				err = -EIO;
-				break;
-			}
-			if (!(dma_buffer->data.flash_status[n] & 0x80)) {
-				err = -EIO;
-				break;
+		for (b = 0; b < batch; b++) {
+			pb = &dma_buffer->page[b];
+
+			/* if any of the writes failed (0x10), or there was a
+			 * protection violation (0x100), or the program success
+			 * bit (0x80) is unset, we lose
+			 */
+			err = 0;
+			for (n = 0; n < cwperpage; n++) {
+				if (pb->data.flash_status[n] & 0x110) {
+					err = -EIO;
+					break;
+				}
+				if (!(pb->data.flash_status[n] & 0x80)) {
+					err = -EIO;
+					break;
+				}
 			}
-		}
 
 #if VERBOSE
-		for (n = 0; n < cwperpage; n++)
-			pr_info("write pg %d: flash_status[%d] = %x\n", page,
-				n, dma_buffer->data.flash_status[n]);
+			for (n = 0; n < cwperpage; n++)
+				pr_info("write pg %d: flash_status[%d] = %x\n", page,
+					n, pb->data.flash_status[n]);
 
 #endif
-		if (err)
-			break;
-		pages_written++;
-		page++;
+			if (err) {
+				oob_len = ops->ooblen - oob_done[b];
+				page_count = 0;
+				break;
+			}
+			pages_written++;
+			page++;
+			page_count--;
+		}
 	}
 	if (ops->mode != MTD_OOB_RAW)
 		ops->retlen = mtd->writesize * pages_written;
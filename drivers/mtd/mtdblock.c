@@ -28,20 +28,50 @@
 #include <linux/slab.h>
 #include <linux/types.h>
 #include <linux/vmalloc.h>
+#include <linux/genhd.h>
+#include <linux/list.h>
+#include <linux/workqueue.h>
+#include <linux/err.h>
 
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/blktrans.h>
 #include <linux/mutex.h>
 
+#define MTDBLK_MAX_CACHE_WAYS	8
+
+static int cache_ways = 4;
+module_param(cache_ways, int, 0444);
+MODULE_PARM_DESC(cache_ways, "Erase blocks cached per device (1-8)");
+
+static unsigned int flush_delay_ms = 5000;
+module_param(flush_delay_ms, uint, 0644);
+MODULE_PARM_DESC(flush_delay_ms, "Write back dirty cached erase blocks "
+		 "this long after the first write (0 = only on flush/close)");
+
+struct mtdblk_cache_line {
+	struct list_head lru;
+	unsigned char *data;
+	unsigned long offset;
+	enum { STATE_EMPTY, STATE_CLEAN, STATE_DIRTY } state;
+};
 
 struct mtdblk_dev {
 	struct mtd_blktrans_dev mbd;
 	int count;
 	struct mutex cache_mutex;
-	unsigned char *cache_data;
-	unsigned long cache_offset;
+	struct mtdblk_cache_line *cache;
+	int cache_ways;
+	struct list_head cache_lru;	/* most recently used first */
 	unsigned int cache_size;
-	enum { STATE_EMPTY, STATE_CLEAN, STATE_DIRTY } cache_state;
+	struct delayed_work flush_work;
+
+	/* statistics, under cache_mutex */
+	unsigned long n_read_hits;
+	unsigned long n_fills;
+	unsigned long n_erase_writes;
+	unsigned long n_rmw_avoided;
+	unsigned long n_evictions;
+	unsigned long n_timer_flushes;
 };
 
 static struct mutex mtdblks_lock;
@@ -52,8 +82,12 @@ static struct mutex mtdblks_lock;
  * Since typical flash erasable sectors are much larger than what Linux's
  * buffer cache can handle, we must implement read-modify-write on flash
  * sectors for each block write requests.  To avoid over-erasing flash sectors
- * and to speed things up, we locally cache a whole flash sector while it is
- * being written to until a different sector is required.
+ * and to speed things up, we locally cache up to cache_ways whole flash
+ * sectors while they are being written to.  When a sector not in the cache
+ * is needed, the least recently used one is written back to make room, so
+ * interleaved writes to a few regions no longer erase on every switch.
+ * Dirty sectors are also written back flush_delay_ms after they were first
+ * dirtied, which bounds how much a crash can lose.
  */
 
 static void erase_callback(struct erase_info *done)
@@ -111,22 +145,32 @@ static int erase_write (struct mtd_info *mtd, unsigned long pos,
 }
 
 
-static int write_cached_data (struct mtdblk_dev *mtdblk)
+static void drop_cache_line(struct mtdblk_dev *mtdblk,
+			    struct mtdblk_cache_line *line)
+{
+	/* empty lines sit at the LRU tail, where they are reused first */
+	line->state = STATE_EMPTY;
+	list_move_tail(&line->lru, &mtdblk->cache_lru);
+}
+
+static int write_cache_line(struct mtdblk_dev *mtdblk,
+			    struct mtdblk_cache_line *line)
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
 	int ret;
 
-	if (mtdblk->cache_state != STATE_DIRTY)
+	if (line->state != STATE_DIRTY)
 		return 0;
 
 	DEBUG(MTD_DEBUG_LEVEL2, "mtdblock: writing cached data for \"%s\" "
 			"at 0x%lx, size 0x%x\n", mtd->name,
-			mtdblk->cache_offset, mtdblk->cache_size);
+			line->offset, mtdblk->cache_size);
 
-	ret = erase_write (mtd, mtdblk->cache_offset,
-			   mtdblk->cache_size, mtdblk->cache_data);
+	ret = erase_write (mtd, line->offset,
+			   mtdblk->cache_size, line->data);
 	if (ret)
 		return ret;
+	mtdblk->n_erase_writes++;
 
 	/*
 	 * Here we could argubly set the cache state to STATE_CLEAN.
@@ -135,15 +179,90 @@ static int write_cached_data (struct mtdblk_dev *mtdblk)
 	 * means.  Let's declare it empty and leave buffering tasks to
 	 * the buffer cache instead.
 	 */
-	mtdblk->cache_state = STATE_EMPTY;
+	drop_cache_line(mtdblk, line);
 	return 0;
 }
 
+static int write_cached_data (struct mtdblk_dev *mtdblk)
+{
+	int i, ret, err = 0;
+
+	for (i = 0; i < mtdblk->cache_ways; i++) {
+		ret = write_cache_line(mtdblk, &mtdblk->cache[i]);
+		if (ret && !err)
+			err = ret;
+	}
+	return err;
+}
+
+static struct mtdblk_cache_line *find_cache_line(struct mtdblk_dev *mtdblk,
+						 unsigned long sect_start)
+{
+	int i;
+
+	for (i = 0; i < mtdblk->cache_ways; i++) {
+		struct mtdblk_cache_line *line = &mtdblk->cache[i];
+
+		if (line->state != STATE_EMPTY && line->offset == sect_start)
+			return line;
+	}
+	return NULL;
+}
+
+/*
+ * Pick a line to hold a new sector: the least recently used one that has,
+ * or can be given, a buffer.  A dirty victim is written back first.
+ */
+static struct mtdblk_cache_line *get_cache_line(struct mtdblk_dev *mtdblk)
+{
+	struct mtdblk_cache_line *line;
+	int ret;
+
+	list_for_each_entry_reverse(line, &mtdblk->cache_lru, lru) {
+		if (!line->data)
+			line->data = vmalloc(mtdblk->cache_size);
+		if (!line->data)
+			continue;
+
+		if (line->state == STATE_DIRTY) {
+			ret = write_cache_line(mtdblk, line);
+			if (ret)
+				return ERR_PTR(ret);
+			mtdblk->n_evictions++;
+		}
+		line->state = STATE_EMPTY;
+		return line;
+	}
+
+	/* -EINTR is not really correct, but it is the best match
+	 * documented in man 2 write for all cases.  We could also
+	 * return -EAGAIN sometimes, but why bother?
+	 */
+	return ERR_PTR(-EINTR);
+}
+
+static void mtdblock_flush_work(struct work_struct *work)
+{
+	struct mtdblk_dev *mtdblk = container_of(to_delayed_work(work),
+						 struct mtdblk_dev, flush_work);
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	ret = write_cached_data(mtdblk);
+	mtdblk->n_timer_flushes++;
+	mutex_unlock(&mtdblk->cache_mutex);
+
+	if (ret)
+		printk(KERN_WARNING "mtdblock: background write back on "
+		       "\"%s\" failed: %d\n", mtdblk->mbd.mtd->name, ret);
+}
+
 
 static int do_cached_write (struct mtdblk_dev *mtdblk, unsigned long pos,
 			    int len, const char *buf)
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
+	struct mtdblk_cache_line *line;
 	unsigned int sect_size = mtdblk->cache_size;
 	size_t retlen;
 	int ret;
@@ -165,40 +284,49 @@ static int do_cached_write (struct mtdblk_dev *mtdblk, unsigned long pos,
 			/*
 			 * We are covering a whole sector.  Thus there is no
 			 * need to bother with the cache while it may still be
-			 * useful for other partial writes.
+			 * useful for other partial writes.  A cached copy
+			 * of this sector would now be stale, so drop it.
 			 */
+			line = find_cache_line(mtdblk, sect_start);
+			if (line)
+				drop_cache_line(mtdblk, line);
 			ret = erase_write (mtd, pos, size, buf);
 			if (ret)
 				return ret;
 		} else {
 			/* Partial sector: need to use the cache */
 
-			if (mtdblk->cache_state == STATE_DIRTY &&
-			    mtdblk->cache_offset != sect_start) {
-				ret = write_cached_data(mtdblk);
-				if (ret)
-					return ret;
-			}
+			line = find_cache_line(mtdblk, sect_start);
+			if (!line) {
+				line = get_cache_line(mtdblk);
+				if (IS_ERR(line))
+					return PTR_ERR(line);
 
-			if (mtdblk->cache_state == STATE_EMPTY ||
-			    mtdblk->cache_offset != sect_start) {
 				/* fill the cache with the current sector */
-				mtdblk->cache_state = STATE_EMPTY;
 				ret = mtd->read(mtd, sect_start, sect_size,
-						&retlen, mtdblk->cache_data);
+						&retlen, line->data);
 				if (ret)
 					return ret;
 				if (retlen != sect_size)
 					return -EIO;
 
-				mtdblk->cache_offset = sect_start;
-				mtdblk->cache_size = sect_size;
-				mtdblk->cache_state = STATE_CLEAN;
+				line->offset = sect_start;
+				line->state = STATE_CLEAN;
+				mtdblk->n_fills++;
+			} else if (line->state == STATE_DIRTY) {
+				/* absorbed by an erase already pending */
+				mtdblk->n_rmw_avoided++;
 			}
+			list_move(&line->lru, &mtdblk->cache_lru);
 
 			/* write data to our local cache */
-			memcpy (mtdblk->cache_data + offset, buf, size);
-			mtdblk->cache_state = STATE_DIRTY;
+			memcpy (line->data + offset, buf, size);
+			if (line->state != STATE_DIRTY) {
+				line->state = STATE_DIRTY;
+				if (flush_delay_ms)
+					schedule_delayed_work(&mtdblk->flush_work,
+						msecs_to_jiffies(flush_delay_ms));
+			}
 		}
 
 		buf += size;
@@ -214,6 +342,7 @@ static int do_cached_read (struct mtdblk_dev *mtdblk, unsigned long pos,
 			   int len, char *buf)
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
+	struct mtdblk_cache_line *line;
 	unsigned int sect_size = mtdblk->cache_size;
 	size_t retlen;
 	int ret;
@@ -237,9 +366,11 @@ static int do_cached_read (struct mtdblk_dev *mtdblk, unsigned long pos,
 		 * contains what we want, otherwise we read the data directly
 		 * from flash.
 		 */
-		if (mtdblk->cache_state != STATE_EMPTY &&
-		    mtdblk->cache_offset == sect_start) {
-			memcpy (buf, mtdblk->cache_data + offset, size);
+		line = find_cache_line(mtdblk, sect_start);
+		if (line) {
+			memcpy (buf, line->data + offset, size);
+			list_move(&line->lru, &mtdblk->cache_lru);
+			mtdblk->n_read_hits++;
 		} else {
 			ret = mtd->read(mtd, pos, size, &retlen, buf);
 			if (ret)
@@ -260,23 +391,24 @@ static int mtdblock_readsect(struct mtd_blktrans_dev *dev,
 			      unsigned long block, char *buf)
 {
 	struct mtdblk_dev *mtdblk = container_of(dev, struct mtdblk_dev, mbd);
-	return do_cached_read(mtdblk, block<<9, 512, buf);
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	ret = do_cached_read(mtdblk, block<<9, 512, buf);
+	mutex_unlock(&mtdblk->cache_mutex);
+	return ret;
 }
 
 static int mtdblock_writesect(struct mtd_blktrans_dev *dev,
 			      unsigned long block, char *buf)
 {
 	struct mtdblk_dev *mtdblk = container_of(dev, struct mtdblk_dev, mbd);
-	if (unlikely(!mtdblk->cache_data && mtdblk->cache_size)) {
-		mtdblk->cache_data = vmalloc(mtdblk->mbd.mtd->erasesize);
-		if (!mtdblk->cache_data)
-			return -EINTR;
-		/* -EINTR is not really correct, but it is the best match
-		 * documented in man 2 write for all cases.  We could also
-		 * return -EAGAIN sometimes, but why bother?
-		 */
-	}
-	return do_cached_write(mtdblk, block<<9, 512, buf);
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	ret = do_cached_write(mtdblk, block<<9, 512, buf);
+	mutex_unlock(&mtdblk->cache_mutex);
+	return ret;
 }
 
 static int mtdblock_open(struct mtd_blktrans_dev *mbd)
@@ -293,13 +425,27 @@ static int mtdblock_open(struct mtd_blktrans_dev *mbd)
 	}
 
 	/* OK, it's not open. Create cache info for it */
-	mtdblk->count = 1;
-	mutex_init(&mtdblk->cache_mutex);
-	mtdblk->cache_state = STATE_EMPTY;
+	INIT_DELAYED_WORK(&mtdblk->flush_work, mtdblock_flush_work);
+	INIT_LIST_HEAD(&mtdblk->cache_lru);
+	mtdblk->cache = NULL;
+	mtdblk->cache_ways = 0;
 	if (!(mbd->mtd->flags & MTD_NO_ERASE) && mbd->mtd->erasesize) {
+		int i, ways = clamp(cache_ways, 1, MTDBLK_MAX_CACHE_WAYS);
+
+		/* buffers are only allocated once a line is first used */
+		mtdblk->cache = kcalloc(ways, sizeof(*mtdblk->cache),
+					GFP_KERNEL);
+		if (!mtdblk->cache) {
+			mutex_unlock(&mtdblks_lock);
+			return -ENOMEM;
+		}
+		for (i = 0; i < ways; i++)
+			list_add_tail(&mtdblk->cache[i].lru,
+				      &mtdblk->cache_lru);
+		mtdblk->cache_ways = ways;
 		mtdblk->cache_size = mbd->mtd->erasesize;
-		mtdblk->cache_data = NULL;
 	}
+	mtdblk->count = 1;
 
 	mutex_unlock(&mtdblks_lock);
 
@@ -321,10 +467,17 @@ static int mtdblock_release(struct mtd_blktrans_dev *mbd)
 	mutex_unlock(&mtdblk->cache_mutex);
 
 	if (!--mtdblk->count) {
+		int i;
+
 		/* It was the last usage. Free the cache */
+		cancel_delayed_work_sync(&mtdblk->flush_work);
 		if (mbd->mtd->sync)
 			mbd->mtd->sync(mbd->mtd);
-		vfree(mtdblk->cache_data);
+		for (i = 0; i < mtdblk->cache_ways; i++)
+			vfree(mtdblk->cache[i].data);
+		kfree(mtdblk->cache);
+		mtdblk->cache = NULL;
+		mtdblk->cache_ways = 0;
 	}
 
 	mutex_unlock(&mtdblks_lock);
@@ -347,6 +500,40 @@ static int mtdblock_flush(struct mtd_blktrans_dev *dev)
 	return 0;
 }
 
+static ssize_t mtdblock_cache_stats_show(struct device *dev,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	struct mtd_blktrans_dev *mbd = dev_to_disk(dev)->private_data;
+	struct mtdblk_dev *mtdblk = container_of(mbd, struct mtdblk_dev, mbd);
+	ssize_t len;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	len = sprintf(buf,
+		      "ways %d\n"
+		      "read_hits %lu\n"
+		      "fills %lu\n"
+		      "erase_writes %lu\n"
+		      "rmw_avoided %lu\n"
+		      "evictions %lu\n"
+		      "timer_flushes %lu\n",
+		      mtdblk->cache_ways, mtdblk->n_read_hits, mtdblk->n_fills,
+		      mtdblk->n_erase_writes, mtdblk->n_rmw_avoided,
+		      mtdblk->n_evictions, mtdblk->n_timer_flushes);
+	mutex_unlock(&mtdblk->cache_mutex);
+	return len;
+}
+static DEVICE_ATTR(cache_stats, S_IRUGO, mtdblock_cache_stats_show, NULL);
+
+static struct attribute *mtdblock_attrs[] = {
+	&dev_attr_cache_stats.attr,
+	NULL,
+};
+
+static struct attribute_group mtdblock_attr_group = {
+	.attrs = mtdblock_attrs,
+};
+
 static void mtdblock_add_mtd(struct mtd_blktrans_ops *tr, struct mtd_info *mtd)
 {
 	struct mtdblk_dev *dev = kzalloc(sizeof(*dev), GFP_KERNEL);
@@ -359,6 +546,8 @@ static void mtdblock_add_mtd(struct mtd_blktrans_ops *tr, struct mtd_info *mtd)
 
 	dev->mbd.size = mtd->size >> 9;
 	dev->mbd.tr = tr;
+	dev->mbd.disk_attributes = &mtdblock_attr_group;
+	mutex_init(&dev->cache_mutex);
 
 	if (!(mtd->flags & MTD_WRITEABLE))
 		dev->mbd.readonly = 1;
@@ -31,6 +31,7 @@
 #include <linux/platform_device.h>
 #include <linux/if_arp.h>
 #include <linux/msm_rmnet.h>
+#include <linux/uio.h>
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/earlysuspend.h>
@@ -77,6 +78,17 @@ static const char *ch_name[RMNET_DEVICE_COUNT] = {
 
 #define HEADROOM_FOR_QOS    8
 
+/* limits of one aggregated SMD packet */
+#define RMNET_AGG_MAX_PKTS  8
+#define RMNET_AGG_MAX_BYTES 4096
+
+#ifdef CONFIG_MSM_RMNET_NAPI
+#define RMNET_NAPI_WEIGHT   64
+/* receive buffers recycled from transmitted skbs */
+#define RMNET_RX_POOL_SIZE  32
+#define RMNET_RX_BUF_SIZE   (RMNET_DATA_LEN + ETH_HLEN + NET_IP_ALIGN)
+#endif
+
 static struct completion *port_complete[RMNET_DEVICE_COUNT];
 
 struct rmnet_private
@@ -90,8 +102,22 @@ struct rmnet_private
 	unsigned long wakeups_xmit;
 	unsigned long wakeups_rcv;
 	unsigned long timeout_us;
+	unsigned long tx_agg_frames;
+	unsigned long tx_agg_pkts;
+	unsigned long tx_queue_stalls;
+#ifdef CONFIG_MSM_RMNET_NAPI
+	unsigned long rx_polls;
+	unsigned long rx_poll_pkts;
+	unsigned long rx_poll_max;
+	unsigned long rx_recycled;
 #endif
-	struct sk_buff *skb;
+#endif
+#ifdef CONFIG_MSM_RMNET_NAPI
+	struct napi_struct napi;
+	struct sk_buff_head rx_pool;
+#endif
+	struct sk_buff_head tx_queue;
+	unsigned tx_queued_bytes;
 	spinlock_t lock;
 	struct tasklet_struct tsklt;
 	u32 operation_mode;    /* IOCTL specified mode (protocol, QoS header) */
@@ -105,6 +131,11 @@ static uint msm_rmnet_modem_wait;
 module_param_named(modem_wait, msm_rmnet_modem_wait,
 		   uint, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/* bytes queued in the driver before the netdev queue is stopped */
+static uint msm_rmnet_tx_queue_bytes = 2 * RMNET_AGG_MAX_BYTES;
+module_param_named(tx_queue_bytes, msm_rmnet_tx_queue_bytes,
+		   uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
 /* Forward declaration */
 static int rmnet_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd);
 
@@ -166,7 +197,7 @@ static struct early_suspend rmnet_power_suspend = {
 
 static int __init rmnet_late_init(void)
 {
-	register_early_suspend(&rmnet_power_suspend);
+	register_early_suspend_async(&rmnet_power_suspend);
 	return 0;
 }
 
@@ -209,6 +240,57 @@ static ssize_t wakeups_rcv_show(struct device *d, struct device_attribute *attr,
 
 DEVICE_ATTR(wakeups_rcv, 0444, wakeups_rcv_show, NULL);
 
+static ssize_t tx_agg_frames_show(struct device *d,
+		struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu %lu\n", p->tx_agg_frames, p->tx_agg_pkts);
+}
+
+DEVICE_ATTR(tx_agg_frames, 0444, tx_agg_frames_show, NULL);
+
+static ssize_t tx_queue_stalls_show(struct device *d,
+		struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->tx_queue_stalls);
+}
+
+DEVICE_ATTR(tx_queue_stalls, 0444, tx_queue_stalls_show, NULL);
+
+#ifdef CONFIG_MSM_RMNET_NAPI
+static ssize_t rx_polls_show(struct device *d, struct device_attribute *attr,
+		char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->rx_polls);
+}
+
+DEVICE_ATTR(rx_polls, 0444, rx_polls_show, NULL);
+
+/* average and largest number of packets handled per NAPI poll */
+static ssize_t rx_per_poll_show(struct device *d,
+		struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	unsigned long polls = p->rx_polls;
+
+	return sprintf(buf, "%lu %lu\n",
+		       polls ? p->rx_poll_pkts / polls : 0, p->rx_poll_max);
+}
+
+DEVICE_ATTR(rx_per_poll, 0444, rx_per_poll_show, NULL);
+
+static ssize_t rx_recycled_show(struct device *d,
+		struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->rx_recycled);
+}
+
+DEVICE_ATTR(rx_recycled, 0444, rx_recycled_show, NULL);
+#endif
+
 /* Set timeout in us. */
 static ssize_t timeout_store(struct device *d, struct device_attribute *attr,
 		const char *buf, size_t n)
@@ -256,116 +338,196 @@ static __be16 rmnet_ip_type_trans(struct sk_buff *skb, struct net_device *dev)
 	return protocol;
 }
 
-/* Called in soft-irq context */
-static void smd_net_data_handler(unsigned long arg)
+/* Returns the size of the next packet if it is completely in the fifo */
+static int rmnet_rx_pending(struct rmnet_private *p)
+{
+	int sz = smd_cur_packet_size(p->ch);
+
+	if (sz == 0 || smd_read_avail(p->ch) < sz)
+		return 0;
+	return sz;
+}
+
+static struct sk_buff *rmnet_alloc_rx_skb(struct net_device *dev, int sz)
 {
-	struct net_device *dev = (struct net_device *) arg;
-	struct rmnet_private *p = netdev_priv(dev);
 	struct sk_buff *skb;
-	void *ptr = 0;
-	int sz;
-	u32 opmode = p->operation_mode;
-	unsigned long flags;
+#ifdef CONFIG_MSM_RMNET_NAPI
+	struct rmnet_private *p = netdev_priv(dev);
 
-	for (;;) {
-		sz = smd_cur_packet_size(p->ch);
-		if (sz == 0) break;
-		if (smd_read_avail(p->ch) < sz) break;
-
-		if (RMNET_IS_MODE_IP(opmode) ? (sz > dev->mtu) :
-						(sz > (dev->mtu + ETH_HLEN))) {
-			pr_err("[%s] rmnet_recv() discarding packet len %d (%d mtu)\n",
-				dev->name, sz, RMNET_IS_MODE_IP(opmode) ?
-					dev->mtu : (dev->mtu + ETH_HLEN));
-			ptr = 0;
-		} else {
-			skb = dev_alloc_skb(sz + NET_IP_ALIGN);
-			if (skb == NULL) {
-				pr_err("[%s] rmnet_recv() cannot allocate skb\n",
-				       dev->name);
-			} else {
-				skb->dev = dev;
-				skb_reserve(skb, NET_IP_ALIGN);
-				ptr = skb_put(skb, sz);
-				wake_lock_timeout(&p->wake_lock, HZ / 2);
-				if (smd_read(p->ch, ptr, sz) != sz) {
-					pr_err("[%s] rmnet_recv() smd lied about avail?!",
-						dev->name);
-					ptr = 0;
-					dev_kfree_skb_irq(skb);
-				} else {
-					/* Handle Rx frame format */
-					spin_lock_irqsave(&p->lock, flags);
-					opmode = p->operation_mode;
-					spin_unlock_irqrestore(&p->lock, flags);
-
-					if (RMNET_IS_MODE_IP(opmode)) {
-						/* Driver in IP mode */
-						skb->protocol =
-						  rmnet_ip_type_trans(skb, dev);
-					} else {
-						/* Driver in Ethernet mode */
-						skb->protocol =
-						  eth_type_trans(skb, dev);
-					}
-					if (RMNET_IS_MODE_IP(opmode) ||
-					    count_this_packet(ptr, skb->len)) {
+	skb = skb_dequeue(&p->rx_pool);
+	if (skb) {
 #ifdef CONFIG_MSM_RMNET_DEBUG
-						p->wakeups_rcv +=
-							rmnet_cause_wakeup(p);
+		p->rx_recycled++;
 #endif
-						p->stats.rx_packets++;
-						p->stats.rx_bytes += skb->len;
-					}
-					DBG1("[%s] Rx packet #%lu len=%d\n",
-						dev->name, p->stats.rx_packets,
-						skb->len);
-
-					/* Deliver to network stack */
-					netif_rx(skb);
-				}
-				continue;
-			}
-		}
-		if (smd_read(p->ch, ptr, sz) != sz)
-			pr_err("[%s] rmnet_recv() smd lied about avail?!",
-				dev->name);
+		skb->dev = dev;
+		skb_reserve(skb, NET_IP_ALIGN);
+		return skb;
 	}
+#endif
+	skb = dev_alloc_skb(sz + NET_IP_ALIGN);
+	if (skb) {
+		skb->dev = dev;
+		skb_reserve(skb, NET_IP_ALIGN);
+	}
+	return skb;
 }
 
-static DECLARE_TASKLET(smd_net_data_tasklet, smd_net_data_handler, 0);
-
-static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
+/* Reads the current SMD packet into a new skb and sets up its protocol.
+ * Returns NULL if the packet was discarded.
+ */
+static struct sk_buff *rmnet_rx_packet(struct net_device *dev, int sz)
 {
 	struct rmnet_private *p = netdev_priv(dev);
-	smd_channel_t *ch = p->ch;
-	int smd_ret;
-	struct QMI_QOS_HDR_S *qmih;
-	u32 opmode;
+	struct sk_buff *skb;
+	void *ptr;
+	u32 opmode = p->operation_mode;
 	unsigned long flags;
 
-	/* For QoS mode, prepend QMI header and assign flow ID from skb->mark */
+	if (RMNET_IS_MODE_IP(opmode) ? (sz > dev->mtu) :
+					(sz > (dev->mtu + ETH_HLEN))) {
+		pr_err("[%s] rmnet_recv() discarding packet len %d (%d mtu)\n",
+			dev->name, sz, RMNET_IS_MODE_IP(opmode) ?
+				dev->mtu : (dev->mtu + ETH_HLEN));
+		goto discard;
+	}
+
+	skb = rmnet_alloc_rx_skb(dev, sz);
+	if (skb == NULL) {
+		pr_err("[%s] rmnet_recv() cannot allocate skb\n", dev->name);
+		goto discard;
+	}
+
+	ptr = skb_put(skb, sz);
+	if (smd_read(p->ch, ptr, sz) != sz) {
+		pr_err("[%s] rmnet_recv() smd lied about avail?!", dev->name);
+		dev_kfree_skb_any(skb);
+		return NULL;
+	}
+
+	/* Handle Rx frame format */
 	spin_lock_irqsave(&p->lock, flags);
 	opmode = p->operation_mode;
 	spin_unlock_irqrestore(&p->lock, flags);
 
-	if (RMNET_IS_MODE_QOS(opmode)) {
-		qmih = (struct QMI_QOS_HDR_S *)
-			skb_push(skb, sizeof(struct QMI_QOS_HDR_S));
-		qmih->version = 1;
-		qmih->flags = 0;
-		qmih->flow_id = skb->mark;
+	if (RMNET_IS_MODE_IP(opmode)) {
+		/* Driver in IP mode */
+		skb->protocol = rmnet_ip_type_trans(skb, dev);
+	} else {
+		/* Driver in Ethernet mode */
+		skb->protocol = eth_type_trans(skb, dev);
+	}
+	if (RMNET_IS_MODE_IP(opmode) || count_this_packet(ptr, skb->len)) {
+#ifdef CONFIG_MSM_RMNET_DEBUG
+		p->wakeups_rcv += rmnet_cause_wakeup(p);
+#endif
+		p->stats.rx_packets++;
+		p->stats.rx_bytes += skb->len;
 	}
+	DBG1("[%s] Rx packet #%lu len=%d\n",
+		dev->name, p->stats.rx_packets, skb->len);
+	return skb;
+
+discard:
+	if (smd_read(p->ch, NULL, sz) != sz)
+		pr_err("[%s] rmnet_recv() smd lied about avail?!", dev->name);
+	return NULL;
+}
 
-	dev->trans_start = jiffies;
-	smd_ret = smd_write(ch, skb->data, skb->len);
-	if (smd_ret != skb->len) {
-		pr_err("[%s] %s: smd_write returned error %d",
-			dev->name, __func__, smd_ret);
-		p->stats.tx_errors++;
-		goto xmit_out;
+#ifdef CONFIG_MSM_RMNET_NAPI
+static int rmnet_poll(struct napi_struct *napi, int budget)
+{
+	struct net_device *dev = napi->dev;
+	struct rmnet_private *p = netdev_priv(dev);
+	struct sk_buff *skb;
+	int work = 0;
+	int sz;
+
+	while (work < budget) {
+		sz = rmnet_rx_pending(p);
+		if (sz == 0)
+			break;
+
+		skb = rmnet_rx_packet(dev, sz);
+		work++;
+		if (!skb)
+			continue;
+
+		/* GRO relies on an Ethernet header to match flows */
+		if (RMNET_IS_MODE_IP(p->operation_mode))
+			netif_receive_skb(skb);
+		else
+			napi_gro_receive(napi, skb);
+	}
+
+	if (work)
+		wake_lock_timeout(&p->wake_lock, HZ / 2);
+
+#ifdef CONFIG_MSM_RMNET_DEBUG
+	p->rx_polls++;
+	p->rx_poll_pkts += work;
+	if (work > p->rx_poll_max)
+		p->rx_poll_max = work;
+#endif
+
+	if (work < budget) {
+		napi_complete(napi);
+		/* data may have arrived after the last check */
+		if (rmnet_rx_pending(p))
+			napi_reschedule(napi);
 	}
 
+	return work;
+}
+
+/* Keep a TX skb around as a future receive buffer if it is big enough */
+static void rmnet_free_tx_skb(struct net_device *dev, struct sk_buff *skb)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+
+	if (skb_queue_len(&p->rx_pool) < RMNET_RX_POOL_SIZE &&
+	    skb_recycle_check(skb, RMNET_RX_BUF_SIZE)) {
+		skb_queue_tail(&p->rx_pool, skb);
+		return;
+	}
+	dev_kfree_skb_any(skb);
+}
+#else
+/* Called in soft-irq context */
+static void smd_net_data_handler(unsigned long arg)
+{
+	struct net_device *dev = (struct net_device *) arg;
+	struct rmnet_private *p = netdev_priv(dev);
+	struct sk_buff *skb;
+	int sz;
+
+	for (;;) {
+		sz = rmnet_rx_pending(p);
+		if (sz == 0)
+			break;
+
+		wake_lock_timeout(&p->wake_lock, HZ / 2);
+		skb = rmnet_rx_packet(dev, sz);
+
+		/* Deliver to network stack */
+		if (skb)
+			netif_rx(skb);
+	}
+}
+
+static DECLARE_TASKLET(smd_net_data_tasklet, smd_net_data_handler, 0);
+
+static void rmnet_free_tx_skb(struct net_device *dev, struct sk_buff *skb)
+{
+	dev_kfree_skb_any(skb);
+}
+#endif
+
+/* Account a transmitted skb; called once it has been copied to SMD */
+static void rmnet_tx_done(struct net_device *dev, struct sk_buff *skb,
+			  u32 opmode)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+
 	if (RMNET_IS_MODE_IP(opmode) ||
 	    count_this_packet(skb->data, skb->len)) {
 		p->stats.tx_packets++;
@@ -376,31 +538,163 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 	DBG1("[%s] Tx packet #%lu len=%d mark=0x%x\n",
 	    dev->name, p->stats.tx_packets, skb->len, skb->mark);
+}
+
+/* Returns 1 if @len bytes fit in the SMD fifo.  Otherwise the read
+ * interrupt is left enabled so that smd_net_notify() runs once the
+ * modem has drained the fifo.
+ */
+static int rmnet_tx_room(smd_channel_t *ch, int len)
+{
+	if (smd_write_avail(ch) >= len)
+		return 1;
 
-xmit_out:
-	/* data xmited, safe to release skb */
-	dev_kfree_skb_irq(skb);
+	smd_enable_read_intr(ch);
+	if (smd_write_avail(ch) >= len) {
+		smd_disable_read_intr(ch);
+		return 1;
+	}
 	return 0;
 }
 
-static void _rmnet_resume_flow(unsigned long param)
+/* Writes the skb at the head of the tx queue as its own SMD packet.
+ * Called with p->lock held; returns 0 if the fifo is full.
+ */
+static int rmnet_tx_single(struct net_device *dev, u32 opmode,
+			   struct sk_buff_head *done)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+	struct sk_buff *skb = skb_peek(&p->tx_queue);
+	int smd_ret;
+
+	if (!rmnet_tx_room(p->ch, skb->len))
+		return 0;
+
+	__skb_unlink(skb, &p->tx_queue);
+	p->tx_queued_bytes -= skb->len;
+
+	smd_ret = smd_write(p->ch, skb->data, skb->len);
+	if (smd_ret != skb->len) {
+		pr_err("[%s] %s: smd_write returned error %d",
+			dev->name, __func__, smd_ret);
+		p->stats.tx_errors++;
+	} else
+		rmnet_tx_done(dev, skb, opmode);
+
+	__skb_queue_tail(done, skb);
+	return 1;
+}
+
+/* Gathers as many queued skbs as fit into one SMD packet, each
+ * preceded by an aggregation header.  Called with p->lock held;
+ * returns 0 if the fifo is full.
+ */
+static int rmnet_tx_aggregate(struct net_device *dev, u32 opmode,
+			      struct sk_buff_head *done)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+	struct RMNET_AGG_HDR_S hdr[RMNET_AGG_MAX_PKTS];
+	struct kvec iov[2 * RMNET_AGG_MAX_PKTS];
+	struct sk_buff *skb;
+	int avail;
+	int len = 0;
+	int n = 0;
+	int smd_ret;
+
+	avail = smd_write_avail(p->ch);
+	if (avail > RMNET_AGG_MAX_BYTES)
+		avail = RMNET_AGG_MAX_BYTES;
+
+	skb_queue_walk(&p->tx_queue, skb) {
+		if (n == RMNET_AGG_MAX_PKTS ||
+		    len + sizeof(hdr[0]) + skb->len > avail)
+			break;
+		hdr[n].len = htons(skb->len);
+		hdr[n].reserved = 0;
+		iov[2 * n].iov_base = &hdr[n];
+		iov[2 * n].iov_len = sizeof(hdr[n]);
+		iov[2 * n + 1].iov_base = skb->data;
+		iov[2 * n + 1].iov_len = skb->len;
+		len += sizeof(hdr[n]) + skb->len;
+		n++;
+	}
+
+	if (n == 0) {
+		skb = skb_peek(&p->tx_queue);
+		if (skb->len + sizeof(hdr[0]) > RMNET_AGG_MAX_BYTES) {
+			/* can never be aggregated, send it on its own */
+			return rmnet_tx_single(dev, opmode, done);
+		}
+		return rmnet_tx_room(p->ch, skb->len + sizeof(hdr[0]));
+	}
+
+	smd_ret = smd_write_segments(p->ch, iov, 2 * n);
+	if (smd_ret != len) {
+		pr_err("[%s] %s: smd_write_segments returned error %d",
+			dev->name, __func__, smd_ret);
+		p->stats.tx_errors += n;
+	}
+
+#ifdef CONFIG_MSM_RMNET_DEBUG
+	if (n > 1) {
+		p->tx_agg_frames++;
+		p->tx_agg_pkts += n;
+	}
+#endif
+
+	while (n--) {
+		skb = __skb_dequeue(&p->tx_queue);
+		p->tx_queued_bytes -= skb->len;
+		if (smd_ret == len)
+			rmnet_tx_done(dev, skb, opmode);
+		__skb_queue_tail(done, skb);
+	}
+	return 1;
+}
+
+/* Moves queued skbs into the SMD fifo until either runs out */
+static void rmnet_tx_flush(struct net_device *dev)
 {
-	struct net_device *dev = (struct net_device *)param;
 	struct rmnet_private *p = netdev_priv(dev);
-	struct sk_buff *skb = NULL;
+	struct sk_buff_head done;
+	struct sk_buff *skb;
 	unsigned long flags;
+	u32 opmode;
+	int sent;
+
+	__skb_queue_head_init(&done);
 
-	/* xmit and enable the flow only once even if
-	   multiple tasklets were scheduled by smd_net_notify */
 	spin_lock_irqsave(&p->lock, flags);
-	if (p->skb && (smd_write_avail(p->ch) >= p->skb->len)) {
-		skb = p->skb;
-		p->skb = NULL;
-		spin_unlock_irqrestore(&p->lock, flags);
-		_rmnet_xmit(skb, dev);
+	opmode = p->operation_mode;
+	if (!p->ch) {
+		/* transport closed underneath us, drop the backlog */
+		p->stats.tx_dropped += skb_queue_len(&p->tx_queue);
+		skb_queue_splice_tail_init(&p->tx_queue, &done);
+		p->tx_queued_bytes = 0;
+	}
+
+	while (!skb_queue_empty(&p->tx_queue)) {
+		if (RMNET_IS_MODE_AGG(opmode))
+			sent = rmnet_tx_aggregate(dev, opmode, &done);
+		else
+			sent = rmnet_tx_single(dev, opmode, &done);
+		if (!sent)
+			break;
+	}
+
+	if (netif_queue_stopped(dev) &&
+	    p->tx_queued_bytes <= msm_rmnet_tx_queue_bytes / 2)
 		netif_wake_queue(dev);
-	} else
-		spin_unlock_irqrestore(&p->lock, flags);
+	spin_unlock_irqrestore(&p->lock, flags);
+
+	/* data xmited, safe to release skbs */
+	while ((skb = __skb_dequeue(&done)) != NULL)
+		rmnet_free_tx_skb(dev, skb);
+}
+
+static void _rmnet_resume_flow(unsigned long param)
+{
+	rmnet_tx_flush((struct net_device *)param);
 }
 
 static void msm_rmnet_unload_modem(void *pil)
@@ -443,7 +737,7 @@ static void smd_net_notify(void *_dev, unsigned event)
 	switch (event) {
 	case SMD_EVENT_DATA:
 		spin_lock(&p->lock);
-		if (p->skb && (smd_write_avail(p->ch) >= p->skb->len)) {
+		if (!skb_queue_empty(&p->tx_queue)) {
 			smd_disable_read_intr(p->ch);
 			tasklet_hi_schedule(&p->tsklt);
 		}
@@ -452,8 +746,12 @@ static void smd_net_notify(void *_dev, unsigned event)
 
 		if (smd_read_avail(p->ch) &&
 			(smd_read_avail(p->ch) >= smd_cur_packet_size(p->ch))) {
+#ifdef CONFIG_MSM_RMNET_NAPI
+			napi_schedule(&p->napi);
+#else
 			smd_net_data_tasklet.data = (unsigned long) _dev;
 			tasklet_schedule(&smd_net_data_tasklet);
+#endif
 		}
 		break;
 
@@ -520,12 +818,24 @@ static int __rmnet_close(struct net_device *dev)
 static int rmnet_open(struct net_device *dev)
 {
 	int rc = 0;
+#ifdef CONFIG_MSM_RMNET_NAPI
+	struct rmnet_private *p = netdev_priv(dev);
+#endif
 
 	DBG0("[%s] rmnet_open()\n", dev->name);
 
 	rc = __rmnet_open(dev);
-	if (rc == 0)
+	if (rc == 0) {
+#ifdef CONFIG_MSM_RMNET_NAPI
+		napi_enable(&p->napi);
+		/* the channel stays open while down; pick up what is waiting */
+		local_bh_disable();
+		if (rmnet_rx_pending(p))
+			napi_schedule(&p->napi);
+		local_bh_enable();
+#endif
 		netif_start_queue(dev);
+	}
 
 	return rc;
 }
@@ -533,11 +843,34 @@ static int rmnet_open(struct net_device *dev)
 static int rmnet_stop(struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
+	struct sk_buff_head dropped;
+	struct sk_buff *skb;
+	unsigned long flags;
 
 	DBG0("[%s] rmnet_stop()\n", dev->name);
 
 	netif_stop_queue(dev);
 	tasklet_kill(&p->tsklt);
+#ifdef CONFIG_MSM_RMNET_NAPI
+	/* waits for a running rmnet_poll(); notifies are ignored after */
+	napi_disable(&p->napi);
+#endif
+
+	__skb_queue_head_init(&dropped);
+
+	spin_lock_irqsave(&p->lock, flags);
+	p->stats.tx_dropped += skb_queue_len(&p->tx_queue);
+	skb_queue_splice_tail_init(&p->tx_queue, &dropped);
+	p->tx_queued_bytes = 0;
+	spin_unlock_irqrestore(&p->lock, flags);
+
+	while ((skb = __skb_dequeue(&dropped)) != NULL)
+		rmnet_free_tx_skb(dev, skb);
+
+#ifdef CONFIG_MSM_RMNET_NAPI
+	/* the pool is refilled from TX once the interface is up again */
+	skb_queue_purge(&p->rx_pool);
+#endif
 
 	/* TODO: unload modem safely,
 	   currently, this causes unnecessary unloads */
@@ -566,7 +899,7 @@ static int rmnet_change_mtu(struct net_device *dev, int new_mtu)
 static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
-	smd_channel_t *ch = p->ch;
+	struct QMI_QOS_HDR_S *qmih;
 	unsigned long flags;
 
 	if (netif_queue_stopped(dev)) {
@@ -576,17 +909,31 @@ static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 
 	spin_lock_irqsave(&p->lock, flags);
-	smd_enable_read_intr(ch);
-	if (smd_write_avail(ch) < skb->len) {
+
+	/* For QoS mode, prepend QMI header and assign flow ID from skb->mark */
+	if (RMNET_IS_MODE_QOS(p->operation_mode)) {
+		qmih = (struct QMI_QOS_HDR_S *)
+			skb_push(skb, sizeof(struct QMI_QOS_HDR_S));
+		qmih->version = 1;
+		qmih->flags = 0;
+		qmih->flow_id = skb->mark;
+	}
+
+	/* Only a few frames worth of bytes are held here; the rest stays
+	 * in the qdisc where it can still be reordered and dropped.
+	 */
+	__skb_queue_tail(&p->tx_queue, skb);
+	p->tx_queued_bytes += skb->len;
+	if (p->tx_queued_bytes >= msm_rmnet_tx_queue_bytes) {
 		netif_stop_queue(dev);
-		p->skb = skb;
-		spin_unlock_irqrestore(&p->lock, flags);
-		return 0;
+#ifdef CONFIG_MSM_RMNET_DEBUG
+		p->tx_queue_stalls++;
+#endif
 	}
-	smd_disable_read_intr(ch);
 	spin_unlock_irqrestore(&p->lock, flags);
 
-	_rmnet_xmit(skb, dev);
+	dev->trans_start = jiffies;
+	rmnet_tx_flush(dev);
 
 	return 0;
 }
@@ -711,6 +1058,27 @@ static int rmnet_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd)
 			(void *)(p->operation_mode & RMNET_MODE_QOS);
 		break;
 
+	case RMNET_IOCTL_SET_AGG_ENABLE:    /* Set TX aggregation on   */
+		spin_lock_irqsave(&p->lock, flags);
+		p->operation_mode |= RMNET_MODE_AGG;
+		spin_unlock_irqrestore(&p->lock, flags);
+		DBG0("[%s] rmnet_ioctl(): set TX aggregation enable\n",
+			dev->name);
+		break;
+
+	case RMNET_IOCTL_SET_AGG_DISABLE:   /* Set TX aggregation off  */
+		spin_lock_irqsave(&p->lock, flags);
+		p->operation_mode &= ~RMNET_MODE_AGG;
+		spin_unlock_irqrestore(&p->lock, flags);
+		DBG0("[%s] rmnet_ioctl(): set TX aggregation disable\n",
+			dev->name);
+		break;
+
+	case RMNET_IOCTL_GET_AGG:           /* Get TX aggregation state */
+		ifr->ifr_ifru.ifru_data =
+			(void *)(p->operation_mode & RMNET_MODE_AGG);
+		break;
+
 	case RMNET_IOCTL_GET_OPMODE:        /* Get operation mode      */
 		ifr->ifr_ifru.ifru_data = (void *)p->operation_mode;
 		break;
@@ -796,7 +1164,8 @@ static int __init rmnet_init(void)
 		p->chname = ch_name[n];
 		/* Initial config uses Ethernet */
 		p->operation_mode = RMNET_MODE_LLP_ETH;
-		p->skb = NULL;
+		skb_queue_head_init(&p->tx_queue);
+		p->tx_queued_bytes = 0;
 		spin_lock_init(&p->lock);
 		tasklet_init(&p->tsklt, _rmnet_resume_flow,
 				(unsigned long)dev);
@@ -805,6 +1174,11 @@ static int __init rmnet_init(void)
 		p->timeout_us = timeout_us;
 		p->wakeups_xmit = p->wakeups_rcv = 0;
 #endif
+#ifdef CONFIG_MSM_RMNET_NAPI
+		skb_queue_head_init(&p->rx_pool);
+		/* left disabled until rmnet_open() */
+		netif_napi_add(dev, &p->napi, rmnet_poll, RMNET_NAPI_WEIGHT);
+#endif
 
 		init_completion(&p->complete);
 		port_complete[n] = &p->complete;
@@ -833,6 +1207,18 @@ static int __init rmnet_init(void)
 			continue;
 		if (device_create_file(d, &dev_attr_wakeups_rcv))
 			continue;
+		if (device_create_file(d, &dev_attr_tx_agg_frames))
+			continue;
+		if (device_create_file(d, &dev_attr_tx_queue_stalls))
+			continue;
+#ifdef CONFIG_MSM_RMNET_NAPI
+		if (device_create_file(d, &dev_attr_rx_polls))
+			continue;
+		if (device_create_file(d, &dev_attr_rx_per_poll))
+			continue;
+		if (device_create_file(d, &dev_attr_rx_recycled))
+			continue;
+#endif
 #ifdef CONFIG_HAS_EARLYSUSPEND
 		if (device_create_file(d, &dev_attr_timeout_suspend))
 			continue;
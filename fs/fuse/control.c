@@ -61,6 +61,29 @@ static ssize_t fuse_conn_waiting_read(struct file *file, char __user *buf,
 	return simple_read_from_buffer(buf, len, ppos, tmp, size);
 }
 
+static ssize_t fuse_conn_queues_read(struct file *file, char __user *buf,
+				     size_t len, loff_t *ppos)
+{
+	struct fuse_conn *fc;
+	char tmp[32 + FUSE_MAX_QUEUES * 48];
+	size_t size;
+	unsigned i;
+
+	fc = fuse_ctl_file_conn_get(file);
+	if (!fc)
+		return 0;
+
+	spin_lock(&fc->lock);
+	size = sprintf(tmp, "pending %u\n", fc->num_pending);
+	for (i = 0; i < fc->nr_queues; i++)
+		size += sprintf(tmp + size, "%u: queued %lu stolen %lu\n", i,
+				fc->queues[i].n_queued, fc->queues[i].n_stolen);
+	spin_unlock(&fc->lock);
+	fuse_conn_put(fc);
+
+	return simple_read_from_buffer(buf, len, ppos, tmp, size);
+}
+
 static ssize_t fuse_conn_limit_read(struct file *file, char __user *buf,
 				    size_t len, loff_t *ppos, unsigned val)
 {
@@ -188,6 +211,12 @@ static const struct file_operations fuse_ctl_waiting_ops = {
 	.llseek = no_llseek,
 };
 
+static const struct file_operations fuse_conn_queues_ops = {
+	.open = nonseekable_open,
+	.read = fuse_conn_queues_read,
+	.llseek = no_llseek,
+};
+
 static const struct file_operations fuse_conn_max_background_ops = {
 	.open = nonseekable_open,
 	.read = fuse_conn_max_background_read,
@@ -262,6 +291,8 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 NULL, &fuse_ctl_waiting_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "abort", S_IFREG | 0200, 1,
 				 NULL, &fuse_ctl_abort_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "queues", S_IFREG | 0400, 1,
+				 NULL, &fuse_conn_queues_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "max_background", S_IFREG | 0600,
 				 1, NULL, &fuse_conn_max_background_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "congestion_threshold",
@@ -19,6 +19,7 @@
 #include <linux/pipe_fs_i.h>
 #include <linux/swap.h>
 #include <linux/splice.h>
+#include <linux/uaccess.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -237,18 +238,70 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 	return fc->reqctr;
 }
 
+static struct fuse_queue *fuse_home_queue(struct fuse_conn *fc)
+{
+	return &fc->queues[raw_smp_processor_id() % fc->nr_queues];
+}
+
+static struct list_head *fuse_processing_list(struct fuse_conn *fc,
+					      u64 unique)
+{
+	return &fc->processing[unique & (FUSE_PQ_HASH_SIZE - 1)];
+}
+
+/*
+ * Wake one reader for new work, preferring a thread that waits on @fq so
+ * the request is picked up on the CPU that issued it.  If every thread
+ * there has already been sent a wakeup it has not acted on yet, an idle
+ * reader on another queue is woken instead.  Called with fc->lock held,
+ * which readers also hold while deciding to sleep.
+ */
+static void fuse_wake_reader(struct fuse_conn *fc, struct fuse_queue *fq)
+{
+	unsigned i;
+
+	if (!fq->n_idle) {
+		for (i = 0; i < fc->nr_queues; i++) {
+			if (fc->queues[i].n_idle) {
+				fq = &fc->queues[i];
+				break;
+			}
+		}
+	}
+	if (fq->n_idle) {
+		fq->n_idle--;
+		fq->n_wakeups++;
+		wake_up(&fq->waitq);
+	}
+	if (waitqueue_active(&fc->waitq))
+		wake_up(&fc->waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+}
+
+void fuse_wake_all_readers(struct fuse_conn *fc)
+{
+	unsigned i;
+
+	for (i = 0; i < fc->nr_queues; i++)
+		wake_up_all(&fc->queues[i].waitq);
+	wake_up_all(&fc->waitq);
+}
+
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_queue *fq = fuse_home_queue(fc);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &fq->pending);
+	fq->n_queued++;
+	fc->num_pending++;
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_reader(fc, fq);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -260,8 +313,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	spin_lock(&fc->lock);
 	fc->forget_list_tail->next = forget;
 	fc->forget_list_tail = forget;
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_reader(fc, fuse_home_queue(fc));
 	spin_unlock(&fc->lock);
 }
 
@@ -294,6 +346,8 @@ __releases(fc->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
+	if (req->state == FUSE_REQ_PENDING)
+		fc->num_pending--;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
@@ -334,8 +388,7 @@ __acquires(fc->lock)
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
 	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_reader(fc, fuse_home_queue(fc));
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
@@ -372,6 +425,7 @@ __acquires(fc->lock)
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
+			fc->num_pending--;
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
@@ -911,29 +965,58 @@ static int forget_pending(struct fuse_conn *fc)
 
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
+	return fc->num_pending || !list_empty(&fc->interrupts) ||
 		forget_pending(fc);
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
+/* Wait on @fq until a request is available on any pending queue */
+static void request_wait(struct fuse_conn *fc, struct fuse_queue *fq)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
+	add_wait_queue_exclusive(&fq->waitq, &wait);
 	while (fc->connected && !request_pending(fc)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
 
+		fq->n_idle++;
 		spin_unlock(&fc->lock);
 		schedule();
 		spin_lock(&fc->lock);
+		/*
+		 * Which sleeper a wakeup reached does not matter, only that
+		 * n_idle keeps counting the ones still free to be woken.
+		 */
+		if (fq->n_wakeups)
+			fq->n_wakeups--;
+		else
+			fq->n_idle--;
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&fq->waitq, &wait);
+}
+
+/*
+ * Take the oldest request off @fq, or off the next non-empty queue if
+ * @fq has nothing.  Called with fc->lock held and fc->num_pending != 0.
+ */
+static struct fuse_req *dequeue_request(struct fuse_conn *fc,
+					struct fuse_queue *fq)
+{
+	unsigned i, home = fq - fc->queues;
+
+	for (i = 0; list_empty(&fq->pending); i++) {
+		BUG_ON(i == fc->nr_queues);
+		fq = &fc->queues[(home + i + 1) % fc->nr_queues];
+	}
+	if (i)
+		fq->n_stolen++;
+
+	fc->num_pending--;
+	return list_entry(fq->pending.next, struct fuse_req, list);
 }
 
 /*
@@ -1103,16 +1186,18 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
+	struct fuse_queue *fq;
 	unsigned reqsize;
 
  restart:
 	spin_lock(&fc->lock);
+	fq = fuse_home_queue(fc);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
 	    !request_pending(fc))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fc, fq);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
@@ -1127,14 +1212,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		if (!fc->num_pending || fc->forget_batch-- > 0)
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = dequeue_request(fc, fq);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
 
@@ -1171,7 +1256,8 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list,
+			       fuse_processing_list(fc, in->h.unique));
 		if (req->interrupted)
 			queue_interrupt(fc, req);
 		spin_unlock(&fc->lock);
@@ -1599,14 +1685,21 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 /* Look up request on processing list by unique ID */
 static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
 {
-	struct list_head *entry;
+	struct fuse_req *req;
+	unsigned i;
 
-	list_for_each(entry, &fc->processing) {
-		struct fuse_req *req;
-		req = list_entry(entry, struct fuse_req, list);
-		if (req->in.h.unique == unique || req->intr_unique == unique)
+	list_for_each_entry(req, fuse_processing_list(fc, unique), list) {
+		if (req->in.h.unique == unique)
 			return req;
 	}
+
+	/* interrupt replies are rare, and hashed under the original ID */
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++) {
+		list_for_each_entry(req, &fc->processing[i], list) {
+			if (req->intr_unique == unique)
+				return req;
+		}
+	}
 	return NULL;
 }
 
@@ -1902,10 +1995,14 @@ static void end_queued_requests(struct fuse_conn *fc)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
+	unsigned i;
+
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
+	for (i = 0; i < fc->nr_queues; i++)
+		end_requests(fc, &fc->queues[i].pending);
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
+		end_requests(fc, &fc->processing[i]);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
 }
@@ -1937,7 +2034,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		fc->blocked = 0;
 		end_io_requests(fc);
 		end_queued_requests(fc);
-		wake_up_all(&fc->waitq);
+		fuse_wake_all_readers(fc);
 		wake_up_all(&fc->blocked_waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
@@ -1972,6 +2069,25 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 	return fasync_helper(fd, file, on, &fc->fasync);
 }
 
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_conn *fc = fuse_get_conn(file);
+	u32 backing_fd;
+
+	if (!fc)
+		return -EPERM;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_PASSTHROUGH_OPEN:
+		if (get_user(backing_fd, (u32 __user *)arg))
+			return -EFAULT;
+		return fuse_passthrough_open(fc, backing_fd);
+	default:
+		return -ENOTTY;
+	}
+}
+
 const struct file_operations fuse_dev_operations = {
 	.owner		= THIS_MODULE,
 	.llseek		= no_llseek,
@@ -1984,6 +2100,7 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -462,6 +462,12 @@ static int fuse_create_open(struct inode *dir, struct dentry *entry, int mode,
 		fuse_sync_release(ff, flags);
 		return PTR_ERR(file);
 	}
+	/* the backing file is checked against the mode of the open */
+	err = fuse_passthrough_setup(fc, ff, file, &outopen);
+	if (err) {
+		fuse_sync_release(ff, flags);
+		return err;
+	}
 	file->private_data = fuse_file_get(ff);
 	fuse_finish_open(inode, file);
 	return 0;
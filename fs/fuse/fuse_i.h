@@ -22,6 +22,10 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/idr.h>
+
+/** Magic number of fuse superblocks */
+#define FUSE_SUPER_MAGIC 0x65735546
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -33,7 +37,13 @@
 #define FUSE_NAME_MAX 1024
 
 /** Number of dentries for each connection in the control filesystem */
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 6
+
+/** Maximum number of pending queues per connection (one per CPU) */
+#define FUSE_MAX_QUEUES 4
+
+/** Number of hash buckets for requests awaiting a reply */
+#define FUSE_PQ_HASH_SIZE 64
 
 /** If the FUSE_DEFAULT_PERMISSIONS flag is given, the filesystem
     module will check permissions based on the file mode.  Otherwise no
@@ -104,6 +114,39 @@ struct fuse_inode {
 
 struct fuse_conn;
 
+/**
+ * A queue of requests not yet read by the daemon.  Requests are queued
+ * on the queue of the CPU they were issued from, and a daemon thread
+ * reading on that CPU is woken for them if there is one.
+ */
+struct fuse_queue {
+	/** Requests waiting to be read */
+	struct list_head pending;
+
+	/** Daemon threads reading from this CPU wait here */
+	wait_queue_head_t waitq;
+
+	/** Threads asleep on waitq that no wakeup has been sent to yet */
+	unsigned n_idle;
+
+	/** Wakeups sent to waitq that no thread has returned from yet */
+	unsigned n_wakeups;
+
+	/** Requests queued here */
+	unsigned long n_queued;
+
+	/** Requests taken by a thread reading from another CPU */
+	unsigned long n_stolen;
+};
+
+/** Backing file of a passthrough open */
+struct fuse_passthrough {
+	struct file *filp;
+
+	/** Credentials of the daemon that registered it */
+	const struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -135,6 +178,9 @@ struct fuse_file {
 
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
+
+	/** Backing file, if the open was set up for passthrough */
+	struct fuse_passthrough passthrough;
 };
 
 /** One input argument of a request */
@@ -342,14 +388,20 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
+	/** Pollers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Pending requests, per CPU */
+	struct fuse_queue queues[FUSE_MAX_QUEUES];
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Number of queues in use */
+	unsigned nr_queues;
+
+	/** Requests on all the pending queues */
+	unsigned num_pending;
+
+	/** Requests being processed, hashed by unique ID */
+	struct list_head processing[FUSE_PQ_HASH_SIZE];
 
 	/** The list of requests under I/O */
 	struct list_head io;
@@ -473,6 +525,12 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Passthrough of file I/O to daemon-registered backing files */
+	unsigned passthrough:1;
+
+	/** Backing files registered but not yet claimed by an open */
+	struct idr passthrough_req;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -684,6 +742,9 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/* Wake up every thread reading or polling the device */
+void fuse_wake_all_readers(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -764,4 +825,17 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_conn *fc, int backing_fd);
+int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			   struct file *file, struct fuse_open_out *openarg);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+void fuse_passthrough_cleanup(struct fuse_conn *fc);
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
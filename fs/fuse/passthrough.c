@@ -0,0 +1,272 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  Passthrough of file I/O to a backing file registered by the daemon.
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/aio.h>
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fsnotify.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/security.h>
+#include <linux/slab.h>
+
+/*
+ * Register an open backing file.  The returned id is handed back by the
+ * daemon in fuse_open_out.passthrough_fh, which is when the file is bound
+ * to the fuse_file being opened.
+ */
+int fuse_passthrough_open(struct fuse_conn *fc, int backing_fd)
+{
+	struct fuse_passthrough *passthrough;
+	struct file *backing;
+	int id, err;
+
+	if (!fc->passthrough)
+		return -EPERM;
+
+	backing = fget(backing_fd);
+	if (!backing)
+		return -EBADF;
+
+	err = -EINVAL;
+	/* no stacking onto another fuse mount: it could loop back to us */
+	if (backing->f_path.dentry->d_sb->s_magic == FUSE_SUPER_MAGIC)
+		goto out_fput;
+	if (!backing->f_op || !backing->f_op->aio_read ||
+	    !backing->f_op->aio_write)
+		goto out_fput;
+
+	err = -ENOMEM;
+	passthrough = kmalloc(sizeof(*passthrough), GFP_KERNEL);
+	if (!passthrough)
+		goto out_fput;
+	passthrough->filp = backing;
+	passthrough->cred = prepare_creds();
+	if (!passthrough->cred)
+		goto out_free;
+
+	do {
+		if (!idr_pre_get(&fc->passthrough_req, GFP_KERNEL))
+			goto out_put_cred;
+		spin_lock(&fc->lock);
+		err = idr_get_new_above(&fc->passthrough_req, passthrough, 1,
+					&id);
+		spin_unlock(&fc->lock);
+	} while (err == -EAGAIN);
+	if (err)
+		goto out_put_cred;
+
+	return id;
+
+ out_put_cred:
+	put_cred(passthrough->cred);
+ out_free:
+	kfree(passthrough);
+ out_fput:
+	fput(backing);
+	return err;
+}
+
+int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			   struct file *file, struct fuse_open_out *openarg)
+{
+	struct fuse_passthrough *passthrough;
+	fmode_t mode = file->f_mode & (FMODE_READ | FMODE_WRITE);
+	int id = openarg->passthrough_fh;
+
+	if (!fc->passthrough || id <= 0)
+		return 0;
+
+	spin_lock(&fc->lock);
+	passthrough = idr_find(&fc->passthrough_req, id);
+	if (passthrough)
+		idr_remove(&fc->passthrough_req, id);
+	spin_unlock(&fc->lock);
+
+	if (!passthrough)
+		return -EINVAL;
+
+	/*
+	 * I/O goes straight to the backing file, so it must have been
+	 * opened for everything this open allows.
+	 */
+	if ((passthrough->filp->f_mode & mode) != mode) {
+		fuse_passthrough_release(passthrough);
+		kfree(passthrough);
+		return -EACCES;
+	}
+
+	ff->passthrough = *passthrough;
+	kfree(passthrough);
+	return 0;
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough)
+{
+	if (passthrough->filp) {
+		fput(passthrough->filp);
+		passthrough->filp = NULL;
+	}
+	if (passthrough->cred) {
+		put_cred(passthrough->cred);
+		passthrough->cred = NULL;
+	}
+}
+
+static int fuse_passthrough_free_req(int id, void *p, void *data)
+{
+	struct fuse_passthrough *passthrough = p;
+
+	fuse_passthrough_release(passthrough);
+	kfree(passthrough);
+	return 0;
+}
+
+/* Drop backing files the daemon registered but never used */
+void fuse_passthrough_cleanup(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_req, NULL);
+	idr_remove_all(&fc->passthrough_req);
+	idr_destroy(&fc->passthrough_req);
+}
+
+/*
+ * Make the checks vfs_readv()/vfs_writev() would make on the backing
+ * file before calling into it; the caller has the daemon's creds set.
+ * rw_verify_area() isn't exported, so this open codes the parts of it
+ * that apply: mandatory locks and the security hook.
+ */
+static ssize_t fuse_passthrough_rw(int type, struct file *backing,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t *ppos)
+{
+	struct inode *inode = backing->f_path.dentry->d_inode;
+	struct kiocb kiocb;
+	size_t count = iov_length(iov, nr_segs);
+	ssize_t ret;
+
+	if (!(backing->f_mode & (type == READ ? FMODE_READ : FMODE_WRITE)))
+		return -EBADF;
+	if (unlikely((ssize_t) count < 0) || *ppos < 0)
+		return -EINVAL;
+	if (inode->i_flock && mandatory_lock(inode)) {
+		ret = locks_mandatory_area(type == READ ? FLOCK_VERIFY_READ :
+					   FLOCK_VERIFY_WRITE, inode, backing,
+					   *ppos, count);
+		if (ret < 0)
+			return ret;
+	}
+	ret = security_file_permission(backing,
+				       type == READ ? MAY_READ : MAY_WRITE);
+	if (ret)
+		return ret;
+
+	init_sync_kiocb(&kiocb, backing);
+	kiocb.ki_pos = *ppos;
+	kiocb.ki_left = count;
+	kiocb.ki_nbytes = count;
+
+	if (type == READ)
+		ret = backing->f_op->aio_read(&kiocb, iov, nr_segs,
+					      kiocb.ki_pos);
+	else
+		ret = backing->f_op->aio_write(&kiocb, iov, nr_segs,
+					       kiocb.ki_pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	*ppos = kiocb.ki_pos;
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = fuse_passthrough_rw(READ, backing, iov, nr_segs, &pos);
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		fsnotify_access(backing);
+		iocb->ki_pos = pos;
+	}
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	struct inode *inode = file->f_mapping->host;
+	struct inode *backing_inode = backing->f_mapping->host;
+	const struct cred *old_cred;
+	loff_t start;
+	ssize_t ret;
+
+	mutex_lock(&inode->i_mutex);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	if (file->f_flags & O_APPEND)
+		pos = i_size_read(backing_inode);
+	start = pos;
+	ret = fuse_passthrough_rw(WRITE, backing, iov, nr_segs, &pos);
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		fsnotify_modify(backing);
+		iocb->ki_pos = pos;
+
+		/* keep our size in step and drop anything we had cached */
+		fuse_write_update_size(inode, pos);
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+					start >> PAGE_CACHE_SHIFT,
+					(pos - 1) >> PAGE_CACHE_SHIFT);
+		fuse_invalidate_attr(inode);
+	}
+
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	/* the mapping is of the backing file; mmap_region() picks it up */
+	get_file(backing);
+	vma->vm_file = backing;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = backing->f_op->mmap(backing, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		vma->vm_file = file;
+		fput(backing);
+		return ret;
+	}
+	fput(file);
+	return 0;
+}
@@ -424,6 +424,8 @@ static int yaffs_find_alloc_block(struct yaffs_dev *dev)
 			bi->block_state = YAFFS_BLOCK_STATE_ALLOCATING;
 			dev->seq_number++;
 			bi->seq_number = dev->seq_number;
+			if (dev->gc_stream_active)
+				dev->cold_seq = dev->seq_number;
 			dev->n_erased_blocks--;
 			yaffs_trace(YAFFS_TRACE_ALLOCATE,
 			  "Allocated block %d, seq  %d, %d left" ,
@@ -446,6 +448,31 @@ static int yaffs_alloc_chunk(struct yaffs_dev *dev, int use_reserver,
 	int ret_val;
 	struct yaffs_block_info *bi;
 
+	/* New writes must go to a block newer than any cold block.  The
+	 * cold stream never opens a block while a write block exists (see
+	 * yaffs_gc_stream_enter()), so this only catches a broken invariant.
+	 */
+	if (!dev->gc_stream_active && dev->alloc_block > 0 &&
+	    yaffs_get_block_info(dev, dev->alloc_block)->seq_number <
+	    dev->cold_seq) {
+		dev->n_hot_reopens++;
+		yaffs_skip_rest_of_block(dev);
+	}
+
+	/* The cold block filled up during gc: continue in the parked write
+	 * block, which is the newest block, instead of opening one that
+	 * would be newer than it.  New writes open a fresh block later.
+	 */
+	if (dev->alloc_block < 0 && dev->gc_stream_active &&
+	    dev->cold_block > 0) {
+		bi = yaffs_get_block_info(dev, dev->cold_block);
+		dev->alloc_block = dev->cold_block;
+		dev->alloc_page = dev->cold_page;
+		if (bi->seq_number > dev->cold_seq)
+			dev->cold_seq = bi->seq_number;
+		dev->cold_block = -1;
+	}
+
 	if (dev->alloc_block < 0) {
 		/* Get next block to allocate off */
 		dev->alloc_block = yaffs_find_alloc_block(dev);
@@ -504,6 +531,17 @@ static int yaffs_get_erased_chunks(struct yaffs_dev *dev)
 
 }
 
+/* Pages left in the cold block: only gc copies can be written there */
+static int yaffs_get_cold_chunks(struct yaffs_dev *dev)
+{
+	int block = dev->gc_stream_active ? dev->alloc_block : dev->cold_block;
+	u32 page = dev->gc_stream_active ? dev->alloc_page : dev->cold_page;
+
+	if (block > 0)
+		return dev->param.chunks_per_block - page;
+	return 0;
+}
+
 /*
  * yaffs_skip_rest_of_block() skips over the rest of the allocation block
  * if we don't want to write to it.
@@ -520,6 +558,96 @@ void yaffs_skip_rest_of_block(struct yaffs_dev *dev)
 	}
 }
 
+/*
+ * yaffs_skip_rest_of_cold_block() closes the cold block, eg. before a
+ * checkpoint, which only records the one allocation block.
+ */
+void yaffs_skip_rest_of_cold_block(struct yaffs_dev *dev)
+{
+	if (dev->cold_block > 0) {
+		struct yaffs_block_info *bi =
+		    yaffs_get_block_info(dev, dev->cold_block);
+		if (bi->block_state == YAFFS_BLOCK_STATE_ALLOCATING)
+			bi->block_state = YAFFS_BLOCK_STATE_FULL;
+	}
+	dev->cold_block = -1;
+}
+
+/*
+ * Chunks that survive garbage collection tend to be static, so gc copies
+ * are written to their own (cold) allocation block instead of being mixed
+ * in with new writes and copied again at the next gc.
+ *
+ * Scanning takes the copy of a chunk in the block with the highest
+ * sequence number as the current one, so the two streams must keep:
+ *  - the cold block newer than the block being collected. If it is not
+ *    the copies go to the normal allocation block as before;
+ *  - the normal allocation block newer than every cold block.  For that
+ *    the cold stream only opens an erased block when there is no write
+ *    block; otherwise it takes over the write block, which is always the
+ *    newest, and new writes open a fresh block.  No pages are skipped.
+ */
+static void yaffs_gc_stream_enter(struct yaffs_dev *dev,
+				  struct yaffs_block_info *victim,
+				  int whole_block)
+{
+	int tmp_block;
+	u32 tmp_page;
+	struct yaffs_block_info *bi;
+
+	if (!dev->param.is_yaffs2 || !dev->param.gc_cold_stream)
+		return;
+
+	if (dev->cold_block > 0) {
+		bi = yaffs_get_block_info(dev, dev->cold_block);
+		if (bi->seq_number <= victim->seq_number)
+			return;
+	} else if (dev->alloc_block > 0 &&
+		   yaffs_get_block_info(dev, dev->alloc_block)->seq_number >
+		   victim->seq_number) {
+		/* Hand the part used allocation block over to the cold
+		 * stream rather than start another one; new writes will
+		 * open a fresh block.
+		 */
+		bi = yaffs_get_block_info(dev, dev->alloc_block);
+		dev->cold_block = dev->alloc_block;
+		dev->cold_page = dev->alloc_page;
+		if (bi->seq_number > dev->cold_seq)
+			dev->cold_seq = bi->seq_number;
+		dev->alloc_block = -1;
+	} else if (whole_block) {
+		/* Short of erased blocks: don't take one for the cold stream */
+		return;
+	}
+
+	tmp_block = dev->alloc_block;
+	tmp_page = dev->alloc_page;
+	dev->alloc_block = dev->cold_block;
+	dev->alloc_page = dev->cold_page;
+	dev->cold_block = tmp_block;
+	dev->cold_page = tmp_page;
+
+	dev->gc_stream_active = 1;
+}
+
+static void yaffs_gc_stream_leave(struct yaffs_dev *dev)
+{
+	int tmp_block;
+	u32 tmp_page;
+
+	if (!dev->gc_stream_active)
+		return;
+
+	tmp_block = dev->alloc_block;
+	tmp_page = dev->alloc_page;
+	dev->alloc_block = dev->cold_block;
+	dev->alloc_page = dev->cold_page;
+	dev->cold_block = tmp_block;
+	dev->cold_page = tmp_page;
+
+	dev->gc_stream_active = 0;
+}
+
 static int yaffs_write_new_chunk(struct yaffs_dev *dev,
 				 const u8 * data,
 				 struct yaffs_ext_tags *tags, int use_reserver)
@@ -668,25 +796,62 @@ static void yaffs_retire_block(struct yaffs_dev *dev, int flash_block)
 
 /*---------------- Name handling functions ------------*/
 
-static u16 yaffs_calc_name_sum(const YCHAR * name)
+static u32 yaffs_calc_name_hash(const YCHAR * name)
 {
-	u16 sum = 0;
-	u16 i = 1;
+	u32 hash = 0;
+	int i = 0;
 
-	const YUCHAR *bname = (const YUCHAR *)name;
-	if (bname) {
-		while ((*bname) && (i < (YAFFS_MAX_NAME_LENGTH / 2))) {
-
-			/* 0x1f mask is case insensitive */
-			sum += ((*bname) & 0x1f) * i;
-			i++;
-			bname++;
-		}
+	while (name[i] && i < YAFFS_MAX_NAME_LENGTH) {
+		hash = hash * 31 + (YUCHAR) name[i];
+		i++;
 	}
-	return sum;
+	return hash;
 }
 
-void yaffs_set_obj_name(struct yaffs_obj *obj, const YCHAR * name)
+static inline struct list_head *yaffs_name_bucket(struct yaffs_dev *dev,
+						  struct yaffs_obj *dir,
+						  u32 hash)
+{
+	return &dev->name_bucket[(hash ^ dir->obj_id) &
+				 (YAFFS_NAME_BUCKETS - 1)];
+}
+
+/*
+ * Directory entries are looked up through a device wide hash keyed on
+ * the parent and the full name.  An object only goes into the hash once
+ * its name is known; until then (eg. lazy loaded after a checkpoint
+ * restore) it is counted in its directory's n_unhashed, and
+ * yaffs_find_by_name() walks the children to load and hash it.
+ */
+static void yaffs_hash_obj_name(struct yaffs_obj *obj, const YCHAR * name)
+{
+	struct yaffs_obj *parent = obj->parent;
+
+	if (parent && !obj->name_hashed)
+		parent->variant.dir_variant.n_unhashed--;
+
+	obj->name_hash = yaffs_calc_name_hash(name);
+	obj->name_hashed = 1;
+
+	list_del_init(&obj->name_link);
+	if (parent)
+		list_add(&obj->name_link,
+			 yaffs_name_bucket(obj->my_dev, parent,
+					   obj->name_hash));
+}
+
+static void yaffs_unhash_obj_name(struct yaffs_obj *obj)
+{
+	if (!obj->name_hashed)
+		return;
+
+	list_del_init(&obj->name_link);
+	obj->name_hashed = 0;
+	if (obj->parent)
+		obj->parent->variant.dir_variant.n_unhashed++;
+}
+
+static void yaffs_set_short_name(struct yaffs_obj *obj, const YCHAR * name)
 {
 #ifndef CONFIG_YAFFS_NO_SHORT_NAMES
 	memset(obj->short_name, 0, sizeof(obj->short_name));
@@ -697,23 +862,51 @@ void yaffs_set_obj_name(struct yaffs_obj *obj, const YCHAR * name)
 	else
 		obj->short_name[0] = _Y('\0');
 #endif
-	obj->sum = yaffs_calc_name_sum(name);
 }
 
-void yaffs_set_obj_name_from_oh(struct yaffs_obj *obj,
-				const struct yaffs_obj_hdr *oh)
+void yaffs_set_obj_name(struct yaffs_obj *obj, const YCHAR * name)
+{
+	yaffs_set_short_name(obj, name);
+
+	/* An empty name reads back as "objNNN", see yaffs_fix_null_name() */
+	if (name && name[0])
+		yaffs_hash_obj_name(obj, name);
+	else
+		yaffs_unhash_obj_name(obj);
+}
+
+/*
+ * Set an object's name from its header. Lazy loading passes hash_name = 0:
+ * it only fills in the short name and leaves hashing to
+ * yaffs_find_by_name(), so that loading an object never changes the name
+ * hash under a reader of it (see yaffs_find_by_name_cached()).
+ */
+static void yaffs_name_from_oh(struct yaffs_obj *obj,
+			       const struct yaffs_obj_hdr *oh, int hash_name)
 {
 #ifdef CONFIG_YAFFS_AUTO_UNICODE
 	YCHAR tmp_name[YAFFS_MAX_NAME_LENGTH + 1];
 	memset(tmp_name, 0, sizeof(tmp_name));
 	yaffs_load_name_from_oh(obj->my_dev, tmp_name, oh->name,
 				YAFFS_MAX_NAME_LENGTH + 1);
-	yaffs_set_obj_name(obj, tmp_name);
+	if (hash_name)
+		yaffs_set_obj_name(obj, tmp_name);
+	else
+		yaffs_set_short_name(obj, tmp_name);
 #else
-	yaffs_set_obj_name(obj, oh->name);
+	if (hash_name)
+		yaffs_set_obj_name(obj, oh->name);
+	else
+		yaffs_set_short_name(obj, oh->name);
 #endif
 }
 
+void yaffs_set_obj_name_from_oh(struct yaffs_obj *obj,
+				const struct yaffs_obj_hdr *oh)
+{
+	yaffs_name_from_oh(obj, oh, 1);
+}
+
 /*-------------------- TNODES -------------------
 
  * List of spare tnodes
@@ -1282,6 +1475,10 @@ static void yaffs_remove_obj_from_dir(struct yaffs_obj *obj)
 		dev->param.remove_obj_fn(obj);
 
 	list_del_init(&obj->siblings);
+	if (obj->name_hashed)
+		list_del_init(&obj->name_link);
+	else if (parent)
+		parent->variant.dir_variant.n_unhashed--;
 	obj->parent = NULL;
 
 	yaffs_verify_dir(parent);
@@ -1315,6 +1512,12 @@ void yaffs_add_obj_to_dir(struct yaffs_obj *directory, struct yaffs_obj *obj)
 	/* Now add it */
 	list_add(&obj->siblings, &directory->variant.dir_variant.children);
 	obj->parent = directory;
+	if (obj->name_hashed)
+		list_add(&obj->name_link,
+			 yaffs_name_bucket(obj->my_dev, directory,
+					   obj->name_hash));
+	else
+		directory->variant.dir_variant.n_unhashed++;
 
 	if (directory == obj->my_dev->unlinked_dir
 	    || directory == obj->my_dev->del_dir) {
@@ -1394,10 +1597,37 @@ static int yaffs_change_obj_name(struct yaffs_obj *obj,
  *   In Linux, the page cache provides read buffering and the short op cache 
  *   provides write buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   Cache entries are hashed on object and chunk id and kept on an LRU list
+ *   so that the cache can be made large (up to YAFFS_MAX_SHORT_OP_CACHES)
+ *   without making lookups and push-outs expensive.
  */
 
+static struct list_head *yaffs_cache_bucket(struct yaffs_dev *dev,
+					    const struct yaffs_obj *obj,
+					    int chunk_id)
+{
+	return &dev->cache_bucket[(obj->obj_id * 7 + chunk_id) &
+				  (YAFFS_CACHE_BUCKETS - 1)];
+}
+
+/* Give a cache entry to (obj, chunk_id) and make it findable */
+static void yaffs_cache_bind(struct yaffs_dev *dev, struct yaffs_cache *cache,
+			     struct yaffs_obj *obj, int chunk_id)
+{
+	cache->object = obj;
+	cache->chunk_id = chunk_id;
+	cache->dirty = 0;
+	cache->locked = 0;
+	list_move(&cache->hash_link, yaffs_cache_bucket(dev, obj, chunk_id));
+}
+
+static void yaffs_cache_unbind(struct yaffs_dev *dev, struct yaffs_cache *cache)
+{
+	cache->object = NULL;
+	cache->dirty = 0;
+	list_move(&cache->hash_link, &dev->cache_free);
+}
+
 static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 {
 	struct yaffs_dev *dev = obj->my_dev;
@@ -1414,53 +1644,60 @@ static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 	return 0;
 }
 
+static int yaffs_cache_chunk_cmp(const void *a, const void *b)
+{
+	const struct yaffs_cache *ca = *(const struct yaffs_cache **)a;
+	const struct yaffs_cache *cb = *(const struct yaffs_cache **)b;
+
+	return ca->chunk_id - cb->chunk_id;
+}
+
+/*
+ * Write back an object's dirty chunks as one batch, in chunk order, so that
+ * they land in consecutive chunks of the allocation block.
+ */
 static void yaffs_flush_file_cache(struct yaffs_obj *obj)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int lowest = -99;	/* Stop compiler whining. */
 	int i;
+	int n_wb = 0;
 	struct yaffs_cache *cache;
-	int chunk_written = 0;
+	int chunk_written = 1;
 	int n_caches = obj->my_dev->param.n_caches;
 
-	if (n_caches > 0) {
-		do {
-			cache = NULL;
-
-			/* Find the dirty cache for this object with the lowest chunk id. */
-			for (i = 0; i < n_caches; i++) {
-				if (dev->cache[i].object == obj &&
-				    dev->cache[i].dirty) {
-					if (!cache
-					    || dev->cache[i].chunk_id <
-					    lowest) {
-						cache = &dev->cache[i];
-						lowest = cache->chunk_id;
-					}
-				}
-			}
+	if (n_caches <= 0)
+		return;
 
-			if (cache && !cache->locked) {
-				/* Write it out and free it up */
+	for (i = 0; i < n_caches; i++) {
+		cache = &dev->cache[i];
+		if (cache->object == obj && cache->dirty && !cache->locked)
+			dev->cache_wb[n_wb++] = cache;
+	}
 
-				chunk_written =
-				    yaffs_wr_data_obj(cache->object,
-						      cache->chunk_id,
-						      cache->data,
-						      cache->n_bytes, 1);
-				cache->dirty = 0;
-				cache->object = NULL;
-			}
+	if (!n_wb)
+		return;
 
-		} while (cache && chunk_written > 0);
+	sort(dev->cache_wb, n_wb, sizeof(struct yaffs_cache *),
+	     yaffs_cache_chunk_cmp, NULL);
 
-		if (cache)
-			/* Hoosterman, disk full while writing cache out. */
-			yaffs_trace(YAFFS_TRACE_ERROR,
-				"yaffs tragedy: no space during cache write");
+	dev->n_cache_flushes++;
 
+	for (i = 0; i < n_wb && chunk_written > 0; i++) {
+		cache = dev->cache_wb[i];
+
+		/* Write it out and free it up */
+		chunk_written =
+		    yaffs_wr_data_obj(cache->object,
+				      cache->chunk_id,
+				      cache->data, cache->n_bytes, 1);
+		yaffs_cache_unbind(dev, cache);
+		dev->n_cache_flush_chunks++;
 	}
 
+	if (chunk_written <= 0)
+		/* Hoosterman, disk full while writing cache out. */
+		yaffs_trace(YAFFS_TRACE_ERROR,
+			"yaffs tragedy: no space during cache write");
 }
 
 /*yaffs_flush_whole_cache(dev)
@@ -1480,7 +1717,8 @@ void yaffs_flush_whole_cache(struct yaffs_dev *dev)
 	do {
 		obj = NULL;
 		for (i = 0; i < n_caches && !obj; i++) {
-			if (dev->cache[i].object && dev->cache[i].dirty)
+			if (dev->cache[i].object && dev->cache[i].dirty &&
+			    !dev->cache[i].locked)
 				obj = dev->cache[i].object;
 
 		}
@@ -1493,19 +1731,14 @@ void yaffs_flush_whole_cache(struct yaffs_dev *dev)
 
 /* Grab us a cache chunk for use.
  * First look for an empty one.
- * Then look for the least recently used non-dirty one.
- * Then look for the least recently used dirty one...., flush and look again.
+ * Then take the least recently used one, flushing its object first if it
+ * is dirty.
  */
 static struct yaffs_cache *yaffs_grab_chunk_worker(struct yaffs_dev *dev)
 {
-	int i;
-
-	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (!dev->cache[i].object)
-				return &dev->cache[i];
-		}
-	}
+	if (dev->param.n_caches > 0 && !list_empty(&dev->cache_free))
+		return list_first_entry(&dev->cache_free, struct yaffs_cache,
+					hash_link);
 
 	return NULL;
 }
@@ -1513,53 +1746,34 @@ static struct yaffs_cache *yaffs_grab_chunk_worker(struct yaffs_dev *dev)
 static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
 {
 	struct yaffs_cache *cache;
-	struct yaffs_obj *the_obj;
-	int usage;
-	int i;
-	int pushout;
-
-	if (dev->param.n_caches > 0) {
-		/* Try find a non-dirty one... */
-
-		cache = yaffs_grab_chunk_worker(dev);
+	struct yaffs_cache *lru;
 
-		if (!cache) {
-			/* They were all dirty, find the last recently used object and flush
-			 * its cache, then  find again.
-			 * NB what's here is not very accurate, we actually flush the object
-			 * the last recently used page.
-			 */
+	if (dev->param.n_caches <= 0)
+		return NULL;
 
-			/* With locking we can't assume we can use entry zero */
+	dev->cache_misses++;
 
-			the_obj = NULL;
-			usage = -1;
-			cache = NULL;
-			pushout = -1;
+	/* Try find a free one... */
+	cache = yaffs_grab_chunk_worker(dev);
+	if (cache)
+		return cache;
 
-			for (i = 0; i < dev->param.n_caches; i++) {
-				if (dev->cache[i].object &&
-				    !dev->cache[i].locked &&
-				    (dev->cache[i].last_use < usage
-				     || !cache)) {
-					usage = dev->cache[i].last_use;
-					the_obj = dev->cache[i].object;
-					cache = &dev->cache[i];
-					pushout = i;
-				}
-			}
+	/* ...else push out the least recently used one we can. */
+	cache = NULL;
+	list_for_each_entry(lru, &dev->cache_lru, lru_link) {
+		if (lru->object && !lru->locked) {
+			cache = lru;
+			break;
+		}
+	}
 
-			if (!cache || cache->dirty) {
-				/* Flush and try again */
-				yaffs_flush_file_cache(the_obj);
-				cache = yaffs_grab_chunk_worker(dev);
-			}
+	if (cache && cache->dirty) {
+		/* Flush the whole object, then find again */
+		yaffs_flush_file_cache(cache->object);
+		cache = yaffs_grab_chunk_worker(dev);
+	}
 
-		}
-		return cache;
-	} else {
-		return NULL;
-        }
+	return cache;
 }
 
 /* Find a cached chunk */
@@ -1567,14 +1781,17 @@ static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
 						  int chunk_id)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
+	struct yaffs_cache *cache;
+
 	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (dev->cache[i].object == obj &&
-			    dev->cache[i].chunk_id == chunk_id) {
+		list_for_each_entry(cache,
+				    yaffs_cache_bucket(dev, obj, chunk_id),
+				    hash_link) {
+			if (cache->object == obj &&
+			    cache->chunk_id == chunk_id) {
 				dev->cache_hits++;
 
-				return &dev->cache[i];
+				return cache;
 			}
 		}
 	}
@@ -1599,6 +1816,7 @@ static void yaffs_use_cache(struct yaffs_dev *dev, struct yaffs_cache *cache,
 		dev->cache_last_use++;
 
 		cache->last_use = dev->cache_last_use;
+		list_move_tail(&cache->lru_link, &dev->cache_lru);
 
 		if (is_write)
 			cache->dirty = 1;
@@ -1616,7 +1834,7 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
 		    yaffs_find_chunk_cache(object, chunk_id);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_cache_unbind(object->my_dev, cache);
 	}
 }
 
@@ -1632,7 +1850,7 @@ static void yaffs_invalidate_whole_cache(struct yaffs_obj *in)
 		/* Invalidate it. */
 		for (i = 0; i < dev->param.n_caches; i++) {
 			if (dev->cache[i].object == in)
-				dev->cache[i].object = NULL;
+				yaffs_cache_unbind(dev, &dev->cache[i]);
 		}
 	}
 }
@@ -1856,6 +2074,7 @@ static struct yaffs_obj *yaffs_alloc_empty_obj(struct yaffs_dev *dev)
 		obj->variant_type = YAFFS_OBJECT_TYPE_UNKNOWN;
 		INIT_LIST_HEAD(&(obj->hard_links));
 		INIT_LIST_HEAD(&(obj->hash_link));
+		INIT_LIST_HEAD(&obj->name_link);
 		INIT_LIST_HEAD(&obj->siblings);
 
 		/* Now make the directory sane */
@@ -1863,6 +2082,7 @@ static struct yaffs_obj *yaffs_alloc_empty_obj(struct yaffs_dev *dev)
 			obj->parent = dev->root_dir;
 			list_add(&(obj->siblings),
 				 &dev->root_dir->variant.dir_variant.children);
+			dev->root_dir->variant.dir_variant.n_unhashed++;
 		}
 
 		/* Add it to the lost and found directory.
@@ -2010,6 +2230,7 @@ struct yaffs_obj *yaffs_new_obj(struct yaffs_dev *dev, int number,
 		case YAFFS_OBJECT_TYPE_DIRECTORY:
 			INIT_LIST_HEAD(&the_obj->variant.dir_variant.children);
 			INIT_LIST_HEAD(&the_obj->variant.dir_variant.dirty);
+			the_obj->variant.dir_variant.n_unhashed = 0;
 			break;
 		case YAFFS_OBJECT_TYPE_SYMLINK:
 		case YAFFS_OBJECT_TYPE_HARDLINK:
@@ -2060,6 +2281,11 @@ static void yaffs_init_tnodes_and_objs(struct yaffs_dev *dev)
 		INIT_LIST_HEAD(&dev->obj_bucket[i].list);
 		dev->obj_bucket[i].count = 0;
 	}
+
+	if (dev->name_bucket) {
+		for (i = 0; i < YAFFS_NAME_BUCKETS; i++)
+			INIT_LIST_HEAD(&dev->name_bucket[i]);
+	}
 }
 
 struct yaffs_obj *yaffs_find_or_create_by_number(struct yaffs_dev *dev,
@@ -2306,6 +2532,9 @@ static int yaffs_init_blocks(struct yaffs_dev *dev)
 	dev->chunk_bits = NULL;
 
 	dev->alloc_block = -1;	/* force it to get a new one */
+	dev->cold_block = -1;
+	dev->cold_seq = 0;
+	dev->gc_stream_active = 0;
 
 	/* If the first allocation strategy fails, thry the alternate one */
 	dev->block_info =
@@ -2489,6 +2718,8 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 		max_copies = (whole_block) ? dev->param.chunks_per_block : 5;
 		old_chunk = block * dev->param.chunks_per_block + dev->gc_chunk;
 
+		yaffs_gc_stream_enter(dev, bi, whole_block);
+
 		for ( /* init already done */ ;
 		     ret_val == YAFFS_OK &&
 		     dev->gc_chunk < dev->param.chunks_per_block &&
@@ -2593,6 +2824,8 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 					tags.serial_number++;
 
 					dev->n_gc_copies++;
+					if (dev->gc_stream_active)
+						dev->n_cold_copies++;
 
 					if (tags.chunk_id == 0) {
 						/* It is an object Id,
@@ -2667,6 +2900,8 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 			}
 		}
 
+		yaffs_gc_stream_leave(dev);
+
 		yaffs_release_temp_buffer(dev, buffer, __LINE__);
 
 	}
@@ -2682,7 +2917,11 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 	} else {
 		/* The gc completed. */
 		/* Do any required cleanups */
-		for (i = 0; i < dev->n_clean_ups; i++) {
+		if (dev->param.defered_gc_cleanup && dev->n_clean_ups > 0)
+			dev->gc_cleanup_pending = 1;	/* see yaffs_gc_cleanup() */
+
+		for (i = 0; i < dev->n_clean_ups &&
+		     !dev->param.defered_gc_cleanup; i++) {
 			/* Time to delete the file too */
 			object =
 			    yaffs_find_by_number(dev, dev->gc_cleanup_list[i]);
@@ -2715,6 +2954,26 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 	return ret_val;
 }
 
+/*
+ * Cost-benefit score of collecting a block: the space reclaimed weighted
+ * by how long the data has been left alone, over the cost of reading and
+ * copying the live chunks. Old, mostly-dead blocks score highest; a
+ * recently written block is left to die off some more.
+ */
+static u32 yaffs_gc_score(struct yaffs_dev *dev, struct yaffs_block_info *bi,
+			  int pages_used)
+{
+	u32 age = 1;
+
+	if (dev->param.is_yaffs2 && dev->seq_number > bi->seq_number)
+		age += dev->seq_number - bi->seq_number;
+	if (age > 4096)
+		age = 4096;
+
+	return ((dev->param.chunks_per_block - pages_used) * 256 * age) /
+	    (dev->param.chunks_per_block + pages_used);
+}
+
 /*
  * FindBlockForgarbageCollection is used to select the dirtiest block (or close enough)
  * for garbage collection.
@@ -2771,6 +3030,7 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 	if (!selected) {
 		int pages_used;
+		u32 score;
 		int n_blocks =
 		    dev->internal_end_block - dev->internal_start_block + 1;
 		if (aggressive) {
@@ -2812,13 +3072,19 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 			pages_used = bi->pages_in_use - bi->soft_del_pages;
 
-			if (bi->block_state == YAFFS_BLOCK_STATE_FULL &&
-			    pages_used < dev->param.chunks_per_block &&
-			    (dev->gc_dirtiest < 1
-			     || pages_used < dev->gc_pages_in_use)
-			    && yaffs_block_ok_for_gc(dev, bi)) {
+			if (bi->block_state != YAFFS_BLOCK_STATE_FULL ||
+			    pages_used >= dev->param.chunks_per_block ||
+			    pages_used > threshold)
+				continue;
+
+			score = yaffs_gc_score(dev, bi, pages_used);
+
+			if ((dev->gc_dirtiest < 1 ||
+			     score > dev->gc_dirtiest_score) &&
+			    yaffs_block_ok_for_gc(dev, bi)) {
 				dev->gc_dirtiest = dev->gc_block_finder;
 				dev->gc_pages_in_use = pages_used;
+				dev->gc_dirtiest_score = score;
 			}
 		}
 
@@ -2974,6 +3240,49 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 	return aggressive ? gc_ok : YAFFS_OK;
 }
 
+/*
+ * yaffs_gc_cleanup() deletes the soft deleted files whose last data chunks
+ * were thrown away by the gc. With param.defered_gc_cleanup set the gc only
+ * flags them and the OS layer calls this when nothing else can be looking
+ * at the object hash or the directories, since freeing an object changes
+ * both. Such files live in the unlinked and deleted directories.
+ */
+static void yaffs_gc_cleanup_dir(struct yaffs_dev *dev,
+				 struct yaffs_obj *dir)
+{
+	struct list_head *i;
+	struct list_head *n;
+	struct yaffs_obj *obj;
+
+	if (!dir)
+		return;
+
+	list_for_each_safe(i, n, &dir->variant.dir_variant.children) {
+		obj = list_entry(i, struct yaffs_obj, siblings);
+		if (obj->variant_type != YAFFS_OBJECT_TYPE_FILE ||
+		    !obj->deleted || !obj->soft_del || obj->n_data_chunks > 0)
+			continue;
+
+		yaffs_free_tnode(dev, obj->variant.file_variant.top);
+		obj->variant.file_variant.top = NULL;
+		yaffs_trace(YAFFS_TRACE_GC,
+			"yaffs: About to finally delete object %d",
+			obj->obj_id);
+		yaffs_generic_obj_del(obj);
+		dev->n_deleted_files--;
+	}
+}
+
+void yaffs_gc_cleanup(struct yaffs_dev *dev)
+{
+	if (!dev->gc_cleanup_pending)
+		return;
+
+	dev->gc_cleanup_pending = 0;
+	yaffs_gc_cleanup_dir(dev, dev->unlinked_dir);
+	yaffs_gc_cleanup_dir(dev, dev->del_dir);
+}
+
 /*
  * yaffs_bg_gc()
  * Garbage collects. Intended to be called from a background thread.
@@ -3256,7 +3565,12 @@ int yaffs_list_xattrib(struct yaffs_obj *obj, char *buffer, int size)
 	return yaffs_do_xattrib_fetch(obj, NULL, buffer, size);
 }
 
-static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
+/*
+ * Load the details of a lazy loaded object from its header. lazy_loaded is
+ * only cleared once everything is in place: the OS layer may look at an
+ * object that is not lazy loaded without excluding this.
+ */
+static void yaffs_load_obj_details(struct yaffs_obj *in, int hash_name)
 {
 	u8 *chunk_data;
 	struct yaffs_obj_hdr *oh;
@@ -3271,7 +3585,6 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 	dev = in->my_dev;
 
 	if (in->lazy_loaded && in->hdr_chunk > 0) {
-		in->lazy_loaded = 0;
 		chunk_data = yaffs_get_temp_buffer(dev, __LINE__);
 
 		result =
@@ -3281,7 +3594,7 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 
 		in->yst_mode = oh->yst_mode;
 		yaffs_load_attribs(in, oh);
-		yaffs_set_obj_name_from_oh(in, oh);
+		yaffs_name_from_oh(in, oh, hash_name);
 
 		if (in->variant_type == YAFFS_OBJECT_TYPE_SYMLINK) {
 			in->variant.symlink_variant.alias =
@@ -3291,9 +3604,17 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 		}
 
 		yaffs_release_temp_buffer(dev, chunk_data, __LINE__);
+
+		smp_wmb();
+		in->lazy_loaded = 0;
 	}
 }
 
+static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
+{
+	yaffs_load_obj_details(in, 0);
+}
+
 static void yaffs_load_name_from_oh(struct yaffs_dev *dev, YCHAR * name,
 				    const YCHAR * oh_name, int buff_size)
 {
@@ -3581,10 +3902,7 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 				if (!cache) {
 					cache =
 					    yaffs_grab_chunk_cache(in->my_dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					yaffs_cache_bind(dev, cache, in, chunk);
 					yaffs_rd_data_obj(in, chunk,
 							  cache->data);
 					cache->n_bytes = 0;
@@ -3707,10 +4025,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 * buffer, loff_t offset,
 				if (!cache
 				    && yaffs_check_alloc_available(dev, 1)) {
 					cache = yaffs_grab_chunk_cache(dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					yaffs_cache_bind(dev, cache, in, chunk);
 					yaffs_rd_data_obj(in, chunk,
 							  cache->data);
 				} else if (cache &&
@@ -4469,12 +4784,13 @@ static void yaffs_empty_l_n_f(struct yaffs_dev *dev)
 struct yaffs_obj *yaffs_find_by_name(struct yaffs_obj *directory,
 				     const YCHAR * name)
 {
-	int sum;
+	u32 hash;
 
 	struct list_head *i;
 	YCHAR buffer[YAFFS_MAX_NAME_LENGTH + 1];
 
 	struct yaffs_obj *l;
+	struct yaffs_dev *dev;
 
 	if (!name)
 		return NULL;
@@ -4493,38 +4809,108 @@ struct yaffs_obj *yaffs_find_by_name(struct yaffs_obj *directory,
 		YBUG();
 	}
 
-	sum = yaffs_calc_name_sum(name);
+	dev = directory->my_dev;
+	dev->n_name_lookups++;
 
-	list_for_each(i, &directory->variant.dir_variant.children) {
-		if (i) {
+	/* First hash in any children whose names have not been loaded */
+	if (directory->variant.dir_variant.n_unhashed > 0) {
+		dev->n_name_walks++;
+		list_for_each(i, &directory->variant.dir_variant.children) {
 			l = list_entry(i, struct yaffs_obj, siblings);
 
 			if (l->parent != directory)
 				YBUG();
 
-			yaffs_check_obj_details_loaded(l);
+			if (l->name_hashed)
+				continue;
 
-			/* Special case for lost-n-found */
-			if (l->obj_id == YAFFS_OBJECTID_LOSTNFOUND) {
-				if (!strcmp(name, YAFFS_LOSTNFOUND_NAME))
-					return l;
-			} else if (l->sum == sum
-				   || l->hdr_chunk <= 0) {
-				/* LostnFound chunk called Objxxx
-				 * Do a real check
+			yaffs_load_obj_details(l, 1);
+			if (!l->name_hashed) {
+				/* lost+found, or LostnFound chunk called
+				 * Objxxx: hash the name it reads back as
 				 */
 				yaffs_get_obj_name(l, buffer,
 						   YAFFS_MAX_NAME_LENGTH + 1);
-				if (strncmp
-				    (name, buffer, YAFFS_MAX_NAME_LENGTH) == 0)
-					return l;
+				yaffs_hash_obj_name(l, buffer);
 			}
 		}
 	}
 
+	hash = yaffs_calc_name_hash(name);
+
+	list_for_each(i, yaffs_name_bucket(dev, directory, hash)) {
+		l = list_entry(i, struct yaffs_obj, name_link);
+
+		if (l->parent != directory || l->name_hash != hash)
+			continue;
+
+		dev->n_name_compares++;
+		yaffs_get_obj_name(l, buffer, YAFFS_MAX_NAME_LENGTH + 1);
+		if (strncmp(name, buffer, YAFFS_MAX_NAME_LENGTH) == 0)
+			return l;
+	}
+
 	return NULL;
 }
 
+/*
+ * yaffs_find_by_name_cached() is the part of yaffs_find_by_name() that can
+ * be answered from RAM: every child of the directory is hashed and every
+ * candidate's name is held as a short name. It changes nothing, so the OS
+ * layer may call it while the allocator and gc are running elsewhere, as
+ * long as nothing is adding, removing or renaming objects.
+ *
+ * Returns 1 with *found set (NULL if there is no such name), or 0 if the
+ * answer needs NAND access and yaffs_find_by_name() must be used instead.
+ * Hard links are resolved to the equivalent object.
+ */
+int yaffs_find_by_name_cached(struct yaffs_obj *directory,
+			      const YCHAR * name, struct yaffs_obj **found)
+{
+#ifdef CONFIG_YAFFS_NO_SHORT_NAMES
+	return 0;
+#else
+	u32 hash;
+	struct list_head *i;
+	struct yaffs_obj *l;
+	struct yaffs_obj *equiv;
+
+	*found = NULL;
+
+	if (!name || !directory ||
+	    directory->variant_type != YAFFS_OBJECT_TYPE_DIRECTORY ||
+	    directory->variant.dir_variant.n_unhashed > 0)
+		return 0;
+
+	hash = yaffs_calc_name_hash(name);
+
+	list_for_each(i, yaffs_name_bucket(directory->my_dev, directory, hash)) {
+		l = list_entry(i, struct yaffs_obj, name_link);
+
+		if (l->parent != directory || l->name_hash != hash)
+			continue;
+
+		if (l->lazy_loaded || l->obj_id == YAFFS_OBJECTID_LOSTNFOUND ||
+		    !l->short_name[0])
+			return 0;
+
+		if (strncmp(name, l->short_name, YAFFS_MAX_NAME_LENGTH) == 0) {
+			*found = l;
+			break;
+		}
+	}
+
+	if (*found && (*found)->variant_type == YAFFS_OBJECT_TYPE_HARDLINK) {
+		equiv = (*found)->variant.hardlink_variant.equiv_obj;
+		if (!equiv || equiv->lazy_loaded)
+			return 0;
+		*found = equiv;
+	}
+
+	return 1;
+#endif
+}
+
 /* GetEquivalentObject dereferences any hard links to get to the
  * actual object.
  */
@@ -4764,6 +5150,7 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	int init_failed = 0;
 	unsigned x;
 	int bits;
+	unsigned long mount_start = jiffies;
 
 	yaffs_trace(YAFFS_TRACE_TRACING, "yaffs: yaffs_guts_initialise()" );
 
@@ -4780,6 +5167,11 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->internal_end_block = dev->param.end_block;
 	dev->block_offset = 0;
 	dev->chunk_offset = 0;
+
+	dev->n_scan_blocks = 0;
+	dev->n_scan_batched = 0;
+	dev->scan_ms = 0;
+
 	dev->n_free_chunks = 0;
 
 	dev->gc_block = 0;
@@ -4939,20 +5331,33 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		init_failed = 1;
 
 	dev->cache = NULL;
+	dev->cache_wb = NULL;
 	dev->gc_cleanup_list = NULL;
+	dev->gc_cleanup_pending = 0;
+
+	INIT_LIST_HEAD(&dev->cache_free);
+	INIT_LIST_HEAD(&dev->cache_lru);
+	for (x = 0; x < YAFFS_CACHE_BUCKETS; x++)
+		INIT_LIST_HEAD(&dev->cache_bucket[x]);
 
 	if (!init_failed && dev->param.n_caches > 0) {
 		int i;
 		void *buf;
-		int cache_bytes =
-		    dev->param.n_caches * sizeof(struct yaffs_cache);
+		int cache_bytes;
 
 		if (dev->param.n_caches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->param.n_caches = YAFFS_MAX_SHORT_OP_CACHES;
 
+		cache_bytes = dev->param.n_caches * sizeof(struct yaffs_cache);
+
 		dev->cache = kmalloc(cache_bytes, GFP_NOFS);
+		dev->cache_wb = kmalloc(dev->param.n_caches *
+					sizeof(struct yaffs_cache *),
+					GFP_NOFS);
 
 		buf = (u8 *) dev->cache;
+		if (!dev->cache_wb)
+			buf = NULL;
 
 		if (dev->cache)
 			memset(dev->cache, 0, cache_bytes);
@@ -4961,6 +5366,10 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 			dev->cache[i].object = NULL;
 			dev->cache[i].last_use = 0;
 			dev->cache[i].dirty = 0;
+			list_add_tail(&dev->cache[i].hash_link,
+				      &dev->cache_free);
+			list_add_tail(&dev->cache[i].lru_link,
+				      &dev->cache_lru);
 			dev->cache[i].data = buf =
 			    kmalloc(dev->param.total_bytes_per_chunk, GFP_NOFS);
 		}
@@ -4971,6 +5380,9 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	}
 
 	dev->cache_hits = 0;
+	dev->cache_misses = 0;
+	dev->n_cache_flushes = 0;
+	dev->n_cache_flush_chunks = 0;
 
 	if (!init_failed) {
 		dev->gc_cleanup_list =
@@ -4980,6 +5392,15 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 			init_failed = 1;
 	}
 
+	dev->name_bucket = NULL;
+	if (!init_failed) {
+		dev->name_bucket =
+		    kmalloc(YAFFS_NAME_BUCKETS * sizeof(struct list_head),
+			    GFP_NOFS);
+		if (!dev->name_bucket)
+			init_failed = 1;
+	}
+
 	if (dev->param.is_yaffs2)
 		dev->param.use_header_file_size = 1;
 
@@ -5056,6 +5477,16 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 
 	dev->n_retired_blocks = 0;
 
+	dev->n_name_lookups = 0;
+	dev->n_name_compares = 0;
+	dev->n_name_walks = 0;
+	dev->n_timed_lookups = 0;
+	dev->name_lookup_ns = 0;
+	dev->name_lookup_max_ns = 0;
+
+	dev->n_cold_copies = 0;
+	dev->n_hot_reopens = 0;
+
 	yaffs_verify_free_chunks(dev);
 	yaffs_verify_blocks(dev);
 
@@ -5063,8 +5494,10 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	if (!dev->is_checkpointed && dev->blocks_in_checkpt > 0)
 		yaffs2_checkpt_invalidate(dev);
 
-	yaffs_trace(YAFFS_TRACE_TRACING,
-	  "yaffs: yaffs_guts_initialise() done.");
+	dev->mount_ms = jiffies_to_msecs(jiffies - mount_start);
+
+	yaffs_trace(YAFFS_TRACE_TRACING | YAFFS_TRACE_MOUNT,
+	  "yaffs: yaffs_guts_initialise() done in %u ms.", dev->mount_ms);
 	return YAFFS_OK;
 
 }
@@ -5087,8 +5520,12 @@ void yaffs_deinitialise(struct yaffs_dev *dev)
 			kfree(dev->cache);
 			dev->cache = NULL;
 		}
+		kfree(dev->cache_wb);
+		dev->cache_wb = NULL;
 
 		kfree(dev->gc_cleanup_list);
+		kfree(dev->name_bucket);
+		dev->name_bucket = NULL;
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
 			kfree(dev->temp_buffer[i].buffer);
@@ -5139,6 +5576,9 @@ int yaffs_get_n_free_chunks(struct yaffs_dev *dev)
 	n_free = dev->n_free_chunks;
 	n_free += dev->n_deleted_files;
 
+	/* normal writes cannot use what is left in the cold block */
+	n_free -= yaffs_get_cold_chunks(dev);
+
 	/* Now count the number of dirty chunks in the cache and subtract those */
 
 	for (n_dirty_caches = 0, i = 0; i < dev->param.n_caches; i++) {
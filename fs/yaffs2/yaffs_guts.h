@@ -56,6 +56,7 @@
 #define YAFFS_ALLOCATION_NLINKS		100
 
 #define YAFFS_NOBJECT_BUCKETS		256
+#define YAFFS_NAME_BUCKETS		1024	/* power of 2 */
 
 #define YAFFS_OBJECT_SPACE		0x40000
 #define YAFFS_MAX_OBJECT_ID		(YAFFS_OBJECT_SPACE -1)
@@ -83,7 +84,8 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	256
+#define YAFFS_CACHE_BUCKETS		64	/* Must be a power of 2 */
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -108,6 +110,8 @@
 
 /* ChunkCache is used for short read/write operations.*/
 struct yaffs_cache {
+	struct list_head hash_link;	/* In a cache bucket, or cache_free */
+	struct list_head lru_link;	/* In cache_lru, least recently used first */
 	struct yaffs_obj *object;
 	int chunk_id;
 	int last_use;
@@ -357,6 +361,7 @@ struct yaffs_file_var {
 struct yaffs_dir_var {
 	struct list_head children;	/* list of child links */
 	struct list_head dirty;	/* Entry for list of dirty directories */
+	int n_unhashed;		/* children not in the name hash yet */
 };
 
 struct yaffs_symlink_var {
@@ -398,13 +403,15 @@ struct yaffs_obj {
 
 	u8 xattr_known:1;	/* We know if this has object has xattribs or not. */
 	u8 has_xattr:1;		/* This object has xattribs. Valid if xattr_known. */
+	u8 name_hashed:1;	/* name_hash is valid and name_link is in use. */
 
 	u8 serial;		/* serial number of chunk in NAND. Cached here */
-	u16 sum;		/* sum of the name to speed searching */
+	u32 name_hash;		/* hash of the name to speed searching */
 
 	struct yaffs_dev *my_dev;	/* The device I'm on */
 
 	struct list_head hash_link;	/* list of objects in this hash bucket */
+	struct list_head name_link;	/* list of objects in this name bucket */
 
 	struct list_head hard_links;	/* all the equivalent hard linked objects */
 
@@ -547,6 +554,12 @@ struct yaffs_param {
 	int (*query_block_fn) (struct yaffs_dev * dev, int block_no,
 			       enum yaffs_block_state * state,
 			       u32 * seq_number);
+	/* Optional: read the tags of n_chunks consecutive chunks in one go.
+	 * Must only return YAFFS_OK if every chunk read back cleanly.
+	 */
+	int (*read_block_tags_fn) (struct yaffs_dev * dev,
+				   int nand_chunk, int n_chunks,
+				   struct yaffs_ext_tags * tags);
 #endif
 
 	/* The remove_obj_fn function must be supplied by OS flavours that
@@ -569,11 +582,13 @@ struct yaffs_param {
 	int disable_soft_del;	/* yaffs 1 only: Set to disable the use of softdeletion. */
 
 	int defered_dir_update;	/* Set to defer directory updates */
+	int defered_gc_cleanup;	/* Leave files emptied by gc for yaffs_gc_cleanup() */
 
 #ifdef CONFIG_YAFFS_AUTO_UNICODE
 	int auto_unicode;
 #endif
 	int always_check_erased;	/* Force chunk erased check always on */
+	int gc_cold_stream;	/* yaffs2: copy gc survivors to their own block */
 };
 
 struct yaffs_dev {
@@ -646,6 +661,12 @@ struct yaffs_dev {
 	u32 alloc_page;
 	int alloc_block_finder;	/* Used to search for next allocation block */
 
+	/* Cold stream: block that gc copies are written to */
+	int cold_block;
+	u32 cold_page;
+	u32 cold_seq;		/* Highest sequence number given to a cold block */
+	unsigned gc_stream_active:1;	/* gc is allocating from the cold block */
+
 	/* Object and Tnode memory management */
 	void *allocator;
 	int n_obj;
@@ -656,17 +677,22 @@ struct yaffs_dev {
 	struct yaffs_obj_bucket obj_bucket[YAFFS_NOBJECT_BUCKETS];
 	u32 bucket_finder;
 
+	/* Directory entries, hashed on parent and name */
+	struct list_head *name_bucket;
+
 	int n_free_chunks;
 
 	/* Garbage collection control */
 	u32 *gc_cleanup_list;	/* objects to delete at the end of a GC. */
 	u32 n_clean_ups;
+	int gc_cleanup_pending;	/* Defered clean ups waiting for yaffs_gc_cleanup() */
 
 	unsigned has_pending_prioritised_gc;	/* We think this device might have pending prioritised gcs */
 	unsigned gc_disable;
 	unsigned gc_block_finder;
 	unsigned gc_dirtiest;
 	unsigned gc_pages_in_use;
+	u32 gc_dirtiest_score;
 	unsigned gc_not_done;
 	unsigned gc_block;
 	unsigned gc_chunk;
@@ -686,6 +712,10 @@ struct yaffs_dev {
 
 	struct yaffs_cache *cache;
 	int cache_last_use;
+	struct list_head cache_bucket[YAFFS_CACHE_BUCKETS];
+	struct list_head cache_free;
+	struct list_head cache_lru;
+	struct yaffs_cache **cache_wb;	/* Scratch list for write-back */
 
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted files live. */
@@ -723,6 +753,8 @@ struct yaffs_dev {
 	u32 passive_gc_count;
 	u32 oldest_dirty_gc_count;
 	u32 n_gc_blocks;
+	u32 n_cold_copies;	/* gc copies written to the cold stream */
+	u32 n_hot_reopens;	/* write blocks closed early; expected to stay 0 */
 	u32 bg_gcs;
 	u32 n_retired_writes;
 	u32 n_retired_blocks;
@@ -734,6 +766,19 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 cache_misses;
+	u32 n_cache_flushes;	/* Write-back batches */
+	u32 n_cache_flush_chunks;	/* Chunks written back by them */
+	u32 n_name_lookups;
+	u32 n_name_compares;	/* entries looked at by name lookups */
+	u32 n_name_walks;	/* lookups that had to load unhashed entries */
+	u32 n_timed_lookups;	/* VFS lookups, timed for benchmarking */
+	u64 name_lookup_ns;	/* total time they spent finding the name */
+	u32 name_lookup_max_ns;
+	u32 n_scan_blocks;	/* blocks read by the last mount scan */
+	u32 n_scan_batched;	/* of which read with a single batched request */
+	u32 scan_ms;		/* time spent in the last mount scan */
+	u32 mount_ms;		/* time spent in the last yaffs_guts_initialise() */
 
 };
 
@@ -823,6 +868,8 @@ struct yaffs_obj *yaffs_create_dir(struct yaffs_obj *parent, const YCHAR * name,
 struct yaffs_obj *yaffs_find_by_name(struct yaffs_obj *the_dir,
 				     const YCHAR * name);
 struct yaffs_obj *yaffs_find_by_number(struct yaffs_dev *dev, u32 number);
+int yaffs_find_by_name_cached(struct yaffs_obj *the_dir, const YCHAR * name,
+			      struct yaffs_obj **found);
 
 /* Link operations */
 struct yaffs_obj *yaffs_link_obj(struct yaffs_obj *parent, const YCHAR * name,
@@ -857,6 +904,7 @@ void yaffs_handle_defered_free(struct yaffs_obj *obj);
 void yaffs_update_dirty_dirs(struct yaffs_dev *dev);
 
 int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency);
+void yaffs_gc_cleanup(struct yaffs_dev *dev);
 
 /* Debug dump  */
 int yaffs_dump_obj(struct yaffs_obj *obj);
@@ -901,6 +949,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 * buffer, loff_t offset,
 		     int n_bytes, int write_trhrough);
 void yaffs_resize_file_down(struct yaffs_obj *obj, loff_t new_size);
 void yaffs_skip_rest_of_block(struct yaffs_dev *dev);
+void yaffs_skip_rest_of_cold_block(struct yaffs_dev *dev);
 
 int yaffs_count_free_chunks(struct yaffs_dev *dev);
 
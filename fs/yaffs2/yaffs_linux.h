@@ -24,14 +24,20 @@ struct yaffs_linux_context {
 	struct super_block *super;
 	struct task_struct *bg_thread;	/* Background thread for this device */
 	int bg_running;
-	struct mutex gross_lock;	/* Gross locking mutex*/
+	struct rw_semaphore gross_lock;	/* Object tree: held for write to change it */
+	struct mutex alloc_lock;	/* Allocator, gc, cache and NAND, under gross_lock read */
+	spinlock_t stats_lock;	/* Lock and lookup counters */
+	atomic_t lock_waiters;	/* Tasks blocked on either lock */
+	u32 n_lock_waits;	/* Contended lock acquisitions */
+	u32 lock_wait_ms;	/* Total time spent waiting */
+	u32 lock_wait_max_us;	/* Longest single wait */
+	u32 n_bg_deferrals;	/* Background passes skipped for waiters */
 	u8 *spare_buffer;	/* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
 				 */
 	struct list_head search_contexts;
 	void (*put_super_fn) (struct super_block * sb);
 
-	struct task_struct *readdir_process;
 	unsigned mount_id;
 };
 
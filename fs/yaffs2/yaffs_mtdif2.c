@@ -165,6 +165,61 @@ int nandmtd2_read_chunk_tags(struct yaffs_dev *dev, int nand_chunk,
 		return YAFFS_FAIL;
 }
 
+/*
+ * Read the tags of n_chunks consecutive chunks with one OOB-only request.
+ * Only a completely clean read is reported as success: the caller re-reads
+ * chunk by chunk on anything else so that ECC events can be attributed.
+ */
+int nandmtd2_read_block_tags(struct yaffs_dev *dev, int nand_chunk,
+			     int n_chunks, struct yaffs_ext_tags *tags)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	struct mtd_oob_ops ops;
+	struct yaffs_packed_tags2 pt;
+	u8 *oob;
+	int retval;
+	int i;
+
+	loff_t addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
+
+	int packed_tags_size =
+	    dev->param.no_tags_ecc ? sizeof(pt.t) : sizeof(pt);
+	void *packed_tags_ptr =
+	    dev->param.no_tags_ecc ? (void *)&pt.t : (void *)&pt;
+
+	yaffs_trace(YAFFS_TRACE_MTD,
+		"nandmtd2_read_block_tags chunk %d count %d",
+		nand_chunk, n_chunks);
+
+	if (dev->param.inband_tags || packed_tags_size > mtd->oobavail)
+		return YAFFS_FAIL;
+
+	oob = kmalloc(n_chunks * mtd->oobavail, GFP_NOFS);
+	if (!oob)
+		return YAFFS_FAIL;
+
+	ops.mode = MTD_OOB_AUTO;
+	ops.ooblen = n_chunks * mtd->oobavail;
+	ops.len = ops.ooblen;
+	ops.ooboffs = 0;
+	ops.datbuf = NULL;
+	ops.oobbuf = oob;
+	retval = mtd->read_oob(mtd, addr, &ops);
+
+	if (retval == 0) {
+		for (i = 0; i < n_chunks; i++) {
+			memcpy(packed_tags_ptr, &oob[i * mtd->oobavail],
+			       packed_tags_size);
+			yaffs_unpack_tags2(&tags[i], &pt,
+					   !dev->param.no_tags_ecc);
+		}
+	}
+
+	kfree(oob);
+
+	return retval == 0 ? YAFFS_OK : YAFFS_FAIL;
+}
+
 int nandmtd2_mark_block_bad(struct yaffs_dev *dev, int block_no)
 {
 	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
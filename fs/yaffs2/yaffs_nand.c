@@ -50,6 +50,57 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 	return result;
 }
 
+/*
+ * Read the tags of a whole block with a single request, if the driver can.
+ * This touches no device state, so the scanner may run it on another
+ * thread while it processes the previous block.
+ */
+int yaffs_rd_block_tags_batch(struct yaffs_dev *dev, int block,
+			      struct yaffs_ext_tags *tags)
+{
+	int n_chunks = dev->param.chunks_per_block;
+
+	if (!dev->param.read_block_tags_fn)
+		return YAFFS_FAIL;
+
+	return dev->param.read_block_tags_fn(dev,
+					     block * n_chunks -
+					     dev->chunk_offset, n_chunks,
+					     tags);
+}
+
+/*
+ * Complete the tags read of a block for the scanner. If the batched read
+ * did not come back clean the block is read again chunk by chunk so that
+ * any ECC event is accounted against the right chunk.
+ */
+int yaffs_rd_block_tags_nand(struct yaffs_dev *dev, int block,
+			     struct yaffs_ext_tags *tags, int batched)
+{
+	int n_chunks = dev->param.chunks_per_block;
+	int result = YAFFS_OK;
+	int i;
+
+	dev->n_scan_blocks++;
+
+	if (batched == YAFFS_OK) {
+		dev->n_scan_batched++;
+		dev->n_page_reads += n_chunks;
+		for (i = 0; i < n_chunks; i++)
+			if (tags[i].ecc_result > YAFFS_ECC_RESULT_NO_ERROR)
+				yaffs_handle_chunk_error(dev,
+					yaffs_get_block_info(dev, block));
+		return YAFFS_OK;
+	}
+
+	for (i = 0; i < n_chunks; i++)
+		if (yaffs_rd_chunk_tags_nand(dev, block * n_chunks + i,
+					     NULL, &tags[i]) != YAFFS_OK)
+			result = YAFFS_FAIL;
+
+	return result;
+}
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 * buffer, struct yaffs_ext_tags *tags)
@@ -20,6 +20,12 @@
 int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 			     u8 * buffer, struct yaffs_ext_tags *tags);
 
+int yaffs_rd_block_tags_batch(struct yaffs_dev *dev, int block,
+			      struct yaffs_ext_tags *tags);
+
+int yaffs_rd_block_tags_nand(struct yaffs_dev *dev, int block,
+			     struct yaffs_ext_tags *tags, int batched);
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 * buffer, struct yaffs_ext_tags *tags);
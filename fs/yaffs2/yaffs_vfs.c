@@ -54,6 +54,7 @@
 #include <linux/kthread.h>
 #include <linux/delay.h>
 #include <linux/freezer.h>
+#include <linux/ktime.h>
 
 #include <asm/div64.h>
 
@@ -97,6 +98,8 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_gc_cold_stream = 1;
+unsigned int yaffs_n_caches = 10;
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -104,6 +107,8 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_gc_cold_stream, uint, 0644);
+module_param(yaffs_n_caches, uint, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -121,17 +126,124 @@ static unsigned yaffs_gc_control_callback(struct yaffs_dev *dev)
 	return yaffs_gc_control;
 }
 
+/*
+ * Locking.
+ *
+ * gross_lock covers the object tree: the directories, the object and name
+ * hashes and the lifetime of the objects. Creating, deleting, renaming or
+ * changing the attributes of an object holds it for write, which keeps
+ * everybody else out.
+ *
+ * Everything else holds it for read and takes alloc_lock around its calls
+ * into the guts; that serialises the chunk allocator, gc, the chunk cache
+ * and NAND access. The gc leaves the freeing of objects it has emptied to
+ * yaffs_gc_cleanup(), which runs with gross_lock held for write, so the
+ * tree does not change under a reader while writes and gc are going on.
+ *
+ * That lets lookups and inode fills for objects that are wholly in RAM run
+ * on the read side alone (yaffs_lookup(), yaffs_iget()).
+ *
+ * Neither lock may be held across yaffs_get_inode() or filldir: the first
+ * can wait on an inode being evicted, the second can fault in a page.
+ */
+static ktime_t yaffs_lock_wait_begin(struct yaffs_linux_context *lc)
+{
+	atomic_inc(&lc->lock_waiters);
+	return ktime_get();
+}
+
+/* Account contended acquisitions, so that lock hold times that hurt other
+ * users of the partition show up in /proc/yaffs.
+ */
+static void yaffs_lock_wait_end(struct yaffs_linux_context *lc, ktime_t start)
+{
+	u32 waited = (u32) ktime_to_us(ktime_sub(ktime_get(), start));
+
+	atomic_dec(&lc->lock_waiters);
+
+	spin_lock(&lc->stats_lock);
+	lc->n_lock_waits++;
+	lc->lock_wait_ms += waited / 1000;
+	if (waited > lc->lock_wait_max_us)
+		lc->lock_wait_max_us = waited;
+	spin_unlock(&lc->stats_lock);
+}
+
 static void yaffs_gross_lock(struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	ktime_t start;
+
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking %p", current);
-	mutex_lock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	if (!down_write_trylock(&lc->gross_lock)) {
+		start = yaffs_lock_wait_begin(lc);
+		down_write(&lc->gross_lock);
+		yaffs_lock_wait_end(lc, start);
+	}
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked %p", current);
 }
 
 static void yaffs_gross_unlock(struct yaffs_dev *dev)
 {
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking %p", current);
-	mutex_unlock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	up_write(&(yaffs_dev_to_lc(dev)->gross_lock));
+}
+
+static void yaffs_gross_lock_rd(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	ktime_t start;
+
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs read locking %p", current);
+	if (!down_read_trylock(&lc->gross_lock)) {
+		start = yaffs_lock_wait_begin(lc);
+		down_read(&lc->gross_lock);
+		yaffs_lock_wait_end(lc, start);
+	}
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs read locked %p", current);
+}
+
+static void yaffs_gross_unlock_rd(struct yaffs_dev *dev)
+{
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs read unlocking %p", current);
+	up_read(&(yaffs_dev_to_lc(dev)->gross_lock));
+}
+
+/* Caller holds gross_lock for read */
+static void yaffs_alloc_lock(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	ktime_t start;
+
+	if (!mutex_trylock(&lc->alloc_lock)) {
+		start = yaffs_lock_wait_begin(lc);
+		mutex_lock(&lc->alloc_lock);
+		yaffs_lock_wait_end(lc, start);
+	}
+}
+
+static void yaffs_alloc_unlock(struct yaffs_dev *dev)
+{
+	mutex_unlock(&(yaffs_dev_to_lc(dev)->alloc_lock));
+}
+
+/* For calls into the guts that do not change the object tree */
+static void yaffs_io_lock(struct yaffs_dev *dev)
+{
+	yaffs_gross_lock_rd(dev);
+	yaffs_alloc_lock(dev);
+}
+
+static void yaffs_io_unlock(struct yaffs_dev *dev)
+{
+	yaffs_alloc_unlock(dev);
+	yaffs_gross_unlock_rd(dev);
+}
+
+/* Is anybody blocked on either lock? */
+static int yaffs_gross_lock_contended(struct yaffs_dev *dev)
+{
+	return atomic_read(&yaffs_dev_to_lc(dev)->lock_waiters) > 0;
 }
 
 static void yaffs_fill_inode_from_obj(struct inode *inode,
@@ -156,13 +268,24 @@ static struct inode *yaffs_iget(struct super_block *sb, unsigned long ino)
 	 * need to lock again.
 	 */
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_rd(dev);
 
 	obj = yaffs_find_by_number(dev, inode->i_ino);
 
-	yaffs_fill_inode_from_obj(inode, obj);
+	/* An object that is wholly in RAM can be read without the allocator
+	 * lock. Hard links and lazy loaded objects need a header read.
+	 */
+	if (obj && !obj->lazy_loaded &&
+	    obj->variant_type != YAFFS_OBJECT_TYPE_HARDLINK) {
+		smp_rmb();
+		yaffs_fill_inode_from_obj(inode, obj);
+	} else {
+		yaffs_alloc_lock(dev);
+		yaffs_fill_inode_from_obj(inode, obj);
+		yaffs_alloc_unlock(dev);
+	}
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_rd(dev);
 
 	unlock_new_inode(inode);
 	return inode;
@@ -370,23 +493,51 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry,
 {
 	struct yaffs_obj *obj;
 	struct inode *inode = NULL;
+	ktime_t start;
+	u32 ns;
+
+	struct yaffs_obj *dir_obj = yaffs_inode_to_obj(dir);
+	struct yaffs_dev *dev = dir_obj->my_dev;
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	int exclusive = 0;
 
-	struct yaffs_dev *dev = yaffs_inode_to_obj(dir)->my_dev;
+	yaffs_gross_lock_rd(dev);
 
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
+	if (dir_obj->variant.dir_variant.n_unhashed > 0) {
+		/* Hashing the directory's names changes the tree */
+		yaffs_gross_unlock_rd(dev);
 		yaffs_gross_lock(dev);
+		exclusive = 1;
+	}
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_lookup for %d:%s",
-		yaffs_inode_to_obj(dir)->obj_id, dentry->d_name.name);
-
-	obj = yaffs_find_by_name(yaffs_inode_to_obj(dir), dentry->d_name.name);
-
-	obj = yaffs_get_equivalent_obj(obj);	/* in case it was a hardlink */
+		dir_obj->obj_id, dentry->d_name.name);
+
+	start = ktime_get();
+	if (exclusive ||
+	    !yaffs_find_by_name_cached(dir_obj, dentry->d_name.name, &obj)) {
+		if (!exclusive)
+			yaffs_alloc_lock(dev);
+		obj = yaffs_find_by_name(dir_obj, dentry->d_name.name);
+		obj = yaffs_get_equivalent_obj(obj);	/* in case it was a hardlink */
+		if (!exclusive)
+			yaffs_alloc_unlock(dev);
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	spin_lock(&lc->stats_lock);
+	dev->n_timed_lookups++;
+	dev->name_lookup_ns += ns;
+	if (ns > dev->name_lookup_max_ns)
+		dev->name_lookup_max_ns = ns;
+	spin_unlock(&lc->stats_lock);
 
 	/* Can't hold gross lock when calling yaffs_get_inode() */
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
+	if (exclusive)
 		yaffs_gross_unlock(dev);
+	else
+		yaffs_gross_unlock_rd(dev);
 
 	if (obj) {
 		yaffs_trace(YAFFS_TRACE_OS,
@@ -452,9 +603,9 @@ static int yaffs_sync_object(struct file *file, int datasync)
 	dev = obj->my_dev;
 
 	yaffs_trace(YAFFS_TRACE_OS | YAFFS_TRACE_SYNC, "yaffs_sync_object");
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 	yaffs_flush_file(obj, 1, datasync);
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 	return 0;
 }
 /*
@@ -600,9 +751,9 @@ static ssize_t yaffs_getxattr(struct dentry * dentry, const char *name, void *bu
 
 	if (error == 0) {
 		dev = obj->my_dev;
-		yaffs_gross_lock(dev);
+		yaffs_io_lock(dev);
 		error = yaffs_get_xattrib(obj, name, buff, size);
-		yaffs_gross_unlock(dev);
+		yaffs_io_unlock(dev);
 
 	}
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_getxattr done returning %d", error);
@@ -650,9 +801,9 @@ static ssize_t yaffs_listxattr(struct dentry * dentry, char *buff, size_t size)
 
 	if (error == 0) {
 		dev = obj->my_dev;
-		yaffs_gross_lock(dev);
+		yaffs_io_lock(dev);
 		error = yaffs_list_xattrib(obj, buff, size);
-		yaffs_gross_unlock(dev);
+		yaffs_io_unlock(dev);
 
 	}
 	yaffs_trace(YAFFS_TRACE_OS,
@@ -810,9 +961,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 	obj = yaffs_dentry_to_obj(f->f_dentry);
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
-
-	yaffs_dev_to_lc(dev)->readdir_process = current;
+	yaffs_io_lock(dev);
 
 	offset = f->f_pos;
 
@@ -829,12 +978,12 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry . ino %d",
 			(int)inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_io_unlock(dev);
 		if (filldir(dirent, ".", 1, offset, inode->i_ino, DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_io_lock(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_io_lock(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -842,14 +991,14 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry .. ino %d",
 			(int)f->f_dentry->d_parent->d_inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_io_unlock(dev);
 		if (filldir(dirent, "..", 2, offset,
 			    f->f_dentry->d_parent->d_inode->i_ino,
 			    DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_io_lock(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_io_lock(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -876,17 +1025,17 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 				"yaffs_readdir: %s inode %d",
 				name, yaffs_get_obj_inode(l));
 
-			yaffs_gross_unlock(dev);
+			yaffs_io_unlock(dev);
 
 			if (filldir(dirent,
 				    name,
 				    strlen(name),
 				    offset, this_inode, this_type) < 0) {
-				yaffs_gross_lock(dev);
+				yaffs_io_lock(dev);
 				goto out;
 			}
 
-			yaffs_gross_lock(dev);
+			yaffs_io_lock(dev);
 
 			offset++;
 			f->f_pos++;
@@ -896,8 +1045,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 out:
 	yaffs_search_end(sc);
-	yaffs_dev_to_lc(dev)->readdir_process = NULL;
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 
 	return ret_val;
 }
@@ -921,11 +1069,11 @@ static int yaffs_file_flush(struct file *file, fl_owner_t id)
 	  	"yaffs_file_flush object %d (%s)",
 		obj->obj_id, obj->dirty ? "dirty" : "clean");
 
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 
 	yaffs_flush_file(obj, 1, 0);
 
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 
 	return 0;
 }
@@ -1013,19 +1161,34 @@ static struct export_operations yaffs_export_ops = {
 
 /*-----------------------------------------------------------------*/
 
+/*
+ * A symlink's alias is fixed when the object is created and the object is
+ * pinned by the dentry, so it can be copied without the gross lock. Hard
+ * links to symlinks need the lock to resolve the equivalent object.
+ */
+static YCHAR *yaffs_vfs_get_alias(struct yaffs_obj *obj)
+{
+	struct yaffs_dev *dev = obj->my_dev;
+	YCHAR *alias;
+
+	if (obj->variant_type == YAFFS_OBJECT_TYPE_SYMLINK)
+		return yaffs_clone_str(obj->variant.symlink_variant.alias);
+
+	yaffs_io_lock(dev);
+	alias = yaffs_get_symlink_alias(obj);
+	yaffs_io_unlock(dev);
+
+	return alias;
+}
+
 static int yaffs_readlink(struct dentry *dentry, char __user * buffer,
 			  int buflen)
 {
 	unsigned char *alias;
 	int ret;
 
-	struct yaffs_dev *dev = yaffs_dentry_to_obj(dentry)->my_dev;
-
-	yaffs_gross_lock(dev);
-
-	alias = yaffs_get_symlink_alias(yaffs_dentry_to_obj(dentry));
 
-	yaffs_gross_unlock(dev);
+	alias = yaffs_vfs_get_alias(yaffs_dentry_to_obj(dentry));
 
 	if (!alias)
 		return -ENOMEM;
@@ -1039,12 +1202,8 @@ static void *yaffs_follow_link(struct dentry *dentry, struct nameidata *nd)
 {
 	unsigned char *alias;
 	void *ret;
-	struct yaffs_dev *dev = yaffs_dentry_to_obj(dentry)->my_dev;
-
-	yaffs_gross_lock(dev);
 
-	alias = yaffs_get_symlink_alias(yaffs_dentry_to_obj(dentry));
-	yaffs_gross_unlock(dev);
+	alias = yaffs_vfs_get_alias(yaffs_dentry_to_obj(dentry));
 
 	if (!alias) {
 		ret = ERR_PTR(-ENOMEM);
@@ -1111,6 +1270,7 @@ static void yaffs_evict_inode(struct inode *inode)
 		dev = obj->my_dev;
 		yaffs_gross_lock(dev);
 		yaffs_unstitch_obj(inode, obj);
+		yaffs_gc_cleanup(dev);
 		yaffs_gross_unlock(dev);
 	}
 
@@ -1149,12 +1309,12 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 
 	ret = yaffs_file_rd(obj, pg_buf,
 			    pg->index << PAGE_CACHE_SHIFT, PAGE_CACHE_SIZE);
 
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 
 	if (ret >= 0)
 		ret = 0;
@@ -1244,7 +1404,7 @@ static int yaffs_writepage(struct page *page, struct writeback_control *wbc)
 
 	obj = yaffs_inode_to_obj(inode);
 	dev = obj->my_dev;
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_writepage at %08x, size %08x",
@@ -1262,7 +1422,7 @@ static int yaffs_writepage(struct page *page, struct writeback_control *wbc)
 		"writepag1: obj = %05x, ino = %05x",
 		(int)obj->variant.file_variant.file_size, (int)inode->i_size);
 
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 
 	kunmap(page);
 	set_page_writeback(page);
@@ -1291,11 +1451,11 @@ static ssize_t yaffs_hold_space(struct file *f)
 
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 
 	n_free_chunks = yaffs_get_n_free_chunks(dev);
 
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 
 	return (n_free_chunks > 20) ? 1 : 0;
 }
@@ -1309,9 +1469,9 @@ static void yaffs_release_space(struct file *f)
 
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 }
 
 static int yaffs_write_begin(struct file *filp, struct address_space *mapping,
@@ -1381,7 +1541,7 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 
 	inode = f->f_dentry->d_inode;
 
@@ -1419,7 +1579,7 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 		}
 
 	}
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 	return (n_written == 0) && (n > 0) ? -ENOSPC : n_written;
 }
 
@@ -1462,7 +1622,7 @@ static int yaffs_statfs(struct dentry *dentry, struct kstatfs *buf)
 
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_statfs");
 
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 
 	buf->f_type = YAFFS_MAGIC;
 	buf->f_bsize = sb->s_blocksize;
@@ -1514,7 +1674,7 @@ static int yaffs_statfs(struct dentry *dentry, struct kstatfs *buf)
 	buf->f_ffree = 0;
 	buf->f_bavail = buf->f_bfree;
 
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 	return 0;
 }
 
@@ -1583,7 +1743,7 @@ static int yaffs_do_sync_fs(struct super_block *sb, int request_checkpoint)
 		request_checkpoint ? "checkpoint requested" : "no checkpoint",
 		oneshot_checkpoint ? " one-shot" : "");
 
-	yaffs_gross_lock(dev);
+	yaffs_io_lock(dev);
 	do_checkpoint = ((request_checkpoint && !gc_urgent) ||
 			 oneshot_checkpoint) && !dev->is_checkpointed;
 
@@ -1593,7 +1753,7 @@ static int yaffs_do_sync_fs(struct super_block *sb, int request_checkpoint)
 		if (oneshot_checkpoint)
 			yaffs_auto_checkpoint &= ~4;
 	}
-	yaffs_gross_unlock(dev);
+	yaffs_io_unlock(dev);
 
 	return 0;
 }
@@ -1641,7 +1801,20 @@ static int yaffs_bg_thread_fn(void *data)
 		if (try_to_freeze())
 			continue;
 
-		yaffs_gross_lock(dev);
+		/* Background work can wait; foreground callers can't */
+		if (yaffs_gross_lock_contended(dev)) {
+			context->n_bg_deferrals++;
+			schedule_timeout_interruptible(HZ / 50 + 1);
+			continue;
+		}
+
+		if (dev->gc_cleanup_pending) {
+			yaffs_gross_lock(dev);
+			yaffs_gc_cleanup(dev);
+			yaffs_gross_unlock(dev);
+		}
+
+		yaffs_io_lock(dev);
 
 		now = jiffies;
 
@@ -1668,7 +1841,7 @@ static int yaffs_bg_thread_fn(void *data)
 				next_gc = next_dir_update;
                         }
 		}
-		yaffs_gross_unlock(dev);
+		yaffs_io_unlock(dev);
 		expires = next_dir_update;
 		if (time_before(next_gc, expires))
 			expires = next_gc;
@@ -2215,7 +2388,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->chunks_per_block = YAFFS_CHUNKS_PER_BLOCK;
 	param->total_bytes_per_chunk = YAFFS_BYTES_PER_CHUNK;
 	param->n_reserved_blocks = 5;
-	param->n_caches = (options.no_cache) ? 0 : 10;
+	param->n_caches = (options.no_cache) ? 0 : yaffs_n_caches;
 	param->inband_tags = options.inband_tags;
 
 #ifdef CONFIG_YAFFS_DISABLE_LAZY_LOAD
@@ -2236,6 +2409,9 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->defered_dir_update = 1;
 #endif
 
+	/* The read side of gross_lock relies on gc not freeing objects */
+	param->defered_gc_cleanup = 1;
+
 	if (options.tags_ecc_overridden)
 		param->no_tags_ecc = !options.tags_ecc_on;
 
@@ -2262,6 +2438,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 		param->read_chunk_tags_fn = nandmtd2_read_chunk_tags;
 		param->bad_block_fn = nandmtd2_mark_block_bad;
 		param->query_block_fn = nandmtd2_query_block;
+		param->read_block_tags_fn = nandmtd2_read_block_tags;
 		yaffs_dev_to_lc(dev)->spare_buffer = 
 		                kmalloc(mtd->oobsize, GFP_NOFS);
 		param->is_yaffs2 = 1;
@@ -2287,6 +2464,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	param->sb_dirty_fn = yaffs_touch_super;
 	param->gc_control = yaffs_gc_control_callback;
+	param->gc_cold_stream = yaffs_gc_cold_stream;
 
 	yaffs_dev_to_lc(dev)->super = sb;
 
@@ -2320,7 +2498,10 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	INIT_LIST_HEAD(&(yaffs_dev_to_lc(dev)->search_contexts));
 	param->remove_obj_fn = yaffs_remove_obj_callback;
 
-	mutex_init(&(yaffs_dev_to_lc(dev)->gross_lock));
+	init_rwsem(&(yaffs_dev_to_lc(dev)->gross_lock));
+	mutex_init(&(yaffs_dev_to_lc(dev)->alloc_lock));
+	spin_lock_init(&(yaffs_dev_to_lc(dev)->stats_lock));
+	atomic_set(&(yaffs_dev_to_lc(dev)->lock_waiters), 0);
 
 	yaffs_gross_lock(dev);
 
@@ -2446,8 +2627,22 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 	return buf;
 }
 
+/* Flash writes per chunk written by the user, times 100 */
+static unsigned yaffs_write_amp_x100(struct yaffs_dev *dev)
+{
+	u64 amp = (u64) dev->n_page_writes * 100;
+
+	if (dev->n_page_writes <= dev->n_gc_copies)
+		return 0;
+
+	do_div(amp, dev->n_page_writes - dev->n_gc_copies);
+	return (unsigned)amp;
+}
+
 static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+
 	buf +=
 	    sprintf(buf, "data_bytes_per_chunk.. %d\n",
 		    dev->data_bytes_per_chunk);
@@ -2473,6 +2668,10 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "oldest_dirty_gc_count. %u\n",
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
+	buf += sprintf(buf, "n_cold_copies......... %u\n", dev->n_cold_copies);
+	buf += sprintf(buf, "n_hot_reopens......... %u\n", dev->n_hot_reopens);
+	buf += sprintf(buf, "write_amp_x100........ %u\n",
+			yaffs_write_amp_x100(dev));
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
@@ -2486,12 +2685,42 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_tags_ecc_unfixed.... %u\n",
 		    dev->n_tags_ecc_unfixed);
 	buf += sprintf(buf, "cache_hits............ %u\n", dev->cache_hits);
+	buf += sprintf(buf, "cache_misses.......... %u\n", dev->cache_misses);
+	buf +=
+	    sprintf(buf, "n_cache_flushes....... %u\n", dev->n_cache_flushes);
+	buf +=
+	    sprintf(buf, "n_cache_flush_chunks.. %u\n",
+		    dev->n_cache_flush_chunks);
+	buf +=
+	    sprintf(buf, "n_name_lookups........ %u\n", dev->n_name_lookups);
+	buf +=
+	    sprintf(buf, "n_name_compares....... %u\n", dev->n_name_compares);
+	buf += sprintf(buf, "n_name_walks.......... %u\n", dev->n_name_walks);
+	buf +=
+	    sprintf(buf, "n_timed_lookups....... %u\n", dev->n_timed_lookups);
+	buf +=
+	    sprintf(buf, "name_lookup_avg_ns.... %u\n",
+		    dev->n_timed_lookups ?
+		    (u32) div_u64(dev->name_lookup_ns, dev->n_timed_lookups) :
+		    0);
+	buf +=
+	    sprintf(buf, "name_lookup_max_ns.... %u\n",
+		    dev->name_lookup_max_ns);
+	buf += sprintf(buf, "n_scan_blocks......... %u\n", dev->n_scan_blocks);
+	buf += sprintf(buf, "n_scan_batched........ %u\n", dev->n_scan_batched);
+	buf += sprintf(buf, "scan_ms............... %u\n", dev->scan_ms);
+	buf += sprintf(buf, "mount_ms.............. %u\n", dev->mount_ms);
 	buf +=
 	    sprintf(buf, "n_deleted_files....... %u\n", dev->n_deleted_files);
 	buf +=
 	    sprintf(buf, "n_unlinked_files...... %u\n", dev->n_unlinked_files);
 	buf += sprintf(buf, "refresh_count......... %u\n", dev->refresh_count);
 	buf += sprintf(buf, "n_bg_deletions........ %u\n", dev->n_bg_deletions);
+	buf += sprintf(buf, "n_lock_waits.......... %u\n", lc->n_lock_waits);
+	buf += sprintf(buf, "lock_wait_ms.......... %u\n", lc->lock_wait_ms);
+	buf +=
+	    sprintf(buf, "lock_wait_max_us...... %u\n", lc->lock_wait_max_us);
+	buf += sprintf(buf, "n_bg_deferrals........ %u\n", lc->n_bg_deferrals);
 
 	return buf;
 }
@@ -298,6 +298,8 @@ int yaffs1_scan(struct yaffs_dev *dev)
 						    YAFFS_OBJECT_TYPE_DIRECTORY;
 						INIT_LIST_HEAD(&parent->
 							       variant.dir_variant.children);
+						parent->variant.dir_variant.
+						    n_unhashed = 0;
 					} else if (!parent
 						   || parent->variant_type !=
 						   YAFFS_OBJECT_TYPE_DIRECTORY) {
@@ -702,8 +702,11 @@ static int yaffs2_wr_checkpt_data(struct yaffs_dev *dev)
 		ok = 0;
 	}
 
-	if (ok)
+	if (ok) {
+		/* The checkpoint only records one allocation block */
+		yaffs_skip_rest_of_cold_block(dev);
 		ok = yaffs2_checkpt_open(dev, 1);
+	}
 
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
@@ -942,6 +945,51 @@ struct yaffs_block_index {
 	int block;
 };
 
+/*
+ * The scan reads the tags of a whole block at a time. While one block is
+ * being processed the tags of the next block to scan are read on the scan
+ * workqueue, so that the flash transfers overlap the tag processing.
+ */
+struct yaffs2_scan_batch {
+	struct work_struct work;
+	struct completion done;
+	struct yaffs_dev *dev;
+	int block;
+	int result;
+	struct yaffs_ext_tags *tags;
+};
+
+static void yaffs2_scan_batch_work(struct work_struct *work)
+{
+	struct yaffs2_scan_batch *batch =
+	    container_of(work, struct yaffs2_scan_batch, work);
+
+	batch->result =
+	    yaffs_rd_block_tags_batch(batch->dev, batch->block, batch->tags);
+	complete(&batch->done);
+}
+
+static void yaffs2_scan_batch_start(struct workqueue_struct *wq,
+				    struct yaffs2_scan_batch *batch, int block)
+{
+	batch->block = block;
+	INIT_COMPLETION(batch->done);
+
+	if (wq)
+		queue_work(wq, &batch->work);
+	else
+		yaffs2_scan_batch_work(&batch->work);
+}
+
+static struct yaffs_ext_tags *yaffs2_scan_batch_wait(struct yaffs2_scan_batch
+						     *batch)
+{
+	wait_for_completion(&batch->done);
+	yaffs_rd_block_tags_nand(batch->dev, batch->block, batch->tags,
+				 batch->result);
+	return batch->tags;
+}
+
 static int yaffs2_ybicmp(const void *a, const void *b)
 {
 	int aseq = ((struct yaffs_block_index *)a)->seq;
@@ -987,10 +1035,34 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
 
+	struct yaffs2_scan_batch batch[2];
+	struct yaffs_ext_tags *block_tags;
+	struct workqueue_struct *scan_wq = NULL;
+	int cur_batch;
+	unsigned long scan_start = jiffies;
+
 	yaffs_trace(YAFFS_TRACE_SCAN,
 		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
 		dev->internal_start_block, dev->internal_end_block);
 
+	for (c = 0; c < 2; c++) {
+		batch[c].dev = dev;
+		batch[c].tags = kmalloc(dev->param.chunks_per_block *
+					sizeof(struct yaffs_ext_tags),
+					GFP_NOFS);
+		INIT_WORK(&batch[c].work, yaffs2_scan_batch_work);
+		init_completion(&batch[c].done);
+	}
+
+	if (!batch[0].tags || !batch[1].tags) {
+		yaffs_trace(YAFFS_TRACE_SCAN,
+			"yaffs2_scan_backwards() could not allocate tags buffers!"
+			);
+		kfree(batch[0].tags);
+		kfree(batch[1].tags);
+		return YAFFS_FAIL;
+	}
+
 	dev->seq_number = YAFFS_LOWEST_SEQUENCE_NUMBER;
 
 	block_index = kmalloc(n_blocks * sizeof(struct yaffs_block_index),
@@ -1006,6 +1078,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		yaffs_trace(YAFFS_TRACE_SCAN,
 			"yaffs2_scan_backwards() could not allocate block index!"
 			);
+		kfree(batch[0].tags);
+		kfree(batch[1].tags);
 		return YAFFS_FAIL;
 	}
 
@@ -1086,6 +1160,15 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	end_iter = n_to_scan - 1;
 	yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "%d blocks to scan", n_to_scan);
 
+	/* Only worth a thread if the driver can do batched reads */
+	if (dev->param.read_block_tags_fn && n_to_scan > 1)
+		scan_wq = create_singlethread_workqueue("yaffs_scan");
+
+	cur_batch = 0;
+	if (n_to_scan > 0)
+		yaffs2_scan_batch_start(scan_wq, &batch[cur_batch],
+					block_index[end_iter].block);
+
 	/* For each block.... backwards */
 	for (block_iter = end_iter; !alloc_failed && block_iter >= start_iter;
 	     block_iter--) {
@@ -1096,6 +1179,14 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		/* get the block to scan in the correct order */
 		blk = block_index[block_iter].block;
 
+		/* Collect this block's tags and start on the next block's */
+		block_tags = yaffs2_scan_batch_wait(&batch[cur_batch]);
+		cur_batch ^= 1;
+		if (block_iter > start_iter)
+			yaffs2_scan_batch_start(scan_wq, &batch[cur_batch],
+						block_index[block_iter -
+							    1].block);
+
 		bi = yaffs_get_block_info(dev, blk);
 
 		state = bi->block_state;
@@ -1114,8 +1205,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			tags = block_tags[c];
 
 			/* Let's have a good look at this chunk... */
 
@@ -1456,6 +1546,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 						    YAFFS_OBJECT_TYPE_DIRECTORY;
 						INIT_LIST_HEAD(&parent->
 							       variant.dir_variant.children);
+						parent->variant.dir_variant.
+						    n_unhashed = 0;
 					} else if (!parent
 						   || parent->variant_type !=
 						   YAFFS_OBJECT_TYPE_DIRECTORY) {
@@ -1575,6 +1667,12 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	yaffs_skip_rest_of_block(dev);
 
+	/* Waits for a read still in flight if the scan was cut short */
+	if (scan_wq)
+		destroy_workqueue(scan_wq);
+	kfree(batch[0].tags);
+	kfree(batch[1].tags);
+
 	if (alt_block_index)
 		vfree(block_index);
 	else
@@ -1592,7 +1690,11 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	if (alloc_failed)
 		return YAFFS_FAIL;
 
-	yaffs_trace(YAFFS_TRACE_SCAN, "yaffs2_scan_backwards ends");
+	dev->scan_ms = jiffies_to_msecs(jiffies - scan_start);
+
+	yaffs_trace(YAFFS_TRACE_SCAN,
+		"yaffs2_scan_backwards ends: %u blocks (%u batched) in %u ms",
+		dev->n_scan_blocks, dev->n_scan_batched, dev->scan_ms);
 
 	return YAFFS_OK;
 }
@@ -18,6 +18,7 @@
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/list.h>
+#include <linux/workqueue.h>
 #endif
 
 /* The early_suspend structure defines suspend and resume hooks to be called
@@ -29,6 +30,11 @@
  * the suspend handlers have already been called without a matching call to the
  * resume handlers, the suspend handler will be called directly from
  * register_early_suspend. This direct call can violate the normal level order.
+ * A handler registered with register_early_suspend_async promises that no
+ * handler that follows it in the same pass depends on it having finished:
+ * no higher level handler on suspend, and no lower level handler on resume.
+ * It is then run on a worker, concurrently with the handlers that follow
+ * it, and only the end of the pass waits for it.
  */
 enum {
 	EARLY_SUSPEND_LEVEL_BLANK_SCREEN = 50,
@@ -41,14 +47,23 @@ struct early_suspend {
 	int level;
 	void (*suspend)(struct early_suspend *h);
 	void (*resume)(struct early_suspend *h);
+	/* private to kernel/power/earlysuspend.c */
+	bool async;
+	struct work_struct work;
+	u32 suspend_us;
+	u32 resume_us;
+	u32 max_suspend_us;
+	u32 max_resume_us;
 #endif
 };
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 void register_early_suspend(struct early_suspend *handler);
+void register_early_suspend_async(struct early_suspend *handler);
 void unregister_early_suspend(struct early_suspend *handler);
 #else
 #define register_early_suspend(handler) do { } while (0)
+#define register_early_suspend_async(handler) do { } while (0)
 #define unregister_early_suspend(handler) do { } while (0)
 #endif
 
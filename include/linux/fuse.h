@@ -47,12 +47,16 @@
  *  - FUSE_IOCTL_UNRESTRICTED shall now return with array of 'struct
  *    fuse_ioctl_iovec' instead of ambiguous 'struct iovec'
  *  - add FUSE_IOCTL_32BIT flag
+ *
+ * Local extension (no version bump, negotiated with FUSE_PASSTHROUGH)
+ *  - add FUSE_DEV_IOC_PASSTHROUGH_OPEN and fuse_open_out.passthrough_fh
  */
 
 #ifndef _LINUX_FUSE_H
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -155,6 +159,7 @@ struct fuse_file_lock {
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
+ * FUSE_PASSTHROUGH: file reads/writes may go straight to a backing file
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -163,6 +168,7 @@ struct fuse_file_lock {
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
+#define FUSE_PASSTHROUGH	(1 << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -380,7 +386,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__u32	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -624,4 +630,13 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+/*
+ * Passthrough: the daemon registers an open backing file on /dev/fuse and
+ * gets back a non-zero id, which it then returns in the passthrough_fh
+ * field of its OPEN/CREATE reply.  Reads, writes and mmap on that open file
+ * then go straight to the backing file.
+ */
+#define FUSE_DEV_IOC_MAGIC		229
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 1, __u32)
+
 #endif /* _LINUX_FUSE_H */
@@ -57,6 +57,8 @@ struct mmc_ext_csd {
 	unsigned int		sec_trim_mult;	/* Secure trim multiplier  */
 	unsigned int		sec_erase_mult;	/* Secure erase multiplier */
 	unsigned int		trim_timeout;		/* In milliseconds */
+	u8			max_packed_writes;	/* eMMC 4.5 packed cmds */
+	u8			max_packed_reads;
 };
 
 struct sd_scr {
@@ -34,14 +34,18 @@
 #define RMNET_MODE_LLP_ETH  (0x01)
 #define RMNET_MODE_LLP_IP   (0x02)
 #define RMNET_MODE_QOS      (0x04)
+#define RMNET_MODE_AGG      (0x08)
 #define RMNET_MODE_MASK     (RMNET_MODE_LLP_ETH | \
 			     RMNET_MODE_LLP_IP  | \
-			     RMNET_MODE_QOS)
+			     RMNET_MODE_QOS     | \
+			     RMNET_MODE_AGG)
 
 #define RMNET_IS_MODE_QOS(mode)  \
 	((mode & RMNET_MODE_QOS) == RMNET_MODE_QOS)
 #define RMNET_IS_MODE_IP(mode)   \
 	((mode & RMNET_MODE_LLP_IP) == RMNET_MODE_LLP_IP)
+#define RMNET_IS_MODE_AGG(mode)  \
+	((mode & RMNET_MODE_AGG) == RMNET_MODE_AGG)
 
 /* IOCTL command enum
  * Values chosen to not conflict with other drivers in the ecosystem */
@@ -55,6 +59,9 @@ enum rmnet_ioctl_cmds_e {
 	RMNET_IOCTL_GET_OPMODE       = 0x000089F7, /* Get operation mode     */
 	RMNET_IOCTL_OPEN             = 0x000089F8, /* Open transport port    */
 	RMNET_IOCTL_CLOSE            = 0x000089F9, /* Close transport port   */
+	RMNET_IOCTL_SET_AGG_ENABLE   = 0x000089FA, /* Set TX aggregation on  */
+	RMNET_IOCTL_SET_AGG_DISABLE  = 0x000089FB, /* Set TX aggregation off */
+	RMNET_IOCTL_GET_AGG          = 0x000089FC, /* Get TX aggregation     */
 	RMNET_IOCTL_MAX
 };
 
@@ -66,4 +73,11 @@ struct QMI_QOS_HDR_S {
 	unsigned long    flow_id;
 };
 
+/* Header preceding each packet of an aggregated transmit frame */
+#define RMNET_AGG_HDR_S  __attribute((__packed__)) rmnet_agg_hdr_s
+struct RMNET_AGG_HDR_S {
+	unsigned short   len;         /* packet length, network order */
+	unsigned short   reserved;
+};
+
 #endif /* _MSM_RMNET_H_ */
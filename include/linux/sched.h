@@ -140,6 +140,9 @@ extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
+extern unsigned long sched_cpu_util(int cpu);
+extern unsigned long sched_cpu_nr_running_avg(int cpu);
+extern unsigned long sched_task_util(struct task_struct *p);
 
 
 extern void calc_global_load(unsigned long ticks);
@@ -1139,6 +1142,13 @@ struct sched_statistics {
 };
 #endif
 
+/* Decayed average, see kernel/sched_avg.c */
+struct sched_avg {
+	u64			last_update;
+	u32			load_sum;
+	u32			period_sum;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1152,6 +1162,8 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+	struct sched_avg	avg;
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -1953,6 +1965,10 @@ int sched_rt_handler(struct ctl_table *table, int write,
 
 extern unsigned int sysctl_sched_compat_yield;
 
+#ifdef CONFIG_CFS_BANDWIDTH
+extern unsigned int sysctl_sched_cfs_bandwidth_slice;
+#endif
+
 #ifdef CONFIG_SCHED_AUTOGROUP
 extern unsigned int sysctl_sched_autogroup_enabled;
 
@@ -323,4 +323,30 @@ static inline void unlock_system_sleep(void)
 }
 #endif
 
+#ifdef CONFIG_PM_SUSPEND_TIMELINE
+/*
+ * Suspend/resume timeline: callers take a timestamp with
+ * suspend_timeline_start() before a callback and pass it to
+ * suspend_timeline_record() after it.  The last few hundred entries are
+ * kept and shown in debugfs, together with what woke the system up.
+ * suspend_timeline_record_dev() is for per-device callbacks and drops
+ * the ones faster than a threshold set in debugfs.
+ */
+extern u64 suspend_timeline_start(void);
+extern __printf(2, 3)
+void suspend_timeline_record(u64 start, const char *fmt, ...);
+extern __printf(2, 3)
+void suspend_timeline_record_dev(u64 start, const char *fmt, ...);
+extern __printf(1, 2)
+void suspend_timeline_wakeup(const char *fmt, ...);
+#else
+static inline u64 suspend_timeline_start(void) { return 0; }
+static inline __printf(2, 3)
+void suspend_timeline_record(u64 start, const char *fmt, ...) {}
+static inline __printf(2, 3)
+void suspend_timeline_record_dev(u64 start, const char *fmt, ...) {}
+static inline __printf(1, 2)
+void suspend_timeline_wakeup(const char *fmt, ...) {}
+#endif
+
 #endif /* _LINUX_SUSPEND_H */
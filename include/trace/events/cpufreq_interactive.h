@@ -0,0 +1,47 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_interactive
+
+#if !defined(_TRACE_CPUFREQ_INTERACTIVE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_INTERACTIVE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One event per load evaluation: the load seen, the target before and
+ * after, and why the target was or was not changed.
+ */
+TRACE_EVENT(cpufreq_interactive_eval,
+
+	TP_PROTO(unsigned int cpu, unsigned int load,
+		 unsigned int cur_target, unsigned int cur_actual,
+		 unsigned int new_target, const char *reason),
+
+	TP_ARGS(cpu, load, cur_target, cur_actual, new_target, reason),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	cpu		)
+		__field(	unsigned int,	load		)
+		__field(	unsigned int,	cur_target	)
+		__field(	unsigned int,	cur_actual	)
+		__field(	unsigned int,	new_target	)
+		__string(	reason,		reason		)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->load		= load;
+		__entry->cur_target	= cur_target;
+		__entry->cur_actual	= cur_actual;
+		__entry->new_target	= new_target;
+		__assign_str(reason, reason);
+	),
+
+	TP_printk("cpu=%u load=%u cur=%u actual=%u new=%u reason=%s",
+		  __entry->cpu, __entry->load, __entry->cur_target,
+		  __entry->cur_actual, __entry->new_target, __get_str(reason))
+);
+
+#endif /* _TRACE_CPUFREQ_INTERACTIVE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -13,9 +13,13 @@
  *
  */
 
+#include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/suspend.h>
 #include <linux/rtc.h>
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
@@ -43,10 +47,71 @@ enum {
 };
 static int state;
 
-void register_early_suspend(struct early_suspend *handler)
+/*
+ * Async handlers run here.  The pool is bounded so that a pass does not
+ * flood the system with i2c and regulator traffic all at once.
+ */
+#define EARLY_SUSPEND_MAX_ASYNC 4
+static struct workqueue_struct *early_suspend_wq;
+static bool async_resuming;
+static u32 last_suspend_us;
+static u32 last_resume_us;
+
+static void call_handler(struct early_suspend *h, bool resume)
+{
+	ktime_t start = ktime_get();
+	u64 tl = suspend_timeline_start();
+	u32 us;
+
+	if (resume)
+		h->resume(h);
+	else
+		h->suspend(h);
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	suspend_timeline_record(tl, "%s %pf",
+				resume ? "late_resume" : "early_suspend",
+				resume ? (void *)h->resume : (void *)h->suspend);
+	if (resume) {
+		h->resume_us = us;
+		if (us > h->max_resume_us)
+			h->max_resume_us = us;
+	} else {
+		h->suspend_us = us;
+		if (us > h->max_suspend_us)
+			h->max_suspend_us = us;
+	}
+}
+
+static void early_suspend_async(struct work_struct *work)
+{
+	struct early_suspend *h = container_of(work, struct early_suspend,
+					       work);
+
+	call_handler(h, async_resuming);
+}
+
+/* Called with early_suspend_lock held */
+static void run_handler(struct early_suspend *h, bool resume)
+{
+	if (resume ? !h->resume : !h->suspend)
+		return;
+
+	if (h->async && early_suspend_wq)
+		queue_work(early_suspend_wq, &h->work);
+	else
+		call_handler(h, resume);
+}
+
+static void __register_early_suspend(struct early_suspend *handler, bool async)
 {
 	struct list_head *pos;
 
+	handler->async = async;
+	INIT_WORK(&handler->work, early_suspend_async);
+	handler->suspend_us = handler->max_suspend_us = 0;
+	handler->resume_us = handler->max_resume_us = 0;
+
 	mutex_lock(&early_suspend_lock);
 	list_for_each(pos, &early_suspend_handlers) {
 		struct early_suspend *e;
@@ -59,8 +124,19 @@ void register_early_suspend(struct early_suspend *handler)
 		handler->suspend(handler);
 	mutex_unlock(&early_suspend_lock);
 }
+
+void register_early_suspend(struct early_suspend *handler)
+{
+	__register_early_suspend(handler, false);
+}
 EXPORT_SYMBOL(register_early_suspend);
 
+void register_early_suspend_async(struct early_suspend *handler)
+{
+	__register_early_suspend(handler, true);
+}
+EXPORT_SYMBOL(register_early_suspend_async);
+
 void unregister_early_suspend(struct early_suspend *handler)
 {
 	mutex_lock(&early_suspend_lock);
@@ -73,6 +149,7 @@ static void early_suspend(struct work_struct *work)
 {
 	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t start;
 	int abort = 0;
 
 	mutex_lock(&early_suspend_lock);
@@ -92,10 +169,15 @@ static void early_suspend(struct work_struct *work)
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
-	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL)
-			pos->suspend(pos);
-	}
+	start = ktime_get();
+	async_resuming = false;
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		run_handler(pos, false);
+	if (early_suspend_wq)
+		flush_workqueue(early_suspend_wq);
+	last_suspend_us = ktime_to_us(ktime_sub(ktime_get(), start));
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("early_suspend: done in %u us\n", last_suspend_us);
 	mutex_unlock(&early_suspend_lock);
 
 	suspend_sys_sync_queue();
@@ -110,6 +192,7 @@ static void late_resume(struct work_struct *work)
 {
 	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t start;
 	int abort = 0;
 
 	mutex_lock(&early_suspend_lock);
@@ -127,11 +210,15 @@ static void late_resume(struct work_struct *work)
 	}
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
+	start = ktime_get();
+	async_resuming = true;
 	list_for_each_entry_reverse(pos, &early_suspend_handlers, link)
-		if (pos->resume != NULL)
-			pos->resume(pos);
+		run_handler(pos, true);
+	if (early_suspend_wq)
+		flush_workqueue(early_suspend_wq);
+	last_resume_us = ktime_to_us(ktime_sub(ktime_get(), start));
 	if (debug_mask & DEBUG_SUSPEND)
-		pr_info("late_resume: done\n");
+		pr_info("late_resume: done in %u us\n", last_resume_us);
 abort:
 	mutex_unlock(&early_suspend_lock);
 }
@@ -172,3 +259,52 @@ suspend_state_t get_suspend_state(void)
 {
 	return requested_suspend_state;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int early_suspend_stats_show(struct seq_file *m, void *unused)
+{
+	struct early_suspend *pos;
+
+	mutex_lock(&early_suspend_lock);
+	seq_printf(m, "last pass: suspend %u us, resume %u us\n",
+		   last_suspend_us, last_resume_us);
+	seq_printf(m, "%-40s %5s %5s %10s %10s %10s %10s\n", "handler",
+		   "level", "async", "suspend_us", "max", "resume_us", "max");
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		seq_printf(m, "%-40pf %5d %5d %10u %10u %10u %10u\n",
+			   pos->suspend ? (void *)pos->suspend :
+					  (void *)pos->resume,
+			   pos->level, pos->async,
+			   pos->suspend_us, pos->max_suspend_us,
+			   pos->resume_us, pos->max_resume_us);
+	mutex_unlock(&early_suspend_lock);
+	return 0;
+}
+
+static int early_suspend_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, early_suspend_stats_show, NULL);
+}
+
+static const struct file_operations early_suspend_stats_fops = {
+	.open = early_suspend_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
+static int __init early_suspend_init(void)
+{
+	early_suspend_wq = alloc_workqueue("early_suspend", WQ_UNBOUND,
+					   EARLY_SUSPEND_MAX_ASYNC);
+	if (!early_suspend_wq)
+		pr_err("early_suspend: no workqueue, async handlers run "
+		       "serially\n");
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("early_suspend_stats", S_IRUGO, NULL, NULL,
+			    &early_suspend_stats_fops);
+#endif
+	return 0;
+}
+late_initcall(early_suspend_init);
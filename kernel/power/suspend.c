@@ -168,8 +168,12 @@ static int suspend_enter(suspend_state_t state)
 	error = sysdev_suspend(PMSG_SUSPEND);
 	if (!error) {
 		if (!(suspend_test(TEST_CORE) || pm_wakeup_pending())) {
+			u64 tl = suspend_timeline_start();
+
 			error = suspend_ops->enter(state);
 			events_check_enabled = false;
+			suspend_timeline_record(tl, "platform enter %pf",
+						suspend_ops->enter);
 		}
 		sysdev_resume();
 	}
@@ -200,6 +204,7 @@ static int suspend_enter(suspend_state_t state)
  */
 int suspend_devices_and_enter(suspend_state_t state)
 {
+	u64 tl;
 	int error;
 
 	if (!suspend_ops)
@@ -214,7 +219,9 @@ int suspend_devices_and_enter(suspend_state_t state)
 	suspend_console();
 	pm_restrict_gfp_mask();
 	suspend_test_start();
+	tl = suspend_timeline_start();
 	error = dpm_suspend_start(PMSG_SUSPEND);
+	suspend_timeline_record(tl, "dpm_suspend_start");
 	if (error) {
 		printk(KERN_ERR "PM: Some devices failed to suspend\n");
 		goto Recover_platform;
@@ -223,11 +230,15 @@ int suspend_devices_and_enter(suspend_state_t state)
 	if (suspend_test(TEST_DEVICES))
 		goto Recover_platform;
 
+	tl = suspend_timeline_start();
 	suspend_enter(state);
+	suspend_timeline_record(tl, "suspend_enter");
 
  Resume_devices:
 	suspend_test_start();
+	tl = suspend_timeline_start();
 	dpm_resume_end(PMSG_RESUME);
+	suspend_timeline_record(tl, "dpm_resume_end");
 	suspend_test_finish("resume devices");
 	pm_restore_gfp_mask();
 	resume_console();
@@ -269,6 +280,7 @@ static void suspend_finish(void)
  */
 int enter_state(suspend_state_t state)
 {
+	u64 tl;
 	int error;
 
 	if (!valid_state(state))
@@ -277,6 +289,7 @@ int enter_state(suspend_state_t state)
 	if (!mutex_trylock(&pm_mutex))
 		return -EBUSY;
 
+	tl = suspend_timeline_start();
 	suspend_sys_sync_queue();
 
 	pr_debug("PM: Preparing system for %s sleep\n", pm_states[state]);
@@ -293,6 +306,7 @@ int enter_state(suspend_state_t state)
  Finish:
 	pr_debug("PM: Finishing wakeup.\n");
 	suspend_finish();
+	suspend_timeline_record(tl, "enter_state %s", pm_states[state]);
  Unlock:
 	mutex_unlock(&pm_mutex);
 	return error;
@@ -0,0 +1,154 @@
+/*
+ * kernel/power/suspend_timeline.c - Suspend/resume timeline recorder.
+ *
+ * Keeps the start time and duration of the most recent early suspend
+ * handlers, slow device PM callbacks and platform sleep steps, and what
+ * woke the system up, so that a slow suspend or resume can be taken apart
+ * after the fact.
+ *
+ * This file is released under the GPLv2.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/suspend.h>
+
+#define TIMELINE_ENTRIES	256
+#define TIMELINE_NAME_LEN	64
+
+struct timeline_entry {
+	u64 start;		/* sched_clock() ns */
+	u32 duration_us;
+	bool wakeup;
+	char name[TIMELINE_NAME_LEN];
+};
+
+static struct timeline_entry timeline[TIMELINE_ENTRIES];
+static unsigned int timeline_head;	/* next slot to fill */
+static unsigned int timeline_count;
+static DEFINE_SPINLOCK(timeline_lock);
+
+/*
+ * A cycle runs a callback for nearly every device, each a few times, and
+ * recording them all would push the rest of the cycle out of the ring.
+ * Only device callbacks at least this slow are kept.
+ */
+static u32 timeline_dev_min_us = 1000;
+
+/*
+ * sched_clock() rather than ktime_get(): the platform sleep code runs
+ * after timekeeping has been suspended.
+ */
+u64 suspend_timeline_start(void)
+{
+	return sched_clock();
+}
+
+static void timeline_add(u64 start, u64 end, bool wakeup,
+			 const char *fmt, va_list args)
+{
+	struct timeline_entry *e;
+	unsigned long flags;
+
+	spin_lock_irqsave(&timeline_lock, flags);
+	e = &timeline[timeline_head];
+	timeline_head = (timeline_head + 1) % TIMELINE_ENTRIES;
+	if (timeline_count < TIMELINE_ENTRIES)
+		timeline_count++;
+
+	e->start = start;
+	e->duration_us = end > start ? div_u64(end - start, NSEC_PER_USEC) : 0;
+	e->wakeup = wakeup;
+	vsnprintf(e->name, sizeof(e->name), fmt, args);
+	spin_unlock_irqrestore(&timeline_lock, flags);
+}
+
+void suspend_timeline_record(u64 start, const char *fmt, ...)
+{
+	u64 end = sched_clock();
+	va_list args;
+
+	va_start(args, fmt);
+	timeline_add(start, end, false, fmt, args);
+	va_end(args);
+}
+
+void suspend_timeline_record_dev(u64 start, const char *fmt, ...)
+{
+	u64 end = sched_clock();
+	va_list args;
+
+	if (end - start < (u64)timeline_dev_min_us * NSEC_PER_USEC)
+		return;
+
+	va_start(args, fmt);
+	timeline_add(start, end, false, fmt, args);
+	va_end(args);
+}
+
+void suspend_timeline_wakeup(const char *fmt, ...)
+{
+	u64 now = sched_clock();
+	va_list args;
+
+	va_start(args, fmt);
+	timeline_add(now, now, true, fmt, args);
+	va_end(args);
+}
+
+/*
+ * Entries are added when a callback returns, so a callback shows up
+ * after the ones it called.  Sort by start time when reading if needed.
+ */
+static int timeline_show(struct seq_file *m, void *unused)
+{
+	unsigned int i, idx;
+	unsigned long flags;
+
+	seq_printf(m, "%-17s %10s  %s\n", "start", "usecs", "callback");
+	spin_lock_irqsave(&timeline_lock, flags);
+	idx = (timeline_head + TIMELINE_ENTRIES - timeline_count) %
+		TIMELINE_ENTRIES;
+	for (i = 0; i < timeline_count; i++) {
+		struct timeline_entry *e = &timeline[idx];
+		u64 secs = e->start;
+		u32 nsecs = do_div(secs, NSEC_PER_SEC);
+
+		if (e->wakeup)
+			seq_printf(m, "%10llu.%06u %10s  wakeup: %s\n",
+				   secs, nsecs / NSEC_PER_USEC, "-", e->name);
+		else
+			seq_printf(m, "%10llu.%06u %10u  %s\n",
+				   secs, nsecs / NSEC_PER_USEC,
+				   e->duration_us, e->name);
+		idx = (idx + 1) % TIMELINE_ENTRIES;
+	}
+	spin_unlock_irqrestore(&timeline_lock, flags);
+	return 0;
+}
+
+static int timeline_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, timeline_show, NULL);
+}
+
+static const struct file_operations timeline_fops = {
+	.open = timeline_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init suspend_timeline_init(void)
+{
+	debugfs_create_file("suspend_timeline", S_IRUGO, NULL, NULL,
+			    &timeline_fops);
+	debugfs_create_u32("suspend_timeline_dev_min_us", S_IRUGO | S_IWUSR,
+			   NULL, &timeline_dev_min_us);
+	return 0;
+}
+late_initcall(suspend_timeline_init);
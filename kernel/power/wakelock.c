@@ -13,11 +13,14 @@
  *
  */
 
+#include <linux/backing-dev.h>
+#include <linux/fs.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/rtc.h>
 #include <linux/suspend.h>
-#include <linux/syscalls.h> /* sys_sync */
+#include <linux/vmstat.h>
+#include <linux/writeback.h>
 #include <linux/wakelock.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
@@ -43,6 +46,13 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/*
+ * Active locks with a timeout are also kept in a tree ordered by expiry,
+ * and the ones without are only counted, so that deciding whether a lock
+ * type is held, and until when, does not walk the active list.
+ */
+static struct rb_root timed_wake_locks[WAKE_LOCK_TYPE_COUNT];
+static atomic_t untimed_wake_locks[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 static int suspend_sys_sync_count;
 static DEFINE_SPINLOCK(suspend_sys_sync_lock);
@@ -52,11 +62,11 @@ struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
 suspend_state_t requested_suspend_state = PM_SUSPEND_MEM;
 static struct wake_lock unknown_wakeup;
+static int wait_for_wakeup;
 
 #ifdef CONFIG_WAKELOCK_STAT
 static struct wake_lock deleted_wake_locks;
 static ktime_t last_sleep_time_update;
-static int wait_for_wakeup;
 
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
@@ -197,11 +207,44 @@ static void update_sleep_wait_stats_locked(int done)
 #endif
 
 
+static void add_timed_lock_locked(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &timed_wake_locks[type].rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct wake_lock *entry;
+
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, node);
+		if (time_before(lock->expires, entry->expires))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&lock->node, parent, p);
+	rb_insert_color(&lock->node, &timed_wake_locks[type]);
+}
+
+/* Take an active lock out of the expiry tree or the untimed count */
+static void deactivate_lock_locked(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		rb_erase(&lock->node, &timed_wake_locks[type]);
+	else
+		atomic_dec(&untimed_wake_locks[type]);
+}
+
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	deactivate_lock_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -232,29 +275,43 @@ static void print_active_locks(int type)
 	}
 }
 
+/*
+ * Returns -1 if a lock of this type is held without a timeout, otherwise
+ * the time until the last timed one expires (0 if none is held).  Timed
+ * locks that have run out are expired on the way.
+ */
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct rb_node *node;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	if (atomic_read(&untimed_wake_locks[type]))
+		return -1;
+
+	while ((node = rb_first(&timed_wake_locks[type]))) {
+		struct wake_lock *lock = rb_entry(node, struct wake_lock, node);
+
+		if ((long)(lock->expires - jiffies) > 0)
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+
+	node = rb_last(&timed_wake_locks[type]);
+	if (!node)
+		return 0;
+	return rb_entry(node, struct wake_lock, node)->expires - jiffies;
 }
 
 long has_wake_lock(int type)
 {
 	long ret;
 	unsigned long irqflags;
+
+	/* a lock held without a timeout settles it, no need for list_lock */
+	if (atomic_read(&untimed_wake_locks[type]) &&
+	    !(debug_mask & DEBUG_SUSPEND))
+		return -1;
+
 	spin_lock_irqsave(&list_lock, irqflags);
 	ret = has_wake_lock_locked(type);
 	if (ret && (debug_mask & DEBUG_SUSPEND) && type == WAKE_LOCK_SUSPEND)
@@ -264,17 +321,72 @@ long has_wake_lock(int type)
 }
 
 
+static bool suspend_sys_sync_abort;
+/* a sync queued since the last suspend_sys_sync_queue() stopped early */
+static bool suspend_sys_sync_cancelled;
+
+struct suspend_sync_state {
+	int synced;
+	int clean;
+	bool cancelled;
+};
+
+/*
+ * Sync one filesystem, unless it has nothing dirty, in which case only
+ * its ->sync_fs is called to commit a journal that may have pending
+ * metadata.  Stop once a suspend waiting for us has been aborted; what
+ * is left is still dirty and gets synced on the next attempt.
+ */
+static void suspend_sync_one_sb(struct super_block *sb, void *arg)
+{
+	struct suspend_sync_state *st = arg;
+
+	if (st->cancelled || suspend_sys_sync_abort) {
+		st->cancelled = true;
+		return;
+	}
+	if ((sb->s_flags & MS_RDONLY) || sb->s_bdi == &noop_backing_dev_info)
+		return;
+
+	if (sb->s_dirt || bdi_has_dirty_io(sb->s_bdi)) {
+		sync_filesystem(sb);
+		st->synced++;
+	} else {
+		if (sb->s_op->sync_fs)
+			sb->s_op->sync_fs(sb, 1);
+		st->clean++;
+	}
+}
+
 static void suspend_sys_sync(struct work_struct *work)
 {
+	struct suspend_sync_state st = { 0, 0, false };
+	unsigned long written = global_page_state(NR_WRITTEN);
+	u64 tl = suspend_timeline_start();
+	ktime_t start = ktime_get();
+	unsigned long kb;
+	u32 ms;
+
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("PM: Syncing filesystems...\n");
 
-	sys_sync();
+	wakeup_flusher_threads(0);
+	iterate_supers(suspend_sync_one_sb, &st);
+
+	ms = ktime_to_ms(ktime_sub(ktime_get(), start));
+	kb = (global_page_state(NR_WRITTEN) - written) << (PAGE_SHIFT - 10);
+	suspend_timeline_record(tl, "suspend_sys_sync %lu KB%s", kb,
+				st.cancelled ? " cancelled" : "");
 
 	if (debug_mask & DEBUG_SUSPEND)
-		pr_info("sync done.\n");
+		pr_info("sync %s: %d filesystems synced, %d clean, "
+			"%lu KB written in %u ms\n",
+			st.cancelled ? "cancelled" : "done",
+			st.synced, st.clean, kb, ms);
 
 	spin_lock(&suspend_sys_sync_lock);
+	if (st.cancelled)
+		suspend_sys_sync_cancelled = true;
 	suspend_sys_sync_count--;
 	spin_unlock(&suspend_sys_sync_lock);
 }
@@ -285,6 +397,13 @@ void suspend_sys_sync_queue(void)
 	int ret;
 
 	spin_lock(&suspend_sys_sync_lock);
+	/*
+	 * A new attempt: let a sync still running from an aborted one
+	 * carry on, and forget that it was cut short, since the sync
+	 * queued here covers what it skipped.
+	 */
+	suspend_sys_sync_abort = false;
+	suspend_sys_sync_cancelled = false;
 	suspend_sys_sync_count++;
 	ret = queue_work(suspend_sys_sync_work_queue, &suspend_sys_sync_work);
 	if (!ret)
@@ -292,7 +411,6 @@ void suspend_sys_sync_queue(void)
 	spin_unlock(&suspend_sys_sync_lock);
 }
 
-static bool suspend_sys_sync_abort;
 static void suspend_sys_sync_handler(unsigned long);
 static DEFINE_TIMER(suspend_sys_sync_timer, suspend_sys_sync_handler, 0, 0);
 /* value should be less then half of input event wake lock timeout value
@@ -312,16 +430,26 @@ static void suspend_sys_sync_handler(unsigned long arg)
 	}
 }
 
+/*
+ * Fail with -EAGAIN unless every sync queued for this attempt ran to the
+ * end, whether it was cut short while we waited or before.  The abort
+ * flag is left set so a sync still running stops; the next
+ * suspend_sys_sync_queue() clears it.
+ */
 int suspend_sys_sync_wait(void)
 {
-	suspend_sys_sync_abort = false;
+	bool cancelled;
 
 	if (suspend_sys_sync_count != 0) {
 		mod_timer(&suspend_sys_sync_timer, jiffies +
 				SUSPEND_SYS_SYNC_TIMEOUT);
 		wait_for_completion(&suspend_sys_sync_comp);
 	}
-	if (suspend_sys_sync_abort) {
+
+	spin_lock(&suspend_sys_sync_lock);
+	cancelled = suspend_sys_sync_abort || suspend_sys_sync_cancelled;
+	spin_unlock(&suspend_sys_sync_lock);
+	if (cancelled) {
 		pr_info("suspend aborted....while waiting for sys_sync\n");
 		return -EAGAIN;
 	}
@@ -392,9 +520,7 @@ static DEFINE_TIMER(expire_timer, expire_wake_locks, 0, 0);
 static int power_suspend_late(struct device *dev)
 {
 	int ret = has_wake_lock(WAKE_LOCK_SUSPEND) ? -EAGAIN : 0;
-#ifdef CONFIG_WAKELOCK_STAT
 	wait_for_wakeup = 1;
-#endif
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("power_suspend_late return %d\n", ret);
 	return ret;
@@ -446,7 +572,8 @@ void wake_lock_destroy(struct wake_lock *lock)
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
-	lock->flags &= ~WAKE_LOCK_INITIALIZED;
+	deactivate_lock_locked(lock);
+	lock->flags &= ~(WAKE_LOCK_INITIALIZED | WAKE_LOCK_ACTIVE);
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
 		deleted_wake_locks.stat.count += lock->stat.count;
@@ -478,19 +605,23 @@ static void wake_lock_internal(
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
 	BUG_ON(!(lock->flags & WAKE_LOCK_INITIALIZED));
-#ifdef CONFIG_WAKELOCK_STAT
 	if (type == WAKE_LOCK_SUSPEND && wait_for_wakeup) {
 		if (debug_mask & DEBUG_WAKEUP)
 			pr_info("wakeup wake lock: %s\n", lock->name);
+		suspend_timeline_wakeup("wake lock %s", lock->name);
 		wait_for_wakeup = 0;
+#ifdef CONFIG_WAKELOCK_STAT
 		lock->stat.wakeup_count++;
+#endif
 	}
+#ifdef CONFIG_WAKELOCK_STAT
 	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
 	    (long)(lock->expires - jiffies) <= 0) {
 		wake_unlock_stat_locked(lock, 0);
 		lock->stat.last_time = ktime_get();
 	}
 #endif
+	deactivate_lock_locked(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
@@ -506,12 +637,14 @@ static void wake_lock_internal(
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
 		list_add_tail(&lock->link, &active_wake_locks[type]);
+		add_timed_lock_locked(lock, type);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
 		list_add(&lock->link, &active_wake_locks[type]);
+		atomic_inc(&untimed_wake_locks[type]);
 	}
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
@@ -565,6 +698,7 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	deactivate_lock_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -619,8 +753,11 @@ static int __init wakelocks_init(void)
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		timed_wake_locks[i] = RB_ROOT;
+		atomic_set(&untimed_wake_locks[i], 0);
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
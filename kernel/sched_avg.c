@@ -0,0 +1,148 @@
+/*
+ * Decayed load tracking, for runqueues and tasks.
+ *
+ * Time is split into ~1ms (1024us) periods.  A period that ended n
+ * periods ago contributes with weight y^n, where y^32 = 1/2, so load
+ * from 32ms ago counts half as much as load now.  The sums are kept
+ * incrementally and only touched when the tracked quantity changes
+ * (enqueue, dequeue) and at the tick, which makes them cheap enough to
+ * keep for every runqueue all the time.
+ *
+ * Each struct sched_avg keeps two sums over the same decayed window:
+ * load_sum, the time-weighted value being tracked, and period_sum, the
+ * elapsed time.  Their ratio is the average.
+ */
+
+#define LOAD_AVG_PERIOD	32
+#define LOAD_AVG_MAX	47742	/* maximum possible period_sum */
+#define LOAD_AVG_MAX_N	345	/* periods needed to reach LOAD_AVG_MAX */
+
+/* y^n * 2^32, for n < LOAD_AVG_PERIOD */
+static const u32 load_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+	0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+	0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+	0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+	0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/* sum of 1024 * y^k for k = 1..n, for n <= LOAD_AVG_PERIOD */
+static const u32 load_avg_yN_sum[] = {
+	    0,  1002,  1982,  2942,  3881,  4800,  5699,  6579,  7440,  8282,
+	 9107,  9914, 10704, 11476, 12232, 12972, 13696, 14405, 15098, 15777,
+	16441, 17091, 17726, 18349, 18957, 19553, 20136, 20707, 21265, 21812,
+	22346, 22870, 23382,
+};
+
+/* val * y^n */
+static u64 decay_load(u64 val, u64 n)
+{
+	unsigned int local_n;
+
+	if (!n)
+		return val;
+	if (unlikely(n > LOAD_AVG_PERIOD * 63))
+		return 0;
+
+	local_n = n;
+	if (unlikely(local_n >= LOAD_AVG_PERIOD)) {
+		val >>= local_n / LOAD_AVG_PERIOD;
+		local_n %= LOAD_AVG_PERIOD;
+	}
+
+	/* val fits in 32 bits here, see __update_load_avg() */
+	val *= load_avg_yN_inv[local_n];
+	return val >> 32;
+}
+
+/* sum of 1024 * y^k for k = 1..n */
+static u32 load_avg_contrib(unsigned int n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= LOAD_AVG_PERIOD))
+		return load_avg_yN_sum[n];
+	if (unlikely(n >= LOAD_AVG_MAX_N))
+		return LOAD_AVG_MAX;
+
+	do {
+		contrib /= 2;
+		contrib += load_avg_yN_sum[LOAD_AVG_PERIOD];
+		n -= LOAD_AVG_PERIOD;
+	} while (n > LOAD_AVG_PERIOD);
+
+	contrib = decay_load(contrib, n);
+	return contrib + load_avg_yN_sum[n];
+}
+
+/*
+ * Account the time since the last update as having had value @weight,
+ * decaying everything older.  @weight is 0 or 1 for busy/runnable
+ * tracking and nr_running for the runqueue length, which keeps load_sum
+ * within 32 bits for any sane number of runnable tasks.
+ */
+static void __update_load_avg(struct sched_avg *sa, u64 now,
+			      unsigned long weight)
+{
+	u64 delta = now - sa->last_update;
+	unsigned int delta_w, periods;
+
+	/* first update, or the clock went backwards across a migration */
+	if (!sa->last_update || (s64)delta < 0) {
+		sa->last_update = now;
+		return;
+	}
+
+	/* ns -> ~us; sub-us remainders are dropped */
+	delta >>= 10;
+	if (!delta)
+		return;
+	sa->last_update = now;
+
+	delta_w = sa->period_sum % 1024;
+	if (delta + delta_w >= 1024) {
+		/* finish the current period, then decay it */
+		delta_w = 1024 - delta_w;
+		sa->load_sum += weight * delta_w;
+		sa->period_sum += delta_w;
+		delta -= delta_w;
+
+		periods = div_u64(delta, 1024);
+		delta -= (u64)periods * 1024;
+
+		sa->load_sum = decay_load(sa->load_sum, periods + 1);
+		sa->period_sum = decay_load(sa->period_sum, periods + 1);
+
+		/* whole periods in between */
+		delta_w = load_avg_contrib(periods);
+		sa->load_sum += weight * delta_w;
+		sa->period_sum += delta_w;
+	}
+
+	sa->load_sum += weight * delta;
+	sa->period_sum += delta;
+}
+
+/* average of the tracked value, scaled by SCHED_LOAD_SCALE */
+static unsigned long sched_avg_ratio(struct sched_avg *sa)
+{
+	return div_u64((u64)sa->load_sum << SCHED_LOAD_SHIFT,
+		       sa->period_sum + 1);
+}
+
+/*
+ * Called with rq->lock held and rq->clock up to date, before anything
+ * that changes rq->nr_running.
+ */
+static inline void update_rq_load_avg(struct rq *rq)
+{
+	__update_load_avg(&rq->busy_avg, rq->clock, rq->nr_running != 0);
+	__update_load_avg(&rq->nr_running_avg, rq->clock, rq->nr_running);
+}
+
+static inline void update_task_load_avg(struct rq *rq, struct task_struct *p,
+					int runnable)
+{
+	__update_load_avg(&p->se.avg, rq->clock, runnable);
+}
@@ -277,6 +277,10 @@ static void print_cpu(struct seq_file *m, int cpu)
 	P(cpu_load[2]);
 	P(cpu_load[3]);
 	P(cpu_load[4]);
+	SEQ_printf(m, "  .%-30s: %lu\n", "busy_avg",
+		   sched_avg_ratio(&rq->busy_avg));
+	SEQ_printf(m, "  .%-30s: %lu\n", "nr_running_avg",
+		   sched_avg_ratio(&rq->nr_running_avg));
 #undef P
 #undef PN
 
@@ -425,6 +429,8 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 	PN(se.exec_start);
 	PN(se.vruntime);
 	PN(se.sum_exec_runtime);
+	P(se.avg.load_sum);
+	P(se.avg.period_sum);
 
 	nr_switches = p->nvcsw + p->nivcsw;
 